@@ -4,10 +4,37 @@ in vec3 a_vertex;
 in vec3 a_normal;
 in vec2 a_uv;
 in vec4 a_color;
+in uint a_draw_id; //only set by the static batches
 
-uniform mat4 u_model;
-uniform mat4 u_viewprojection;
-uniform vec3 u_camera_position;
+//written once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameBlock
+{
+	mat4 u_viewprojection;
+	vec3 u_camera_position;
+	float u_time;
+	vec4 u_ambient_light;
+};
+
+//written for every draw (binding 2)
+layout(std140, binding = 2) uniform ObjectBlock
+{
+	mat4 u_model;
+	vec4 u_color;
+};
+
+//static batches: one entry per draw, picked with the base instance of its command
+struct sObject
+{
+	mat4 model;
+	vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer ObjectBuffer
+{
+	sObject u_objects[];
+};
+
+uniform bool u_batched;
 
 //this will store the color for the pixel shader
 out vec3 v_position;
@@ -15,18 +42,22 @@ out vec3 v_world_position;
 out vec3 v_normal;
 out vec2 v_uv;
 out vec4 v_color;
+flat out vec4 v_material_color;
 
 void main()
 {	
+	mat4 model = u_batched ? u_objects[a_draw_id].model : u_model;
+
 	//calcule the normal in camera space (the NormalMatrix is like ViewMatrix but without traslation)
-	v_normal = (u_model * vec4( a_normal, 0.0) ).xyz;
+	v_normal = (model * vec4( a_normal, 0.0) ).xyz;
 	
 	//calcule the vertex in object space
 	v_position = a_vertex;
-	v_world_position = (u_model * vec4( v_position, 1.0) ).xyz;
+	v_world_position = (model * vec4( v_position, 1.0) ).xyz;
 	
 	//store the color in the varying var to use it from the pixel shader
 	v_color = a_color;
+	v_material_color = u_batched ? u_objects[a_draw_id].color : u_color;
 
 	//store the texture coordinates
 	v_uv = a_uv;
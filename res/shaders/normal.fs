@@ -1,10 +1,133 @@
 #version 450 core
 
+#define LIGHT_DIRECTIONAL 0
+#define LIGHT_POINT 1
+#define LIGHT_SPOT 2
+
+in vec3 v_world_position;
 in vec3 v_normal;
+flat in vec4 v_material_color;
+
+//written once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameBlock
+{
+	mat4 u_viewprojection;
+	vec3 u_camera_position;
+	float u_time;
+	vec4 u_ambient_light;
+};
+
+struct sLight
+{
+	vec4 color;
+	vec3 position;
+	float intensity;
+	vec3 direction; //front of the light, it points to the light
+	float shininess;
+	int type;
+	float max_distance;
+	vec2 padding;
+};
+
+#ifdef USE_LIGHT_CLUSTERS
+
+//grid of light clusters (binding 4), see LightClusters
+layout(std140, binding = 4) uniform ClusterBlock
+{
+	uvec4 u_cluster_dims;
+	vec4 u_cluster_depth_params;
+	vec4 u_cluster_slice_params;
+};
+
+//all the lights of the frame
+layout(std430, binding = 1) readonly buffer LightBuffer
+{
+	sLight u_lights[];
+};
+
+//offset and count in u_light_indices of every cluster
+layout(std430, binding = 2) readonly buffer ClusterBuffer
+{
+	uvec2 u_clusters[];
+};
+
+layout(std430, binding = 3) readonly buffer LightIndexBuffer
+{
+	uint u_light_indices[];
+};
+
+#else
+
+//same value as MAX_LIGHTS in uniformbuffer.h
+#define MAX_LIGHTS 64
+
+//all the lights, written once per frame (binding 3)
+layout(std140, binding = 3) uniform LightsBlock
+{
+	int u_num_lights;
+	sLight u_lights[MAX_LIGHTS];
+};
+
+#endif
 
 out vec4 FragColor;
 
+#ifdef USE_LIGHT_CLUSTERS
+//same slicing as LightClusters::computeBoxes, tiles in screen space and log depth slices
+uint getCluster()
+{
+	vec4 p = u_cluster_depth_params;
+	float ndc_z = gl_FragCoord.z * 2.0 - 1.0;
+	float depth = -(p.y - ndc_z * p.w) / (ndc_z * p.z - p.x);
+
+	uvec3 cluster;
+	cluster.xy = uvec2(gl_FragCoord.xy * u_cluster_slice_params.zw * vec2(u_cluster_dims.xy));
+	cluster.z = uint(max(log(depth) * u_cluster_slice_params.x + u_cluster_slice_params.y, 0.0));
+	cluster = min(cluster, u_cluster_dims.xyz - 1u);
+	return cluster.x + u_cluster_dims.x * (cluster.y + u_cluster_dims.y * cluster.z);
+}
+#endif
+
+vec3 shadeLight(uint i, vec3 N, vec3 V)
+{
+	vec3 L = normalize(u_lights[i].direction);
+	float attenuation = 1.0;
+
+	if (u_lights[i].type != LIGHT_DIRECTIONAL)
+	{
+		vec3 to_light = u_lights[i].position - v_world_position;
+		float dist = length(to_light);
+		vec3 D = L;
+		L = to_light / dist;
+		attenuation = clamp(1.0 - dist / u_lights[i].max_distance, 0.0, 1.0);
+		attenuation *= attenuation;
+
+		//fixed cone around the front of the spot
+		if (u_lights[i].type == LIGHT_SPOT)
+			attenuation *= smoothstep(0.8, 0.9, dot(L, D));
+	}
+
+	float NdotL = max(dot(N, L), 0.0);
+	vec3 R = reflect(-L, N);
+	float specular = NdotL > 0.0 ? pow(max(dot(R, V), 0.0), u_lights[i].shininess) : 0.0;
+
+	return u_lights[i].color.xyz * u_lights[i].intensity * attenuation * (NdotL + specular);
+}
+
 void main()
 {
-	FragColor = vec4(v_normal, 1.0);
-}
\ No newline at end of file
+	vec3 N = normalize(v_normal);
+	vec3 V = normalize(u_camera_position - v_world_position);
+	vec3 light = u_ambient_light.xyz;
+
+#ifdef USE_LIGHT_CLUSTERS
+	uvec2 range = u_clusters[getCluster()];
+	for (uint k = range.x; k < range.x + range.y; ++k)
+		light += shadeLight(u_light_indices[k], N, V);
+#else
+	for (int i = 0; i < u_num_lights; ++i)
+		light += shadeLight(uint(i), N, V);
+#endif
+
+	FragColor = vec4(v_material_color.xyz * light, v_material_color.a);
+}
@@ -1,6 +1,9 @@
 #include "application.h"
 
 #include "./physics/particle.h"
+#include "./framework/scenefile.h"
+
+#include "ImGuizmo.h"
 
 bool render_wireframe = false;
 Camera* Application::camera = nullptr;
@@ -24,22 +27,39 @@ void Application::init(GLFWwindow* window)
 
     this->ambient_light = glm::vec4(0.15f);
 
+    // the front of a directional light points to it
+    Light* sun = new Light(glm::vec3(0.f, 10.f, 0.f), LIGHT_DIRECTIONAL);
+    sun->setLocalMatrix(glm::rotate(sun->getLocalMatrix(), glm::radians(-60.f), glm::vec3(1.f, 0.f, 0.f)));
+    this->light_list.push_back(sun);
+
+    // Uniform blocks
+    this->frame_ubo = new UniformBuffer(sizeof(sFrameBlock), UNIFORM_BLOCK_FRAME);
+    this->light_ubo = new UniformBuffer(UniformBuffer::Align(sizeof(sLightBlock)), UNIFORM_BLOCK_LIGHT);
+    this->lights_ubo = new UniformBuffer(sizeof(sLightsBlock), UNIFORM_BLOCK_LIGHTS);
+
     /* ADD NODES TO THE SCENE */
     SceneNode* example = new SceneNode();
-    example->mesh = Mesh::Get("res/meshes/sphere.obj");
-    example->material = new StandardMaterial();
-    example->model[3][1] = 3.f; // move up
+    example->setMesh(Mesh::GetAsync("res/meshes/sphere.obj"));
+    example->setMaterial(new StandardMaterial());
+    example->setLocalMatrix(glm::translate(glm::mat4(1.f), glm::vec3(0.f, 3.f, 0.f))); // move up
+    example->setStatic(true);
     this->node_list.push_back(example);
 
     SceneNode* floor = new SceneNode("Floor");
-    floor->mesh = new Mesh();
-    floor->mesh->createPlane(500.f);
-    floor->material = new StandardMaterial(glm::vec4(0.2f));
-    floor->model[3][1] = -0.1f; // solve visual error with grid
+    Mesh* plane = new Mesh();
+    plane->createPlane(500.f);
+    floor->setMesh(plane);
+    floor->setMaterial(new StandardMaterial(glm::vec4(0.2f)));
+    floor->setLocalMatrix(glm::translate(glm::mat4(1.f), glm::vec3(0.f, -0.1f, 0.f))); // solve visual error with grid
+    floor->setStatic(true);
     this->node_list.push_back(floor);
 
     // We will have 1 particle (bullet), and reuse it for each shot
     blue::Particle* bullet = new blue::Particle();
+    this->particle_list.push_back(bullet);
+
+    // the materials only submitted their shaders, wait for all of them at once
+    Shader::ResolveAll();
 }
 
 void Application::update(float dt)
@@ -50,6 +70,15 @@ void Application::update(float dt)
         this->camera->orbit(-delta.x * dt, delta.y * dt);
     }
     this->lastMousePosition = this->mousePosition;
+
+    // world matrices of the nodes moved this frame and their children
+    SceneGraph::get()->update();
+
+    // static nodes moved from the editor or the gizmo, the batch draws them with its own copy of the models
+    this->static_batch.updateObjects(*SceneGraph::get(), SceneGraph::get()->batched_changed);
+
+    // refit the boxes that moved, rebuilt only after nodes were added or removed
+    this->scene_bvh.update(*SceneGraph::get());
 }
 
 void Application::render()
@@ -64,12 +93,29 @@ void Application::render()
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
-    for (unsigned int i = 0; i < this->node_list.size(); i++)
-    {
-        this->node_list[i]->render(this->camera);
+    uploadFrameUniforms(this->camera);
+
+    // static nodes are culled and drawn by the batch, the queue skips them
+    updateStaticBatch();
+    this->static_batch.render(this->camera);
+
+    // skip the entities outside the camera, hidden or still loading, the batched ones were culled by the batch unless they need the wireframe
+    SceneGraph* scene = SceneGraph::get();
+    this->culler.cull(*scene, this->camera, this->flag_wireframe ? 0 : ENTITY_BATCHED);
 
-        if (this->flag_wireframe) this->node_list[i]->renderWireframe(this->camera);
+    // collect the draws straight from the component arrays and render them sorted by state
+    this->render_queue.clear();
+    for (size_t i = 0; i < scene->size(); i++)
+    {
+        if (!this->culler.visibility[i])
+            continue;
+        if (scene->material[i] && !(scene->flags[i] & ENTITY_BATCHED))
+            this->render_queue.submit(scene->mesh[i], scene->material[i], scene->world[i], this->camera, RENDER_PASS_OPAQUE);
+        if (this->flag_wireframe)
+            this->render_queue.submit(scene->mesh[i], WireframeMaterial::GetShared(), scene->world[i], this->camera, RENDER_PASS_WIREFRAME);
     }
+    this->render_queue.sort();
+    this->render_queue.render(this->camera);
 
     // Draw the floor grid
     if (this->flag_grid) drawGrid();
@@ -80,12 +126,46 @@ void Application::renderGUI()
     if (ImGui::TreeNodeEx("Scene", ImGuiTreeNodeFlags_DefaultOpen))
     {
         ImGui::ColorEdit3("Ambient light", (float*)&this->ambient_light);
+        ImGui::Text("Draws: %d Shader changes: %d Material changes: %d", this->render_queue.num_draws, this->render_queue.num_shader_changes, this->render_queue.num_material_changes);
+        ImGui::Text("Visible nodes: %d Culled: %d Transforms updated: %d", this->culler.num_visible, this->culler.num_culled, SceneGraph::get()->num_updated);
+        ImGui::Text("Selected: %s Pick: %.1f us BVH rebuilds: %d Refitted: %d", this->selected_node ? this->selected_node->name.c_str() : "none", this->pick_time, this->scene_bvh.num_rebuilds, this->scene_bvh.num_refitted);
+        ImGui::Text("Lights: %d Cluster indices: %d Max per cluster: %d", (int)this->light_list.size(), this->light_clusters.num_indices, this->light_clusters.max_cluster_lights);
+        ImGui::Text("Stream buffer: %d/%d KB GPU waits: %d", StreamBuffer::get()->frame_usage / 1024, StreamBuffer::get()->frame_size / 1024, StreamBuffer::get()->num_waits);
+        ImGui::Text("Textures loading: %d", Texture::num_async_loads);
+        ImGui::Text("Static batch: %d nodes, %d visible, %d draws", (int)this->static_batch.nodes.size(), this->static_batch.num_visible, this->static_batch.num_draw_calls);
+
+        FrameCapture* capture = FrameCapture::get();
+        if (ImGui::Button(capture->isRecording() ? "Stop recording" : "Record frames")) {
+            if (capture->isRecording())
+                capture->stop();
+            else
+                capture->startTGASequence("frame_");
+        }
+        ImGui::SameLine();
+        ImGui::Text("Captured: %d Written: %d Waits: %d", capture->num_captured, (unsigned int)capture->num_written, capture->num_waits);
+
+        if (ImGui::Button("Save scene"))
+            saveScene("res/scene.sbin");
+        ImGui::SameLine();
+        if (ImGui::Button("Load scene"))
+            loadScene("res/scene.sbin");
 
         if (ImGui::TreeNode("Camera")) {
             this->camera->renderInMenu();
             ImGui::TreePop();
         }
 
+        // the gizmo edits the world matrix, the node keeps it relative to its parent (batched ones are uploaded again on the next update)
+        if (this->selected_node) {
+            ImGuiIO& io = ImGui::GetIO();
+            ImGuizmo::SetRect(0, 0, io.DisplaySize.x, io.DisplaySize.y);
+            glm::mat4 world = this->selected_node->getGlobalMatrix();
+            if (ImGuizmo::Manipulate(glm::value_ptr(this->camera->view_matrix), glm::value_ptr(this->camera->projection_matrix), ImGuizmo::TRANSLATE, ImGuizmo::WORLD, glm::value_ptr(world))) {
+                SceneNode* parent = this->selected_node->parent;
+                this->selected_node->setLocalMatrix(parent ? glm::inverse(parent->getGlobalMatrix()) * world : world);
+            }
+        }
+
         unsigned int count = 0;
         std::stringstream ss;
         for (auto& node : this->node_list) {
@@ -99,7 +179,137 @@ void Application::renderGUI()
     }
 }
 
-void Application::shutdown() { }
+void Application::shutdown()
+{
+    this->static_batch.clear();
+    delete this->frame_ubo;
+    delete this->light_ubo;
+    delete this->lights_ubo;
+}
+
+void Application::uploadFrameUniforms(Camera* camera)
+{
+    sFrameBlock frame;
+    frame.viewprojection = camera->viewprojection_matrix;
+    frame.camera_position = camera->eye;
+    frame.time = (float)glfwGetTime();
+    frame.ambient_light = this->ambient_light;
+    this->frame_ubo->upload(&frame, sizeof(frame));
+    this->frame_ubo->bind();
+
+    // the blocks are only filled when some shader reads them
+    if (Shader::IsUniformBlockUsed(UNIFORM_BLOCK_LIGHT))
+    {
+        // one aligned slot per light plus the empty one
+        unsigned int stride = UniformBuffer::Align(sizeof(sLightBlock));
+        unsigned int size = stride * (unsigned int)(this->light_list.size() + 1);
+        if (this->light_ubo->size < size)
+            this->light_ubo->resize(size);
+
+        this->light_ubo_data.assign(size, 0);
+        sLightBlock* empty = (sLightBlock*)&this->light_ubo_data[0];
+        empty->intensity = 1.f;
+        empty->shininess = 1.f;
+        for (size_t i = 0; i < this->light_list.size(); ++i)
+            this->light_list[i]->fillUniformBlock(*(sLightBlock*)&this->light_ubo_data[stride * (i + 1)]);
+        this->light_ubo->upload(&this->light_ubo_data[0], size);
+    }
+
+    // the single pass shaders without clusters get all of them at once
+    if (Shader::IsUniformBlockUsed(UNIFORM_BLOCK_LIGHTS))
+    {
+        sLightsBlock lights;
+        lights.num_lights = (int)std::min(this->light_list.size(), (size_t)MAX_LIGHTS);
+        if (this->light_list.size() > MAX_LIGHTS)
+        {
+            static bool warned = false;
+            if (!warned)
+                std::cout << "[WARN] Too many lights, only the first " << MAX_LIGHTS << " are shaded in a single pass" << std::endl;
+            warned = true;
+        }
+        for (int i = 0; i < lights.num_lights; ++i)
+            this->light_list[i]->fillUniformBlock(lights.lights[i]);
+        this->lights_ubo->upload(&lights, sizeof(int) * 4 + sizeof(sLightBlock) * lights.num_lights);
+        this->lights_ubo->bind();
+    }
+
+    // the clustered shaders only loop over the lists of their cluster
+    if (Shader::IsUniformBlockUsed(UNIFORM_BLOCK_CLUSTERS))
+    {
+        this->light_clusters.update(this->light_list, camera);
+        this->light_clusters.bind();
+    }
+}
+
+void Application::bindLightBlock(int light_index)
+{
+    unsigned int stride = UniformBuffer::Align(sizeof(sLightBlock));
+    this->light_ubo->bindRange(stride * (light_index + 1), sizeof(sLightBlock));
+}
+
+void Application::updateStaticBatch()
+{
+    if (!StaticBatch::IsSupported())
+        return;
+
+    // meshes loaded in background join the batch once they are ready
+    bool added = false;
+    for (SceneNode* node : this->node_list)
+    {
+        if (node->isStatic() && !node->isBatched())
+            added |= this->static_batch.add(node);
+    }
+
+    if (added)
+        this->static_batch.build();
+}
+
+SceneNode* Application::pickNode(float x, float y)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // the mouse is in window coordinates, not framebuffer pixels
+    ImGuiIO& io = ImGui::GetIO();
+    glm::vec3 origin, direction;
+    this->camera->getRay(x, y, io.DisplaySize.x, io.DisplaySize.y, origin, direction);
+    SceneNode* node = this->scene_bvh.pick(origin, direction);
+
+    this->pick_time = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return node;
+}
+
+bool Application::loadScene(const char* filename)
+{
+    std::vector<SceneNode*> nodes;
+    std::vector<Light*> lights;
+    std::vector<blue::Particle*> particles;
+    if (!SceneFile::Load(filename, nodes, lights, particles))
+        return false;
+
+    // the batch keeps pointers to the old nodes
+    this->static_batch.clear();
+    this->selected_node = NULL;
+    // the materials are deleted with the last node using them, dropping their shaders and textures
+    for (SceneNode* node : this->node_list)
+        delete node;
+    for (Light* light : this->light_list)
+        delete light;
+    for (blue::Particle* particle : this->particle_list)
+        delete particle;
+
+    this->node_list.swap(nodes);
+    this->light_list.swap(lights);
+    this->particle_list.swap(particles);
+
+    // the materials only submitted their shaders
+    Shader::ResolveAll();
+    return true;
+}
+
+bool Application::saveScene(const char* filename)
+{
+    return SceneFile::Save(filename, this->node_list, this->light_list, this->particle_list);
+}
 
 // keycodes: https://www.glfw.org/docs/3.3/group__keys.html
 void Application::onKeyDown(int key, int scancode)
@@ -150,12 +360,19 @@ void Application::onRightMouseUp()
 
 void Application::onLeftMouseDown()
 {
+    // the gizmo takes the drag, the camera does not orbit
+    if (ImGuizmo::IsOver())
+        return;
     this->dragging = true;
     this->lastMousePosition = this->mousePosition;
+    this->clickPosition = this->mousePosition;
 }
 
 void Application::onLeftMouseUp()
 {
+    // a click without dragging selects the node under the mouse
+    if (this->dragging && glm::length(this->mousePosition - this->clickPosition) < 3.f)
+        this->selected_node = pickNode(this->mousePosition.x, this->mousePosition.y);
     this->dragging = false;
     this->lastMousePosition = this->mousePosition;
 }
@@ -4,9 +4,19 @@
 #include "framework/camera.h"
 #include "framework/scenenode.h"
 #include "framework/light.h"
+#include "framework/culling.h"
+#include "framework/lightclusters.h"
+#include "framework/bvh.h"
+#include "graphics/uniformbuffer.h"
+#include "graphics/renderqueue.h"
+#include "graphics/staticbatch.h"
+#include "graphics/streambuffer.h"
+#include "graphics/framecapture.h"
 
 #include <glm/vec2.hpp>
 
+namespace blue { class Particle; }
+
 class Application
 {
 public:
@@ -16,6 +26,22 @@ public:
 	std::vector<SceneNode*> node_list;
 	glm::vec4 ambient_light;
 	std::vector<Light*> light_list;
+	std::vector<blue::Particle*> particle_list;
+
+	// Uniform blocks shared by all the shaders
+	UniformBuffer* frame_ubo;
+	UniformBuffer* light_ubo; // slot 0 is an empty light for the passes without lights
+	std::vector<uint8_t> light_ubo_data; // staging of light_ubo, kept to not allocate every frame
+	UniformBuffer* lights_ubo; // all the lights, up to MAX_LIGHTS
+	LightClusters light_clusters; // lights around every froxel, for the clustered shaders
+
+	RenderQueue render_queue;
+	StaticBatch static_batch; // the static nodes, drawn with a few multi draws
+	FrustumCuller culler;
+	SceneBVH scene_bvh; // world boxes of the entities, for picking
+
+	SceneNode* selected_node = NULL; // edited with the gizmo
+	float pick_time = 0.f; // microseconds spent in the last pick
 
 	int window_width;
 	int window_height;
@@ -27,6 +53,7 @@ public:
 	bool dragging;
 	glm::vec2 mousePosition;
 	glm::vec2 lastMousePosition;
+	glm::vec2 clickPosition;
 
 	void init(GLFWwindow* window);
 	void update(float dt);
@@ -34,6 +61,14 @@ public:
 	void renderGUI();
 	void shutdown();
 
+	void uploadFrameUniforms(Camera* camera); // fills the frame and light blocks, once per frame
+	void bindLightBlock(int light_index); // -1 binds the empty light
+	void updateStaticBatch(); // rebuilds the batch when more static nodes can be added
+
+	SceneNode* pickNode(float x, float y); // nearest visible node under the window position, NULL if none
+	bool loadScene(const char* filename); // replaces the nodes, lights and particles with the ones in the .sbin
+	bool saveScene(const char* filename);
+
 	void onKeyDown(int key, int scancode);
 	void onKeyUp(int key, int scancode);
 	void onRightMouseDown();
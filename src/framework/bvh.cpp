@@ -0,0 +1,295 @@
+#include "bvh.h"
+
+#include <cassert>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/matrix.hpp>
+
+#include "scenegraph.h"
+#include "../graphics/mesh.h"
+
+#define BVH_NO_PARENT 0xFFFFFFFF
+
+// BVH ************************
+
+void BVH::build(const glm::vec3* mins, const glm::vec3* maxs, size_t count)
+{
+	this->nodes.clear();
+	this->parents.clear();
+	this->primitives.resize(count);
+	this->leaves.resize(count);
+	if (!count)
+		return;
+
+	std::iota(this->primitives.begin(), this->primitives.end(), 0);
+	std::vector<glm::vec3> centers(count);
+	for (size_t i = 0; i < count; ++i)
+		centers[i] = (mins[i] + maxs[i]) * 0.5f;
+
+	//a binary tree has at most 2n-1 nodes
+	this->nodes.reserve(count * 2);
+	this->parents.reserve(count * 2);
+	sBVHNode root;
+	root.first = 0;
+	root.count = (uint32_t)count;
+	this->nodes.push_back(root);
+	this->parents.push_back(BVH_NO_PARENT);
+	subdivide(0, mins, maxs, centers);
+
+	for (const sBVHNode& node : this->nodes)
+		for (uint32_t i = node.first; node.count && i < node.first + node.count; ++i)
+			this->leaves[this->primitives[i]] = (uint32_t)(&node - &this->nodes[0]);
+}
+
+void BVH::subdivide(uint32_t index, const glm::vec3* mins, const glm::vec3* maxs, const std::vector<glm::vec3>& centers)
+{
+	uint32_t first = this->nodes[index].first;
+	uint32_t count = this->nodes[index].count;
+
+	glm::vec3 box_min = mins[this->primitives[first]], box_max = maxs[this->primitives[first]];
+	glm::vec3 center_min = centers[this->primitives[first]], center_max = center_min;
+	for (uint32_t i = first + 1; i < first + count; ++i)
+	{
+		uint32_t primitive = this->primitives[i];
+		box_min = glm::min(box_min, mins[primitive]);
+		box_max = glm::max(box_max, maxs[primitive]);
+		center_min = glm::min(center_min, centers[primitive]);
+		center_max = glm::max(center_max, centers[primitive]);
+	}
+	this->nodes[index].min = box_min;
+	this->nodes[index].max = box_max;
+
+	//all the centers in the same point cannot be split
+	glm::vec3 extent = center_max - center_min;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	if (count <= BVH_MAX_LEAF_SIZE || extent[axis] <= 0.f)
+		return;
+
+	uint32_t half = count / 2;
+	std::nth_element(this->primitives.begin() + first, this->primitives.begin() + first + half, this->primitives.begin() + first + count,
+		[&centers, axis](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+
+	uint32_t left = (uint32_t)this->nodes.size();
+	sBVHNode child;
+	child.first = first;
+	child.count = half;
+	this->nodes.push_back(child);
+	child.first = first + half;
+	child.count = count - half;
+	this->nodes.push_back(child);
+	this->parents.push_back(index);
+	this->parents.push_back(index);
+
+	this->nodes[index].first = left;
+	this->nodes[index].count = 0;
+	subdivide(left, mins, maxs, centers);
+	subdivide(left + 1, mins, maxs, centers);
+}
+
+void BVH::updateBox(uint32_t index, const glm::vec3* mins, const glm::vec3* maxs)
+{
+	sBVHNode& node = this->nodes[index];
+	if (!node.count)
+	{
+		node.min = glm::min(this->nodes[node.first].min, this->nodes[node.first + 1].min);
+		node.max = glm::max(this->nodes[node.first].max, this->nodes[node.first + 1].max);
+		return;
+	}
+	node.min = mins[this->primitives[node.first]];
+	node.max = maxs[this->primitives[node.first]];
+	for (uint32_t i = node.first + 1; i < node.first + node.count; ++i)
+	{
+		node.min = glm::min(node.min, mins[this->primitives[i]]);
+		node.max = glm::max(node.max, maxs[this->primitives[i]]);
+	}
+}
+
+//the ancestors only depend on their children, the walk stops where a box did not change
+void BVH::refit(const glm::vec3* mins, const glm::vec3* maxs, const int* changed, size_t num_changed)
+{
+	for (size_t i = 0; i < num_changed; ++i)
+	{
+		assert(changed[i] >= 0 && (size_t)changed[i] < this->leaves.size());
+		uint32_t index = this->leaves[changed[i]];
+		while (index != BVH_NO_PARENT)
+		{
+			glm::vec3 previous_min = this->nodes[index].min;
+			glm::vec3 previous_max = this->nodes[index].max;
+			updateBox(index, mins, maxs);
+			if (index != this->leaves[changed[i]] && previous_min == this->nodes[index].min && previous_max == this->nodes[index].max)
+				break;
+			index = this->parents[index];
+		}
+	}
+}
+
+// MESH BVH ************************
+
+bool MeshBVH::build(Mesh* mesh)
+{
+	this->triangles.clear();
+
+	const glm::vec3* positions;
+	size_t stride, num_vertices;
+	if (mesh->interleaved.size())
+	{
+		positions = &mesh->interleaved[0].vertex;
+		stride = sizeof(Mesh::tInterleaved);
+		num_vertices = mesh->interleaved.size();
+	}
+	else if (mesh->vertices.size())
+	{
+		positions = &mesh->vertices[0];
+		stride = sizeof(glm::vec3);
+		num_vertices = mesh->vertices.size();
+	}
+	else
+		return false;
+	auto position = [positions, stride](uint32_t i) { return *(const glm::vec3*)((const uint8_t*)positions + i * stride); };
+
+	//the indices are stored as unsigned ints in the vec3 array
+	std::vector<glm::vec3> vertices;
+	if (mesh->indices.size())
+	{
+		const uint32_t* indices = (const uint32_t*)&mesh->indices[0];
+		vertices.resize(mesh->indices.size() * 3);
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			if (indices[i] >= num_vertices)
+				return false;
+			vertices[i] = position(indices[i]);
+		}
+	}
+	else
+	{
+		vertices.resize(num_vertices - num_vertices % 3);
+		for (size_t i = 0; i < vertices.size(); ++i)
+			vertices[i] = position((uint32_t)i);
+	}
+
+	size_t num_triangles = vertices.size() / 3;
+	std::vector<glm::vec3> mins(num_triangles), maxs(num_triangles);
+	for (size_t i = 0; i < num_triangles; ++i)
+	{
+		mins[i] = glm::min(glm::min(vertices[i * 3], vertices[i * 3 + 1]), vertices[i * 3 + 2]);
+		maxs[i] = glm::max(glm::max(vertices[i * 3], vertices[i * 3 + 1]), vertices[i * 3 + 2]);
+	}
+	this->bvh.build(&mins[0], &maxs[0], num_triangles);
+
+	//stored in the order of the leaves, a leaf reads consecutive triangles
+	this->triangles.resize(vertices.size());
+	for (size_t i = 0; i < num_triangles; ++i)
+	{
+		uint32_t triangle = this->bvh.primitives[i];
+		this->triangles[i * 3] = vertices[triangle * 3];
+		this->triangles[i * 3 + 1] = vertices[triangle * 3 + 1];
+		this->triangles[i * 3 + 2] = vertices[triangle * 3 + 2];
+		this->bvh.primitives[i] = (uint32_t)i;
+	}
+	return num_triangles > 0;
+}
+
+//Moller-Trumbore, both faces
+float MeshBVH::intersect(const glm::vec3& origin, const glm::vec3& direction, float max_distance) const
+{
+	const glm::vec3* triangles = this->triangles.data();
+	return this->bvh.intersect(origin, direction, max_distance, [triangles, &origin, &direction](uint32_t triangle, float max_distance) {
+		const glm::vec3& a = triangles[triangle * 3];
+		glm::vec3 edge1 = triangles[triangle * 3 + 1] - a;
+		glm::vec3 edge2 = triangles[triangle * 3 + 2] - a;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (fabsf(determinant) < 1e-12f)
+			return max_distance;
+		float inv_determinant = 1.f / determinant;
+		glm::vec3 s = origin - a;
+		float u = glm::dot(s, p) * inv_determinant;
+		if (u < 0.f || u > 1.f)
+			return max_distance;
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(direction, q) * inv_determinant;
+		if (v < 0.f || u + v > 1.f)
+			return max_distance;
+		float t = glm::dot(edge2, q) * inv_determinant;
+		return t >= 0.f && t < max_distance ? t : max_distance;
+	});
+}
+
+// SCENE BVH ************************
+
+void SceneBVH::readBox(int entity)
+{
+	glm::vec3 center = glm::vec3(this->scene->center_x[entity], this->scene->center_y[entity], this->scene->center_z[entity]);
+	glm::vec3 halfsize = glm::vec3(this->scene->halfsize_x[entity], this->scene->halfsize_y[entity], this->scene->halfsize_z[entity]);
+	this->mins[entity] = center - halfsize;
+	this->maxs[entity] = center + halfsize;
+}
+
+void SceneBVH::update(const SceneGraph& scene)
+{
+	this->num_refitted = 0;
+	size_t count = scene.size();
+
+	//the entity indices changed, the leaves point to other nodes now
+	if (this->scene != &scene || this->layout_version != scene.layout_version)
+	{
+		this->scene = &scene;
+		this->layout_version = scene.layout_version;
+		this->mins.resize(count);
+		this->maxs.resize(count);
+		for (size_t i = 0; i < count; ++i)
+			readBox((int)i);
+		this->bvh.build(this->mins.data(), this->maxs.data(), count);
+		this->num_rebuilds++;
+		return;
+	}
+
+	//entities without a box yet are a point at the origin until their mesh is ready
+	const std::vector<int>& changed = scene.bounds_changed;
+	for (int entity : changed)
+		readBox(entity);
+	this->bvh.refit(this->mins.data(), this->maxs.data(), changed.data(), changed.size());
+	this->num_refitted = (unsigned int)changed.size();
+}
+
+SceneNode* SceneBVH::pick(const glm::vec3& origin, const glm::vec3& direction, float* distance) const
+{
+	if (!this->scene)
+		return NULL;
+
+	const SceneGraph& scene = *this->scene;
+	glm::vec3 inv_direction = 1.f / direction;
+	int nearest = -1;
+	float nearest_distance = this->bvh.intersect(origin, direction, INFINITY, [&](uint32_t entity, float max_distance) {
+		const uint8_t required = ENTITY_VISIBLE | ENTITY_BOUNDS_READY;
+		if ((scene.flags[entity] & required) != required)
+			return max_distance;
+		float box_distance = intersectRayBox(this->mins[entity], this->maxs[entity], origin, inv_direction, max_distance);
+		if (box_distance == INFINITY)
+			return max_distance;
+
+		//the ray in local space keeps the same distances, its direction is not normalized
+		float hit_distance = box_distance;
+		Mesh* mesh = scene.mesh[entity];
+		MeshBVH* mesh_bvh = mesh->getBVH();
+		if (mesh_bvh)
+		{
+			glm::mat4 inv_world = glm::inverse(scene.world[entity]);
+			glm::vec3 local_origin = glm::vec3(inv_world * glm::vec4(origin, 1.f));
+			glm::vec3 local_direction = glm::vec3(inv_world * glm::vec4(direction, 0.f));
+			hit_distance = mesh_bvh->intersect(local_origin, local_direction, max_distance);
+		}
+		if (hit_distance >= max_distance)
+			return max_distance;
+		nearest = (int)entity;
+		return hit_distance;
+	});
+
+	if (nearest == -1)
+		return NULL;
+	if (distance)
+		*distance = nearest_distance;
+	return scene.nodes[nearest];
+}
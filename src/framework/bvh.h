@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+
+class Mesh;
+class SceneGraph;
+class SceneNode;
+
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_STACK_SIZE 64 //the median split halves every node, enough for any count
+
+struct sBVHNode
+{
+	glm::vec3 min;
+	uint32_t first; //first primitive in a leaf, left child otherwise (the right one is next to it)
+	glm::vec3 max;
+	uint32_t count; //primitives in a leaf, 0 for the inner nodes
+};
+
+//distance where the ray enters the box, INFINITY if it misses it or the box is further than max_distance
+inline float intersectRayBox(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inv_direction, float max_distance)
+{
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 t_min = glm::min(t0, t1);
+	glm::vec3 t_max = glm::max(t0, t1);
+	float enter = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.f));
+	float exit = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, max_distance));
+	return enter <= exit ? enter : INFINITY;
+}
+
+//Bounding volume hierarchy over boxes, built splitting the longest axis at the median of the centers.
+//When the primitives move it is refitted: only the leaves that changed and their ancestors are recomputed.
+class BVH
+{
+public:
+	std::vector<sBVHNode> nodes; //the root first
+	std::vector<uint32_t> primitives; //primitive of every leaf slot
+
+	void build(const glm::vec3* mins, const glm::vec3* maxs, size_t count);
+	void refit(const glm::vec3* mins, const glm::vec3* maxs, const int* changed, size_t num_changed); //the boxes of the listed primitives moved
+
+	//test(primitive, max_distance) returns the distance to the primitive or max_distance if it is not closer,
+	//the nearest children are visited first so far away nodes get skipped
+	template<typename T> float intersect(const glm::vec3& origin, const glm::vec3& direction, float max_distance, T test) const
+	{
+		if (!this->nodes.size())
+			return max_distance;
+
+		glm::vec3 inv_direction = 1.f / direction;
+		uint32_t stack[BVH_STACK_SIZE];
+		int top = 0;
+		if (intersectRayBox(this->nodes[0].min, this->nodes[0].max, origin, inv_direction, max_distance) != INFINITY)
+			stack[top++] = 0;
+
+		while (top)
+		{
+			const sBVHNode& node = this->nodes[stack[--top]];
+			if (node.count)
+			{
+				for (uint32_t i = node.first; i < node.first + node.count; ++i)
+					max_distance = test(this->primitives[i], max_distance);
+				continue;
+			}
+
+			const sBVHNode& left = this->nodes[node.first];
+			const sBVHNode& right = this->nodes[node.first + 1];
+			float left_distance = intersectRayBox(left.min, left.max, origin, inv_direction, max_distance);
+			float right_distance = intersectRayBox(right.min, right.max, origin, inv_direction, max_distance);
+			uint32_t closest = node.first, furthest = node.first + 1;
+			if (right_distance < left_distance)
+			{
+				std::swap(closest, furthest);
+				std::swap(left_distance, right_distance);
+			}
+			if (right_distance != INFINITY)
+				stack[top++] = furthest;
+			if (left_distance != INFINITY)
+				stack[top++] = closest;
+		}
+		return max_distance;
+	}
+
+private:
+	std::vector<uint32_t> parents; //of every node, the root has none
+	std::vector<uint32_t> leaves; //of every primitive
+
+	void subdivide(uint32_t index, const glm::vec3* mins, const glm::vec3* maxs, const std::vector<glm::vec3>& centers);
+	void updateBox(uint32_t index, const glm::vec3* mins, const glm::vec3* maxs);
+};
+
+//Triangles of a mesh in local space, reordered as the leaves of their BVH
+class MeshBVH
+{
+public:
+	BVH bvh;
+	std::vector<glm::vec3> triangles; //3 vertices each, the primitive i is the triangle i
+
+	bool build(Mesh* mesh); //needs the RAM copy of the mesh
+	float intersect(const glm::vec3& origin, const glm::vec3& direction, float max_distance) const;
+};
+
+//BVH over the world boxes of the SceneGraph entities, for ray queries on the CPU
+class SceneBVH
+{
+public:
+	//stats
+	unsigned int num_rebuilds = 0;
+	unsigned int num_refitted = 0; //entities refitted in the last update
+
+	void update(const SceneGraph& scene); //after SceneGraph::update, rebuilds only when entities were added, removed or reordered
+	//nearest visible node hit, against the triangles of its mesh when it has a BVH (built when loaded), or its box otherwise
+	SceneNode* pick(const glm::vec3& origin, const glm::vec3& direction, float* distance = NULL) const;
+
+private:
+	const SceneGraph* scene = NULL;
+	unsigned int layout_version = 0xFFFFFFFF; //of the scene when built
+	BVH bvh;
+	std::vector<glm::vec3> mins, maxs;
+
+	void readBox(int entity);
+};
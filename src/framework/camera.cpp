@@ -243,6 +243,56 @@ void Camera::updateProjectionMatrix()
 void Camera::updateViewProjectionMatrix()
 {
 	viewprojection_matrix = projection_matrix * view_matrix;
+	updateFrustumPlanes();
+}
+
+// Gribb-Hartmann: every plane is the last row of the matrix plus/minus another row
+void Camera::updateFrustumPlanes()
+{
+	const glm::mat4& m = viewprojection_matrix;
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	frustum_planes[0] = row3 + row0; // left
+	frustum_planes[1] = row3 - row0; // right
+	frustum_planes[2] = row3 + row1; // bottom
+	frustum_planes[3] = row3 - row1; // top
+	frustum_planes[4] = row3 + row2; // near
+	frustum_planes[5] = row3 - row2; // far
+
+	for (int i = 0; i < 6; ++i)
+	{
+		float length = glm::length(glm::vec3(frustum_planes[i]));
+		if (length > 0.f)
+			frustum_planes[i] /= length;
+	}
+}
+
+// The box is outside if it is completely behind any plane
+bool Camera::testBoxInFrustum(const glm::vec3& center, const glm::vec3& halfsize)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		const glm::vec4& plane = frustum_planes[i];
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = fabsf(plane.x) * halfsize.x + fabsf(plane.y) * halfsize.y + fabsf(plane.z) * halfsize.z;
+		if (distance + radius < 0.f)
+			return false;
+	}
+	return true;
+}
+
+// The near and far points under the pixel, unprojected with the inverse viewprojection
+void Camera::getRay(float x, float y, float width, float height, glm::vec3& origin, glm::vec3& direction)
+{
+	glm::mat4 inv_viewprojection = glm::inverse(viewprojection_matrix);
+	glm::vec2 ndc = glm::vec2(x / width * 2.f - 1.f, 1.f - y / height * 2.f);
+	glm::vec4 near_point = inv_viewprojection * glm::vec4(ndc.x, ndc.y, -1.f, 1.f);
+	glm::vec4 far_point = inv_viewprojection * glm::vec4(ndc.x, ndc.y, 1.f, 1.f);
+	origin = glm::vec3(near_point) / near_point.w;
+	direction = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
 }
 
 glm::mat4 Camera::getViewProjectionMatrix()
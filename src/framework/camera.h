@@ -36,6 +36,10 @@ public:
 	glm::mat4 projection_matrix;
 	glm::mat4 viewprojection_matrix;
 
+	// Planes of the frustum in world space (left, right, bottom, top, near, far)
+	// xyz is the normal pointing inside and w the distance, updated with the viewprojection
+	glm::vec4 frustum_planes[6];
+
 	Camera();
 
 	// Setters
@@ -66,6 +70,13 @@ public:
 	void updateViewMatrix();
 	void updateProjectionMatrix();
 	void updateViewProjectionMatrix();
+	void updateFrustumPlanes();
+
+	// Frustum tests
+	bool testBoxInFrustum(const glm::vec3& center, const glm::vec3& halfsize);
+
+	// Ray through a pixel (window coordinates, y down), starting at the near plane
+	void getRay(float x, float y, float width, float height, glm::vec3& origin, glm::vec3& direction);
 
 	glm::mat4 getViewProjectionMatrix();
 
@@ -0,0 +1,159 @@
+#include "culling.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "scenenode.h"
+#include "camera.h"
+#include "threadpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CULLING_SSE2
+	#include <emmintrin.h>
+#endif
+
+unsigned int FrustumCuller::parallel_threshold = 4096;
+unsigned int FrustumCuller::parallel_grain = 1024;
+
+void FrustumCuller::cull(const std::vector<SceneNode*>& nodes, Camera* camera)
+{
+	size_t num = nodes.size();
+	size_t padded = (num + 3) & ~(size_t)3;
+
+	this->visibility.resize(padded);
+	this->center_x.resize(padded);
+	this->center_y.resize(padded);
+	this->center_z.resize(padded);
+	this->halfsize_x.resize(padded);
+	this->halfsize_y.resize(padded);
+	this->halfsize_z.resize(padded);
+
+	const float* const boxes[6] = { this->center_x.data(), this->center_y.data(), this->center_z.data(), this->halfsize_x.data(), this->halfsize_y.data(), this->halfsize_z.data() };
+	auto job = [this, &nodes, &boxes, camera](size_t begin, size_t end) {
+		gatherBoxes(nodes, begin, end);
+		testBoxes(boxes, camera, begin, end);
+	};
+
+	if (!num)
+		this->visibility.clear();
+	else if (num < parallel_threshold)
+		job(0, padded);
+	else
+		ThreadPool::get()->parallelFor(padded, std::max(parallel_grain & ~3u, 4u), job);
+
+	countVisible(num);
+}
+
+void FrustumCuller::cull(const SceneGraph& scene, Camera* camera, uint8_t skip_flags)
+{
+	size_t num = scene.size();
+	size_t padded = scene.center_x.size();
+	this->visibility.resize(padded);
+
+	//the boxes are read in place, only the flags decide what gets tested
+	const float* const boxes[6] = { scene.center_x.data(), scene.center_y.data(), scene.center_z.data(), scene.halfsize_x.data(), scene.halfsize_y.data(), scene.halfsize_z.data() };
+	auto job = [this, &scene, &boxes, num, camera, skip_flags](size_t begin, size_t end) {
+		const uint8_t required = ENTITY_VISIBLE | ENTITY_BOUNDS_READY;
+		for (size_t i = begin; i < end; ++i)
+			this->visibility[i] = i < num && (scene.flags[i] & required) == required && !(scene.flags[i] & skip_flags);
+		testBoxes(boxes, camera, begin, end);
+	};
+
+	if (!num)
+		this->visibility.clear();
+	else if (num < parallel_threshold)
+		job(0, padded);
+	else
+		ThreadPool::get()->parallelFor(padded, std::max(parallel_grain & ~3u, 4u), job);
+
+	countVisible(num);
+}
+
+void FrustumCuller::countVisible(size_t num)
+{
+	this->visibility.resize(num);
+	this->num_visible = (unsigned int)std::count(this->visibility.begin(), this->visibility.end(), 1);
+	this->num_culled = (unsigned int)num - this->num_visible;
+}
+
+//the world boxes are kept up to date by SceneGraph::update, they are only copied in the order of the list
+void FrustumCuller::gatherBoxes(const std::vector<SceneNode*>& nodes, size_t begin, size_t end)
+{
+	const SceneGraph* scene = SceneGraph::get();
+	for (size_t i = begin; i < end; ++i)
+	{
+		//padding and nodes with nothing to draw, they are discarded after the test
+		SceneNode* node = i < nodes.size() ? nodes[i] : NULL;
+		if (!node || !scene->hasFlag(node->entity, ENTITY_BOUNDS_READY))
+		{
+			this->visibility[i] = 0;
+			center_x[i] = center_y[i] = center_z[i] = 0.f;
+			halfsize_x[i] = halfsize_y[i] = halfsize_z[i] = 0.f;
+			continue;
+		}
+
+		int entity = node->entity;
+		this->visibility[i] = 1;
+		center_x[i] = scene->center_x[entity];
+		center_y[i] = scene->center_y[entity];
+		center_z[i] = scene->center_z[entity];
+		halfsize_x[i] = scene->halfsize_x[entity];
+		halfsize_y[i] = scene->halfsize_y[entity];
+		halfsize_z[i] = scene->halfsize_z[entity];
+	}
+}
+
+//begin and end must be multiples of 4
+void FrustumCuller::testBoxes(const float* const boxes[6], const Camera* camera, size_t begin, size_t end)
+{
+	const glm::vec4* planes = camera->frustum_planes;
+	const float* center_x = boxes[0];
+	const float* center_y = boxes[1];
+	const float* center_z = boxes[2];
+	const float* halfsize_x = boxes[3];
+	const float* halfsize_y = boxes[4];
+	const float* halfsize_z = boxes[5];
+
+#ifdef CULLING_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	for (size_t i = begin; i < end; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&center_x[i]);
+		__m128 cy = _mm_loadu_ps(&center_y[i]);
+		__m128 cz = _mm_loadu_ps(&center_z[i]);
+		__m128 hx = _mm_loadu_ps(&halfsize_x[i]);
+		__m128 hy = _mm_loadu_ps(&halfsize_y[i]);
+		__m128 hz = _mm_loadu_ps(&halfsize_z[i]);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (int p = 0; p < 6; ++p)
+		{
+			const glm::vec4& plane = planes[p];
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(hx, _mm_set1_ps(fabsf(plane.x))), _mm_mul_ps(hy, _mm_set1_ps(fabsf(plane.y)))),
+				_mm_mul_ps(hz, _mm_set1_ps(fabsf(plane.z))));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int k = 0; k < 4; ++k)
+			this->visibility[i + k] &= (mask >> k) & 1;
+	}
+#else
+	for (size_t i = begin; i < end; ++i)
+	{
+		for (int p = 0; p < 6; ++p)
+		{
+			const glm::vec4& plane = planes[p];
+			float distance = plane.x * center_x[i] + plane.y * center_y[i] + plane.z * center_z[i] + plane.w;
+			float radius = fabsf(plane.x) * halfsize_x[i] + fabsf(plane.y) * halfsize_y[i] + fabsf(plane.z) * halfsize_z[i];
+			if (distance + radius < 0.f)
+			{
+				this->visibility[i] = 0;
+				break;
+			}
+		}
+	}
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class SceneNode;
+class SceneGraph;
+class Camera;
+
+//Tests the world AABB of every node against the camera frustum
+//Boxes are stored as structure of arrays so 4 of them are tested per plane at once, the SceneGraph already keeps them that way
+class FrustumCuller
+{
+public:
+	static unsigned int parallel_threshold; //smaller lists are culled in the calling thread
+	static unsigned int parallel_grain; //nodes per job, multiple of 4
+
+	//results of the last cull
+	std::vector<uint8_t> visibility; //one per node (or entity), nodes without a mesh ready are never visible
+	unsigned int num_visible = 0;
+	unsigned int num_culled = 0;
+
+	void cull(const std::vector<SceneNode*>& nodes, Camera* camera); //a subset of the scene, the boxes are gathered first
+	void cull(const SceneGraph& scene, Camera* camera, uint8_t skip_flags = 0); //every entity, hidden ones and the ones with any of skip_flags included as not visible
+
+private:
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> halfsize_x, halfsize_y, halfsize_z;
+
+	void gatherBoxes(const std::vector<SceneNode*>& nodes, size_t begin, size_t end);
+	void testBoxes(const float* const boxes[6], const Camera* camera, size_t begin, size_t end);
+	void countVisible(size_t num);
+};
@@ -0,0 +1,123 @@
+#include "filewatcher.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include "utils.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+unsigned int FileWatcher::poll_interval = 500;
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+	this->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->inotify_fd == -1)
+		std::cout << "[WARN] inotify not available, files will not be watched" << std::endl;
+#else
+	this->last_poll = getTime();
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+	if (this->inotify_fd != -1)
+		close(this->inotify_fd); //removes all the watches
+#endif
+}
+
+std::string FileWatcher::Normalize(const std::string& filename)
+{
+	return std::filesystem::path(filename).lexically_normal().generic_string();
+}
+
+bool FileWatcher::isWatched(const std::string& filename) const
+{
+	return this->files.find(Normalize(filename)) != this->files.end();
+}
+
+void FileWatcher::addFile(const std::string& filename)
+{
+	std::string name = Normalize(filename);
+	if (!this->files.insert(name).second)
+		return;
+
+#ifdef __linux__
+	if (this->inotify_fd == -1)
+		return;
+
+	std::string folder = std::filesystem::path(name).parent_path().generic_string();
+	folder = folder.empty() ? "./" : folder + "/";
+
+	//the same folder always returns the same descriptor
+	int wd = inotify_add_watch(this->inotify_fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd == -1)
+	{
+		std::cout << "[WARN] Cannot watch folder: " << folder << std::endl;
+		return;
+	}
+	this->folders[wd] = folder;
+#else
+	std::error_code error;
+	this->times[name] = std::filesystem::last_write_time(name, error);
+#endif
+}
+
+bool FileWatcher::poll(std::vector<std::string>& changed)
+{
+	changed.clear();
+
+#ifdef __linux__
+	if (this->inotify_fd == -1)
+		return false;
+
+	//every read returns whole events
+	alignas(struct inotify_event) char buffer[4096];
+	while (true)
+	{
+		ssize_t size = read(this->inotify_fd, buffer, sizeof(buffer));
+		if (size <= 0)
+			break; //EAGAIN, nothing else pending
+
+		for (char* ptr = buffer; ptr < buffer + size; )
+		{
+			const struct inotify_event* event = (const struct inotify_event*)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			auto it = this->folders.find(event->wd);
+			if (it == this->folders.end() || !event->len)
+				continue;
+
+			std::string name = Normalize(it->second + event->name);
+			if (this->files.find(name) == this->files.end())
+				continue;
+
+			//saving usually fires more than one event
+			if (std::find(changed.begin(), changed.end(), name) == changed.end())
+				changed.push_back(name);
+		}
+	}
+#else
+	long now = getTime();
+	if (now - this->last_poll < (long)poll_interval)
+		return false;
+	this->last_poll = now;
+
+	for (auto& entry : this->times)
+	{
+		std::error_code error;
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(entry.first, error);
+		if (error || time == entry.second)
+			continue;
+		entry.second = time;
+		changed.push_back(entry.first);
+	}
+#endif
+
+	return changed.size() > 0;
+}
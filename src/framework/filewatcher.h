@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <filesystem>
+
+//Reports the files modified on disk since the last poll
+//On Linux it uses inotify on their folders, so editors that save to a temporary file and rename it are also detected,
+//elsewhere it compares the modification times every poll_interval ms
+class FileWatcher
+{
+public:
+	static unsigned int poll_interval; //ms between checks without inotify
+
+	FileWatcher();
+	~FileWatcher();
+
+	static std::string Normalize(const std::string& filename); //the same file always gives the same string
+
+	void addFile(const std::string& filename); //ignored if already watched
+	bool isWatched(const std::string& filename) const;
+	bool poll(std::vector<std::string>& changed); //never blocks, fills the normalized names and returns true if any changed
+
+private:
+	std::set<std::string> files;
+
+#ifdef __linux__
+	int inotify_fd;
+	std::map<int, std::string> folders; //watch descriptor to folder, with the trailing slash
+#else
+	std::map<std::string, std::filesystem::file_time_type> times;
+	long last_poll;
+#endif
+};
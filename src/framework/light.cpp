@@ -2,13 +2,22 @@
 
 #include "ImGuizmo.h"
 
+//resolved once, they are set for every light pass
+static const UniformHandle u_light_type = Shader::GetUniform("u_light_type");
+static const UniformHandle u_light_intensity = Shader::GetUniform("u_light_intensity");
+static const UniformHandle u_light_shininess = Shader::GetUniform("u_light_shininess");
+static const UniformHandle u_light_color = Shader::GetUniform("u_light_color");
+static const UniformHandle u_light_direction = Shader::GetUniform("u_light_direction");
+static const UniformHandle u_light_position = Shader::GetUniform("u_light_position");
+static const UniformHandle u_local_light_position = Shader::GetUniform("u_local_light_position");
+
 Light::Light(glm::vec3 position, eLightType type, float intensity, glm::vec4 color)
 {
 	this->type = NODE_LIGHT;
 	this->light_type = type;
 
 	this->name = std::string("Light" + std::to_string(this->lastNameId));
-	this->model = glm::translate(this->model, position);
+	glm::mat4 model = glm::translate(glm::mat4(1.f), position);
 	
 	this->color = color;
 	this->intensity = intensity;
@@ -16,16 +25,18 @@ Light::Light(glm::vec3 position, eLightType type, float intensity, glm::vec4 col
 	this->max_distance;
 	this->cast_shadows;
 
-	// create a debug sphere mesh
-	this->mesh = Mesh::Get("res/meshes/sphere.obj");
-	this->model = glm::scale(this->model, glm::vec3(0.1f));
-	this->material = new FlatMaterial();
+	// create a debug sphere mesh, it is not drawn with the scene
+	setMesh(Mesh::Get("res/meshes/sphere.obj"));
+	setLocalMatrix(glm::scale(model, glm::vec3(0.1f)));
+	setMaterial(new FlatMaterial());
+	setVisible(false);
 }
 
 void Light::setUniforms(Shader* shader, const glm::mat4& model)
 {
-	glm::vec3 position = glm::vec3(this->model[3][0], this->model[3][1], this->model[3][2]);
-	glm::vec3 front = glm::vec3(this->model[2][0], this->model[2][1], this->model[2][2]);
+	const glm::mat4& global = getGlobalMatrix();
+	glm::vec3 position = glm::vec3(global[3][0], global[3][1], global[3][2]);
+	glm::vec3 front = glm::vec3(global[2][0], global[2][1], global[2][2]);
 
 	// compute camera position in local coordinates
 	glm::mat4 inverseModel = glm::inverse(model);
@@ -33,17 +44,36 @@ void Light::setUniforms(Shader* shader, const glm::mat4& model)
 	temp = inverseModel * temp;
 	glm::vec3 local_pos = glm::vec3(temp.x / temp.w, temp.y / temp.w, temp.z / temp.w);
 
-	shader->setUniform("u_light_type", this->light_type);
-	shader->setUniform("u_light_intensity", this->intensity);
-	shader->setUniform("u_light_shininess", this->shininess);
-	shader->setUniform("u_light_color", this->color);
-	shader->setUniform("u_light_direction", front);
-	shader->setUniform("u_light_position", position);
-	shader->setUniform("u_local_light_position", local_pos);
+	// depends on the object, it cannot go in the light block
+	shader->setUniform(u_local_light_position, local_pos);
+
+	// the rest comes from the LightBlock bound for this pass
+	if (shader->hasUniformBlock(UNIFORM_BLOCK_LIGHT))
+		return;
+
+	shader->setUniform(u_light_type, (int)this->light_type);
+	shader->setUniform(u_light_intensity, this->intensity);
+	shader->setUniform(u_light_shininess, this->shininess);
+	shader->setUniform(u_light_color, this->color);
+	shader->setUniform(u_light_direction, front);
+	shader->setUniform(u_light_position, position);
+}
+
+void Light::fillUniformBlock(sLightBlock& block)
+{
+	const glm::mat4& global = getGlobalMatrix();
+	block.color = this->color;
+	block.position = glm::vec3(global[3][0], global[3][1], global[3][2]);
+	block.intensity = this->intensity;
+	block.direction = glm::vec3(global[2][0], global[2][1], global[2][2]);
+	block.shininess = this->shininess;
+	block.type = this->light_type;
+	block.max_distance = this->max_distance;
 }
 
 void Light::renderInMenu()
 {
+	glm::mat4 model = getLocalMatrix();
 	glm::vec3 front = glm::vec3(model[2][0], model[2][1], model[2][2]);
 
 	if (ImGui::Combo("Light Type", (int*)&this->light_type, "DIRECTIONAL\0POINT\0SPOT", 3))
@@ -52,9 +82,12 @@ void Light::renderInMenu()
 	}
 
 	float matrixTranslation[3], matrixRotation[3], matrixScale[3];
-	ImGuizmo::DecomposeMatrixToComponents(glm::value_ptr(this->model), matrixTranslation, matrixRotation, matrixScale);
-	ImGui::DragFloat3("Position", matrixTranslation, 0.1f);
-	ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, glm::value_ptr(this->model));
+	ImGuizmo::DecomposeMatrixToComponents(glm::value_ptr(model), matrixTranslation, matrixRotation, matrixScale);
+	if (ImGui::DragFloat3("Position", matrixTranslation, 0.1f))
+	{
+		ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, glm::value_ptr(model));
+		setLocalMatrix(model);
+	}
 
 	ImGui::SliderFloat("Intensity", (float*)&this->intensity, 0.f, 50.f);
 	ImGui::SliderFloat("Shininess", (float*)&this->shininess, 0.f, 30.f);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "scenenode.h"
+#include "../graphics/uniformbuffer.h"
 
 enum eLightType { LIGHT_DIRECTIONAL, LIGHT_POINT, LIGHT_SPOT };
 
@@ -18,5 +19,6 @@ public:
 	Light(glm::vec3 position = glm::vec3(0.f), eLightType type = LIGHT_DIRECTIONAL, float intensity = 1.f, glm::vec4 color = glm::vec4(1.f));
 
 	void setUniforms(Shader* shader, const glm::mat4& model);
+	void fillUniformBlock(sLightBlock& block);
 	void renderInMenu();
 };
\ No newline at end of file
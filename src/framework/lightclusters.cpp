@@ -0,0 +1,211 @@
+#include "lightclusters.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "light.h"
+#include "camera.h"
+#include "threadpool.h"
+#include "../graphics/shader.h"
+
+unsigned int LightClusters::parallel_threshold = 32;
+
+LightClusters::LightClusters()
+{
+	this->cluster_ubo = NULL;
+	this->lights_buffer_id = this->clusters_buffer_id = this->indices_buffer_id = 0;
+	this->boxes_projection = glm::mat4(0.f);
+	this->slice_indices.resize(CLUSTERS_Z);
+	this->slice_spheres.resize(CLUSTERS_Z);
+	this->ranges.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+}
+
+LightClusters::~LightClusters()
+{
+	delete this->cluster_ubo;
+	unsigned int buffers[] = { this->lights_buffer_id, this->clusters_buffer_id, this->indices_buffer_id };
+	for (unsigned int buffer : buffers)
+		if (buffer)
+			glDeleteBuffers(1, &buffer);
+}
+
+//corners of every tile unprojected at the depths of the slice
+void LightClusters::computeBoxes(Camera* camera)
+{
+	const glm::mat4& projection = camera->projection_matrix;
+	glm::mat4 inv_projection = glm::inverse(projection);
+	float near_plane = std::max(camera->near_plane, 0.01f);
+	float far_plane = std::max(camera->far_plane, near_plane * 2.f);
+
+	for (int z = 0; z <= CLUSTERS_Z; ++z)
+		this->slice_depths[z] = near_plane * powf(far_plane / near_plane, z / (float)CLUSTERS_Z);
+
+	this->box_min.resize(this->ranges.size());
+	this->box_max.resize(this->ranges.size());
+
+	for (int z = 0; z < CLUSTERS_Z; ++z)
+	{
+		float ndc_z[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			glm::vec4 p = projection * glm::vec4(0.f, 0.f, -this->slice_depths[z + k], 1.f);
+			ndc_z[k] = p.z / p.w;
+		}
+
+		for (int y = 0; y < CLUSTERS_Y; ++y)
+			for (int x = 0; x < CLUSTERS_X; ++x)
+			{
+				glm::vec3 min = glm::vec3(1e10f);
+				glm::vec3 max = glm::vec3(-1e10f);
+				for (int corner = 0; corner < 8; ++corner)
+				{
+					float ndc_x = -1.f + 2.f * (x + (corner & 1)) / CLUSTERS_X;
+					float ndc_y = -1.f + 2.f * (y + ((corner >> 1) & 1)) / CLUSTERS_Y;
+					glm::vec4 p = inv_projection * glm::vec4(ndc_x, ndc_y, ndc_z[corner >> 2], 1.f);
+					glm::vec3 v = glm::vec3(p) / p.w;
+					min = glm::min(min, v);
+					max = glm::max(max, v);
+				}
+				unsigned int index = x + CLUSTERS_X * (y + CLUSTERS_Y * z);
+				this->box_min[index] = min;
+				this->box_max[index] = max;
+			}
+	}
+
+	this->boxes_projection = projection;
+}
+
+//writes the lists of all the clusters of a slice, only touches data of that slice
+void LightClusters::binSlice(unsigned int z)
+{
+	std::vector<uint32_t>& list = this->slice_indices[z];
+	std::vector<sLightSphere>& candidates = this->slice_spheres[z];
+	list.clear();
+	candidates.clear();
+
+	//view space looks to -z
+	float near_depth = this->slice_depths[z];
+	float far_depth = this->slice_depths[z + 1];
+	for (const sLightSphere& sphere : this->spheres)
+	{
+		float depth = -sphere.center.z;
+		if (depth + sphere.radius >= near_depth && depth - sphere.radius <= far_depth)
+			candidates.push_back(sphere);
+	}
+
+	for (unsigned int y = 0; y < CLUSTERS_Y; ++y)
+		for (unsigned int x = 0; x < CLUSTERS_X; ++x)
+		{
+			unsigned int index = x + CLUSTERS_X * (y + CLUSTERS_Y * z);
+			const glm::vec3& min = this->box_min[index];
+			const glm::vec3& max = this->box_max[index];
+			uint32_t start = (uint32_t)list.size();
+
+			list.insert(list.end(), this->global_lights.begin(), this->global_lights.end());
+			for (const sLightSphere& sphere : candidates)
+			{
+				glm::vec3 closest = glm::clamp(sphere.center, min, max);
+				glm::vec3 delta = sphere.center - closest;
+				if (glm::dot(delta, delta) <= sphere.radius * sphere.radius)
+					list.push_back(sphere.index);
+			}
+
+			this->ranges[index] = glm::uvec2(start, (uint32_t)list.size() - start);
+		}
+}
+
+void LightClusters::update(const std::vector<Light*>& lights, Camera* camera)
+{
+	if (camera->projection_matrix != this->boxes_projection)
+		computeBoxes(camera);
+
+	//the fragment shader finds its cluster with the same slicing
+	const glm::mat4& projection = camera->projection_matrix;
+	float near_plane = this->slice_depths[0];
+	float log_range = logf(this->slice_depths[CLUSTERS_Z] / near_plane);
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	sClusterBlock block;
+	block.dims = glm::uvec4(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, 0);
+	block.depth_params = glm::vec4(projection[2][2], projection[3][2], projection[2][3], projection[3][3]);
+	block.slice_params = glm::vec4(CLUSTERS_Z / log_range, -CLUSTERS_Z * logf(near_plane) / log_range, 1.f / std::max(viewport[2], 1), 1.f / std::max(viewport[3], 1));
+
+	if (!this->cluster_ubo)
+		this->cluster_ubo = new UniformBuffer(sizeof(sClusterBlock), UNIFORM_BLOCK_CLUSTERS);
+	this->cluster_ubo->upload(&block, sizeof(block));
+
+	this->spheres.clear();
+	this->global_lights.clear();
+	this->light_data.resize(lights.size());
+
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		Light* light = lights[i];
+		light->fillUniformBlock(this->light_data[i]);
+
+		if (light->light_type == LIGHT_DIRECTIONAL)
+		{
+			this->global_lights.push_back((uint32_t)i);
+			continue;
+		}
+
+		sLightSphere sphere;
+		sphere.center = glm::vec3(camera->view_matrix * glm::vec4(this->light_data[i].position, 1.f));
+		sphere.radius = light->max_distance;
+		sphere.index = (uint32_t)i;
+		this->spheres.push_back(sphere);
+	}
+
+	auto job = [this](size_t begin, size_t end) {
+		for (size_t z = begin; z < end; ++z)
+			binSlice((unsigned int)z);
+	};
+
+	if (this->spheres.size() < parallel_threshold)
+		job(0, CLUSTERS_Z);
+	else
+		ThreadPool::get()->parallelFor(CLUSTERS_Z, 1, job);
+
+	//merge the slices, their ranges become absolute
+	this->indices.clear();
+	this->max_cluster_lights = 0;
+	for (unsigned int z = 0; z < CLUSTERS_Z; ++z)
+	{
+		uint32_t base = (uint32_t)this->indices.size();
+		for (unsigned int c = z * CLUSTERS_X * CLUSTERS_Y; c < (z + 1) * CLUSTERS_X * CLUSTERS_Y; ++c)
+		{
+			this->ranges[c].x += base;
+			this->max_cluster_lights = std::max(this->max_cluster_lights, this->ranges[c].y);
+		}
+		this->indices.insert(this->indices.end(), this->slice_indices[z].begin(), this->slice_indices[z].end());
+	}
+	this->num_indices = (unsigned int)this->indices.size();
+
+	//orphaned every frame, empty buffers cannot be bound
+	if (!this->lights_buffer_id)
+	{
+		glGenBuffers(1, &this->lights_buffer_id);
+		glGenBuffers(1, &this->clusters_buffer_id);
+		glGenBuffers(1, &this->indices_buffer_id);
+	}
+	sLightBlock empty = {};
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->lights_buffer_id);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(this->light_data.size(), (size_t)1) * sizeof(sLightBlock), this->light_data.size() ? &this->light_data[0] : &empty, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->clusters_buffer_id);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, this->ranges.size() * sizeof(glm::uvec2), &this->ranges[0], GL_STREAM_DRAW);
+	uint32_t no_index = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->indices_buffer_id);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(this->indices.size(), (size_t)1) * sizeof(uint32_t), this->indices.size() ? &this->indices[0] : &no_index, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void LightClusters::bind()
+{
+	if (!this->cluster_ubo)
+		return;
+	this->cluster_ubo->bind();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BUFFER_LIGHTS, this->lights_buffer_id);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BUFFER_CLUSTERS, this->clusters_buffer_id);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BUFFER_LIGHT_INDICES, this->indices_buffer_id);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/matrix.hpp>
+
+#include "../graphics/uniformbuffer.h"
+
+class Light;
+class Camera;
+
+//size of the grid, the z slices are distributed in log scale between the near and far planes
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+
+//Bins the lights in a froxel grid (view space clusters) so the fragments only loop over the lights around them
+//Point and spot lights are spheres of radius max_distance, directional lights go to every cluster
+class LightClusters
+{
+public:
+	static unsigned int parallel_threshold; //with less lights the slices are binned in the calling thread
+
+	//stats of the last update
+	unsigned int num_indices = 0;
+	unsigned int max_cluster_lights = 0;
+
+	LightClusters();
+	~LightClusters();
+
+	void update(const std::vector<Light*>& lights, Camera* camera); //bins in the workers and uploads, main thread only
+	void bind();
+
+private:
+	struct sLightSphere
+	{
+		glm::vec3 center; //view space
+		float radius;
+		uint32_t index;
+	};
+
+	//view space bounds of every cluster, they only change with the projection
+	std::vector<glm::vec3> box_min;
+	std::vector<glm::vec3> box_max;
+	float slice_depths[CLUSTERS_Z + 1];
+	glm::mat4 boxes_projection;
+
+	std::vector<sLightSphere> spheres;
+	std::vector<uint32_t> global_lights;
+	std::vector<sLightBlock> light_data;
+
+	//filled by one job per z slice, the ranges are relative to its slice until merged
+	std::vector<std::vector<uint32_t>> slice_indices;
+	std::vector<std::vector<sLightSphere>> slice_spheres;
+	std::vector<glm::uvec2> ranges; //offset and count in indices, one per cluster
+	std::vector<uint32_t> indices;
+
+	UniformBuffer* cluster_ubo;
+	unsigned int lights_buffer_id;
+	unsigned int clusters_buffer_id;
+	unsigned int indices_buffer_id;
+
+	void computeBoxes(Camera* camera);
+	void binSlice(unsigned int z);
+};
@@ -0,0 +1,112 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	this->data = NULL;
+	this->size = 0;
+#ifdef _WIN32
+	this->file_handle = this->mapping_handle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!view)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	this->file_handle = file;
+	this->mapping_handle = mapping;
+	this->data = (const uint8_t*)view;
+	this->size = (size_t)file_size.QuadPart;
+#else
+	int fd = ::open(filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	//the mapping keeps the file alive, the descriptor is not needed anymore
+	void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	this->data = (const uint8_t*)view;
+	this->size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::prefetch() const
+{
+	if (!this->data)
+		return;
+#ifdef _WIN32
+	//one byte of every page, the sink keeps the reads from being optimized away
+	static volatile uint8_t sink;
+	uint8_t sum = 0;
+	for (size_t i = 0; i < this->size; i += 4096)
+		sum += this->data[i];
+	sink = sum;
+#else
+	//the kernel reads the pages ahead in background
+	madvise((void*)this->data, this->size, MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::close()
+{
+	if (!this->data)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(this->data);
+	CloseHandle(this->mapping_handle);
+	CloseHandle(this->file_handle);
+	this->file_handle = this->mapping_handle = NULL;
+#else
+	munmap((void*)this->data, this->size);
+#endif
+	this->data = NULL;
+	this->size = 0;
+}
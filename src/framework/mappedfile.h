@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+//Read only view of a whole file mapped in memory, the pages are loaded by the OS when touched
+class MappedFile
+{
+public:
+	const uint8_t* data;
+	size_t size;
+
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* filename);
+	void close();
+	bool isOpen() const { return data != NULL; }
+	void prefetch() const; //starts reading every page (madvise on POSIX, touching them on Windows), call it from a worker so the main thread does not wait for the disk
+
+private:
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#endif
+};
@@ -0,0 +1,233 @@
+#include "resourcemanager.h"
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+size_t ResourceManager::cpu_budget = 512 * 1024 * 1024;
+size_t ResourceManager::vram_budget = 1024 * 1024 * 1024;
+size_t ResourceManager::cpu_usage = 0;
+size_t ResourceManager::vram_usage = 0;
+
+struct sResourceEntry
+{
+	Resource* resource;
+	std::string key;
+	uint64_t hash;
+	uint32_t generation;
+	int refs;
+	uint64_t last_used; //frame of the last Find or Release
+	size_t cpu_size; //sizes from the last Collect
+	size_t vram_size;
+};
+
+static std::vector<sResourceEntry> entries;
+static std::vector<uint32_t> free_entries;
+static std::unordered_map<uint64_t, uint32_t> entries_by_hash;
+static uint64_t current_frame = 0;
+static bool over_budget_warned = false;
+
+//returns the entry the handle points to or NULL if it has been evicted
+static sResourceEntry* getEntry(ResourceHandle handle)
+{
+	if (!handle.isValid() || handle.index >= entries.size())
+		return NULL;
+	sResourceEntry& entry = entries[handle.index];
+	if (entry.generation != handle.generation || !entry.resource)
+		return NULL;
+	return &entry;
+}
+
+static void removeEntry(uint32_t index)
+{
+	sResourceEntry& entry = entries[index];
+	entries_by_hash.erase(entry.hash);
+	entry.resource->handle = ResourceHandle();
+	entry.resource = NULL;
+	entry.key.clear();
+	entry.generation++; //old handles will not resolve anymore
+	free_entries.push_back(index);
+}
+
+Resource::~Resource()
+{
+	//deleted by its owner instead of evicted, do not leave a dangling entry
+	if (this->handle.isValid())
+		ResourceManager::Unregister(this);
+}
+
+void Resource::addRef()
+{
+	ResourceManager::AddRef(this->handle);
+}
+
+void Resource::removeRef()
+{
+	ResourceManager::Release(this->handle);
+}
+
+//FNV-1a, the type is mixed in so different kinds of resources can share names
+uint64_t ResourceManager::HashKey(eResourceType type, const std::string& key)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	hash = (hash ^ (uint64_t)type) * 1099511628211ULL;
+	for (size_t i = 0; i < key.size(); ++i)
+		hash = (hash ^ (uint8_t)key[i]) * 1099511628211ULL;
+	return hash;
+}
+
+void ResourceManager::Register(const std::string& key, Resource* resource)
+{
+	assert(resource);
+	if (resource->handle.isValid())
+		Unregister(resource);
+
+	uint64_t hash = HashKey(resource->resource_type, key);
+	auto it = entries_by_hash.find(hash);
+	if (it != entries_by_hash.end())
+	{
+		if (entries[it->second].key != key)
+			std::cout << "[WARN] Resource name hash collision: " << key << " and " << entries[it->second].key << std::endl;
+		removeEntry(it->second);
+	}
+
+	uint32_t index;
+	if (free_entries.size())
+	{
+		index = free_entries.back();
+		free_entries.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)entries.size();
+		entries.push_back(sResourceEntry());
+		entries[index].generation = 0;
+	}
+
+	sResourceEntry& entry = entries[index];
+	entry.resource = resource;
+	entry.key = key;
+	entry.hash = hash;
+	entry.refs = 0;
+	entry.last_used = current_frame;
+	entry.cpu_size = entry.vram_size = 0;
+	entries_by_hash[hash] = index;
+
+	resource->handle.index = index;
+	resource->handle.generation = entry.generation;
+}
+
+void ResourceManager::Unregister(Resource* resource)
+{
+	assert(resource);
+	if (getEntry(resource->handle))
+		removeEntry(resource->handle.index);
+}
+
+Resource* ResourceManager::Find(const std::string& key, eResourceType type)
+{
+	auto it = entries_by_hash.find(HashKey(type, key));
+	if (it == entries_by_hash.end())
+		return NULL;
+	sResourceEntry& entry = entries[it->second];
+	if (entry.key != key)
+		return NULL;
+	entry.last_used = current_frame;
+	return entry.resource;
+}
+
+Resource* ResourceManager::Resolve(ResourceHandle handle)
+{
+	sResourceEntry* entry = getEntry(handle);
+	return entry ? entry->resource : NULL;
+}
+
+void ResourceManager::AddRef(ResourceHandle handle)
+{
+	sResourceEntry* entry = getEntry(handle);
+	if (!entry)
+		return;
+	entry->refs++;
+	entry->last_used = current_frame;
+}
+
+void ResourceManager::Release(ResourceHandle handle)
+{
+	sResourceEntry* entry = getEntry(handle);
+	if (!entry)
+		return;
+	assert(entry->refs > 0 && "resource released more times than acquired");
+	entry->refs--;
+	entry->last_used = current_frame;
+}
+
+void ResourceManager::Collect()
+{
+	current_frame++;
+
+	cpu_usage = vram_usage = 0;
+	for (sResourceEntry& entry : entries)
+	{
+		if (!entry.resource)
+			continue;
+		entry.cpu_size = entry.resource->getCPUSize();
+		entry.vram_size = entry.resource->getVRAMSize();
+		cpu_usage += entry.cpu_size;
+		vram_usage += entry.vram_size;
+	}
+
+	bool cpu_over = cpu_budget && cpu_usage > cpu_budget;
+	bool vram_over = vram_budget && vram_usage > vram_budget;
+	if (!cpu_over && !vram_over)
+	{
+		over_budget_warned = false;
+		return;
+	}
+
+	//only the ones nobody is using can go, oldest first
+	std::vector<uint32_t> candidates;
+	for (uint32_t i = 0; i < entries.size(); ++i)
+		if (entries[i].resource && entries[i].refs == 0 && entries[i].resource->canEvict())
+			candidates.push_back(i);
+	std::sort(candidates.begin(), candidates.end(), [](uint32_t a, uint32_t b) { return entries[a].last_used < entries[b].last_used; });
+
+	for (uint32_t index : candidates)
+	{
+		if (!cpu_over && !vram_over)
+			break;
+
+		sResourceEntry& entry = entries[index];
+		//evicting it must help the pool that is over budget
+		if (!(cpu_over && entry.cpu_size) && !(vram_over && entry.vram_size))
+			continue;
+
+		std::cout << " + Resource evicted: " << entry.key << std::endl;
+		cpu_usage -= entry.cpu_size;
+		vram_usage -= entry.vram_size;
+		Resource* resource = entry.resource;
+		removeEntry(index);
+		delete resource;
+
+		cpu_over = cpu_budget && cpu_usage > cpu_budget;
+		vram_over = vram_budget && vram_usage > vram_budget;
+	}
+
+	//warn once, it would flood the console every frame
+	if ((cpu_over || vram_over) && !over_budget_warned)
+		std::cout << "[WARN] Resources in use exceed the memory budget" << std::endl;
+	over_budget_warned = cpu_over || vram_over;
+}
+
+void ResourceManager::ForEach(eResourceType type, const std::function<void(Resource*)>& callback)
+{
+	for (size_t i = 0; i < entries.size(); ++i)
+		if (entries[i].resource && entries[i].resource->resource_type == type)
+			callback(entries[i].resource);
+}
+
+unsigned int ResourceManager::GetNumResources()
+{
+	return (unsigned int)(entries.size() - free_entries.size());
+}
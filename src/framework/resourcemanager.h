@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+enum eResourceType { RESOURCE_MESH, RESOURCE_TEXTURE, RESOURCE_SHADER };
+
+//Generational handle, it stops resolving once the resource it points to has been evicted
+struct ResourceHandle
+{
+	uint32_t index = 0xFFFFFFFF;
+	uint32_t generation = 0;
+
+	bool isValid() const { return index != 0xFFFFFFFF; }
+};
+
+//Base class of anything that can be stored in the ResourceManager
+class Resource
+{
+public:
+	eResourceType resource_type;
+	ResourceHandle handle; //invalid while the resource is not registered
+
+	Resource(eResourceType type) { this->resource_type = type; }
+	virtual ~Resource();
+
+	virtual size_t getCPUSize() { return 0; } //bytes used in RAM
+	virtual size_t getVRAMSize() { return 0; } //bytes used in VRAM
+	virtual bool canEvict() { return true; } //false while other threads are still using it
+
+	void addRef();
+	void removeRef(); //drops a reference taken with Get, resources not registered ignore it
+};
+
+//Stores all the loaded resources by hashed name, counts references and evicts the least recently used ones
+//that have no references left when the memory used goes over budget
+class ResourceManager
+{
+public:
+	static size_t cpu_budget; //in bytes, 0 means no limit
+	static size_t vram_budget;
+	static size_t cpu_usage; //updated on every Collect
+	static size_t vram_usage;
+
+	static uint64_t HashKey(eResourceType type, const std::string& key);
+
+	static void Register(const std::string& key, Resource* resource); //replaces any other resource with the same name
+	static void Unregister(Resource* resource); //does not delete it
+	static Resource* Find(const std::string& key, eResourceType type); //does not add a reference
+	static Resource* Resolve(ResourceHandle handle); //NULL if the handle is stale
+
+	template<class T> static T* Get(ResourceHandle handle) { return static_cast<T*>(Resolve(handle)); }
+
+	static void AddRef(ResourceHandle handle);
+	static void Release(ResourceHandle handle);
+
+	static void Collect(); //call it once per frame, evicts unreferenced resources while over budget
+	static void ForEach(eResourceType type, const std::function<void(Resource*)>& callback);
+	static unsigned int GetNumResources();
+};
@@ -0,0 +1,444 @@
+#include "scenefile.h"
+
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <string>
+
+#include "scenenode.h"
+#include "light.h"
+#include "mappedfile.h"
+#include "../graphics/material.h"
+#include "../graphics/texture.h"
+#include "../physics/particle.h"
+
+#define SCENE_SECTION_ALIGNMENT 16
+#define SCENE_NONE 0xFFFFFFFF
+
+enum eSceneMaterialType { SCENE_MATERIAL_FLAT, SCENE_MATERIAL_STANDARD };
+
+struct sSceneBinHeader
+{
+	char magic[4]; //SBIN
+	uint32_t version;
+	uint32_t header_bytes;
+	uint32_t num_nodes;
+	uint32_t num_meshes;
+	uint32_t num_materials;
+	uint32_t num_lights;
+	uint32_t num_particles;
+	uint32_t strings_bytes;
+	uint32_t padding;
+	//from the start of the file, aligned to SCENE_SECTION_ALIGNMENT
+	uint64_t nodes_offset;
+	uint64_t meshes_offset; //one string per mesh
+	uint64_t materials_offset;
+	uint64_t lights_offset;
+	uint64_t particles_offset;
+	uint64_t strings_offset; //null terminated, the offset 0 is the empty string
+};
+
+struct sSceneBinNode
+{
+	glm::mat4 local;
+	uint32_t parent; //index of an earlier node, SCENE_NONE for the roots
+	uint32_t name; //offset in the string table
+	uint32_t mesh; //index in the mesh table or SCENE_NONE
+	uint32_t material; //index in the materials or SCENE_NONE
+	uint32_t flags; //eEntityFlags, only visible and static
+	uint32_t type; //eType, the lights have one sSceneBinLight
+	uint32_t padding[2];
+};
+
+struct sSceneBinMaterial
+{
+	glm::vec4 color;
+	uint32_t type; //eSceneMaterialType
+	uint32_t texture; //string offset or SCENE_NONE
+	uint32_t padding[2];
+};
+
+struct sSceneBinLight
+{
+	glm::vec4 color;
+	uint32_t node; //index of its node, the lights are sorted by it
+	uint32_t type; //eLightType
+	float intensity;
+	float shininess;
+	float max_distance;
+	uint32_t cast_shadows;
+	uint32_t padding[2];
+};
+
+struct sSceneBinParticle
+{
+	float position[3];
+	float velocity[3];
+	float acceleration[3];
+	float damping;
+	float inverse_mass;
+	uint32_t padding;
+};
+
+static uint64_t alignSection(uint64_t offset)
+{
+	return (offset + SCENE_SECTION_ALIGNMENT - 1) & ~(uint64_t)(SCENE_SECTION_ALIGNMENT - 1);
+}
+
+static bool isSectionValid(uint64_t offset, uint64_t count, size_t record_size, size_t file_size)
+{
+	return offset % SCENE_SECTION_ALIGNMENT == 0 && offset <= file_size && count <= (file_size - offset) / record_size;
+}
+
+//nothing is created until the whole file is known to be consistent
+static bool validateScene(const sSceneBinHeader& header, const uint8_t* data, size_t size)
+{
+	if (!isSectionValid(header.nodes_offset, header.num_nodes, sizeof(sSceneBinNode), size) ||
+		!isSectionValid(header.meshes_offset, header.num_meshes, sizeof(uint32_t), size) ||
+		!isSectionValid(header.materials_offset, header.num_materials, sizeof(sSceneBinMaterial), size) ||
+		!isSectionValid(header.lights_offset, header.num_lights, sizeof(sSceneBinLight), size) ||
+		!isSectionValid(header.particles_offset, header.num_particles, sizeof(sSceneBinParticle), size) ||
+		!isSectionValid(header.strings_offset, header.strings_bytes, 1, size) ||
+		!header.strings_bytes || data[header.strings_offset + header.strings_bytes - 1] != 0)
+		return false;
+
+	uint32_t strings_bytes = header.strings_bytes;
+	const sSceneBinNode* nodes = (const sSceneBinNode*)(data + header.nodes_offset);
+	const uint32_t* meshes = (const uint32_t*)(data + header.meshes_offset);
+	const sSceneBinMaterial* materials = (const sSceneBinMaterial*)(data + header.materials_offset);
+	const sSceneBinLight* lights = (const sSceneBinLight*)(data + header.lights_offset);
+
+	for (uint32_t i = 0; i < header.num_meshes; ++i)
+		if (!meshes[i] || meshes[i] >= strings_bytes)
+			return false;
+	for (uint32_t i = 0; i < header.num_materials; ++i)
+		if (materials[i].type > SCENE_MATERIAL_STANDARD || (materials[i].texture != SCENE_NONE && materials[i].texture >= strings_bytes))
+			return false;
+
+	uint32_t num_light_nodes = 0;
+	for (uint32_t i = 0; i < header.num_nodes; ++i)
+	{
+		const sSceneBinNode& node = nodes[i];
+		if ((node.parent != SCENE_NONE && node.parent >= i) || node.name >= strings_bytes ||
+			(node.mesh != SCENE_NONE && node.mesh >= header.num_meshes) ||
+			(node.material != SCENE_NONE && node.material >= header.num_materials) ||
+			(node.type != NODE_BASE && node.type != NODE_LIGHT))
+			return false;
+		num_light_nodes += node.type == NODE_LIGHT;
+	}
+
+	if (num_light_nodes != header.num_lights)
+		return false;
+	for (uint32_t i = 0; i < header.num_lights; ++i)
+	{
+		const sSceneBinLight& light = lights[i];
+		if (light.node >= header.num_nodes || nodes[light.node].type != NODE_LIGHT || light.type > LIGHT_SPOT || (i && light.node <= lights[i - 1].node))
+			return false;
+	}
+	return true;
+}
+
+bool SceneFile::Load(const char* filename, std::vector<SceneNode*>& nodes, std::vector<Light*>& lights, std::vector<blue::Particle*>& particles)
+{
+	assert(filename);
+	auto start = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cout << "[ERROR] Scene not found: " << filename << std::endl;
+		return false;
+	}
+
+	sSceneBinHeader header;
+	bool valid = file.size >= sizeof(header);
+	if (valid)
+	{
+		memcpy(&header, file.data, sizeof(header));
+		valid = memcmp(header.magic, "SBIN", 4) == 0 && header.version == SCENE_BIN_VERSION && header.header_bytes == sizeof(header);
+	}
+	if (!valid || !validateScene(header, file.data, file.size))
+	{
+		std::cout << "[ERROR] loading scene BIN: invalid content or old version: " << filename << std::endl;
+		return false;
+	}
+
+	//the sections are aligned, the records are read in place from the mapped pages
+	const sSceneBinNode* file_nodes = (const sSceneBinNode*)(file.data + header.nodes_offset);
+	const uint32_t* file_meshes = (const uint32_t*)(file.data + header.meshes_offset);
+	const sSceneBinMaterial* file_materials = (const sSceneBinMaterial*)(file.data + header.materials_offset);
+	const sSceneBinLight* file_lights = (const sSceneBinLight*)(file.data + header.lights_offset);
+	const sSceneBinParticle* file_particles = (const sSceneBinParticle*)(file.data + header.particles_offset);
+	const char* strings = (const char*)(file.data + header.strings_offset);
+
+	//every mesh is requested once, the nodes that share it add a reference
+	std::vector<Mesh*> meshes(header.num_meshes);
+	std::vector<bool> mesh_taken(header.num_meshes, false);
+	for (uint32_t i = 0; i < header.num_meshes; ++i)
+		meshes[i] = Mesh::GetAsync(strings + file_meshes[i]);
+
+	//held while the nodes take their references, the ones no node uses are deleted after
+	std::vector<Material*> materials(header.num_materials);
+	for (uint32_t i = 0; i < header.num_materials; ++i)
+	{
+		const sSceneBinMaterial& info = file_materials[i];
+		Material* material = info.type == SCENE_MATERIAL_STANDARD ? (Material*)new StandardMaterial(info.color) : (Material*)new FlatMaterial(info.color);
+		if (info.texture != SCENE_NONE)
+			material->texture = Texture::GetAsync(strings + info.texture);
+		material->addRef();
+		materials[i] = material;
+	}
+
+	//fix-up pass: the parents come first, so every index already points to a created node
+	SceneGraph::get()->reserve(SceneGraph::get()->size() + header.num_nodes);
+	std::vector<SceneNode*> created(header.num_nodes);
+	nodes.reserve(nodes.size() + header.num_nodes - header.num_lights);
+	lights.reserve(lights.size() + header.num_lights);
+	uint32_t light_index = 0;
+	for (uint32_t i = 0; i < header.num_nodes; ++i)
+	{
+		const sSceneBinNode& info = file_nodes[i];
+		SceneNode* node;
+		if (info.type == NODE_LIGHT)
+		{
+			//the light creates its own debug sphere
+			const sSceneBinLight& light_info = file_lights[light_index++];
+			Light* light = new Light(glm::vec3(0.f), (eLightType)light_info.type, light_info.intensity, light_info.color);
+			light->shininess = light_info.shininess;
+			light->max_distance = light_info.max_distance;
+			light->cast_shadows = light_info.cast_shadows != 0;
+			light->name = strings + info.name;
+			lights.push_back(light);
+			node = light;
+		}
+		else
+		{
+			node = new SceneNode(strings + info.name);
+			if (info.mesh != SCENE_NONE)
+			{
+				Mesh* mesh = meshes[info.mesh];
+				if (mesh_taken[info.mesh])
+					mesh->addRef();
+				mesh_taken[info.mesh] = true;
+				node->setMesh(mesh);
+			}
+			if (info.material != SCENE_NONE)
+				node->setMaterial(materials[info.material]);
+			node->setVisible((info.flags & ENTITY_VISIBLE) != 0);
+			node->setStatic((info.flags & ENTITY_STATIC) != 0);
+			nodes.push_back(node);
+		}
+
+		if (info.parent != SCENE_NONE)
+			created[info.parent]->addChild(node);
+		node->setLocalMatrix(info.local);
+		created[i] = node;
+	}
+
+	//meshes no node ended up using
+	for (uint32_t i = 0; i < header.num_meshes; ++i)
+		if (!mesh_taken[i])
+			meshes[i]->removeRef();
+	for (Material* material : materials)
+		material->removeRef();
+
+	particles.reserve(particles.size() + header.num_particles);
+	for (uint32_t i = 0; i < header.num_particles; ++i)
+	{
+		const sSceneBinParticle& info = file_particles[i];
+		blue::Particle* particle = new blue::Particle();
+		particle->position = blue::Vector3(info.position[0], info.position[1], info.position[2]);
+		particle->velocity = blue::Vector3(info.velocity[0], info.velocity[1], info.velocity[2]);
+		particle->acceleration = blue::Vector3(info.acceleration[0], info.acceleration[1], info.acceleration[2]);
+		particle->damping = info.damping;
+		particle->inverseMass = info.inverse_mass;
+		particles.push_back(particle);
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << " + Scene " << filename << ": " << header.num_nodes << " nodes, " << header.num_meshes << " meshes, " << header.num_materials << " materials in " << ms << " ms" << std::endl;
+	return true;
+}
+
+//string table with the empty string at offset 0, repeated strings are stored once
+class SceneStrings
+{
+public:
+	std::vector<char> data;
+
+	SceneStrings() { data.push_back(0); }
+
+	uint32_t add(const std::string& text)
+	{
+		if (text.empty())
+			return 0;
+		auto it = offsets.find(text);
+		if (it != offsets.end())
+			return it->second;
+		uint32_t offset = (uint32_t)data.size();
+		data.insert(data.end(), text.c_str(), text.c_str() + text.size() + 1);
+		offsets[text] = offset;
+		return offset;
+	}
+
+private:
+	std::unordered_map<std::string, uint32_t> offsets;
+};
+
+static void collectSubtree(SceneNode* node, std::unordered_map<SceneNode*, uint32_t>& saved, std::vector<SceneNode*>& ordered)
+{
+	if (!saved.emplace(node, 0).second)
+		return;
+	ordered.push_back(node);
+	for (SceneNode* child : node->children)
+		collectSubtree(child, saved, ordered);
+}
+
+bool SceneFile::Save(const char* filename, const std::vector<SceneNode*>& nodes, const std::vector<Light*>& lights, const std::vector<blue::Particle*>& particles)
+{
+	assert(filename);
+	SceneGraph* scene = SceneGraph::get();
+
+	//the parents must be written before their children, the depth in the graph gives that order
+	std::unordered_map<SceneNode*, uint32_t> saved;
+	std::vector<SceneNode*> ordered;
+	for (SceneNode* node : nodes)
+		collectSubtree(node, saved, ordered);
+	for (Light* light : lights)
+		collectSubtree(light, saved, ordered);
+	std::stable_sort(ordered.begin(), ordered.end(), [scene](SceneNode* a, SceneNode* b) {
+		return scene->depth[a->entity] < scene->depth[b->entity];
+	});
+	for (uint32_t i = 0; i < ordered.size(); ++i)
+		saved[ordered[i]] = i;
+
+	SceneStrings strings;
+	std::unordered_map<Mesh*, uint32_t> mesh_indices;
+	std::unordered_map<Material*, uint32_t> material_indices;
+	std::vector<uint32_t> file_meshes;
+	std::vector<sSceneBinMaterial> file_materials;
+	std::vector<sSceneBinNode> file_nodes(ordered.size());
+	std::vector<sSceneBinLight> file_lights;
+	unsigned int num_unnamed = 0;
+
+	for (uint32_t i = 0; i < ordered.size(); ++i)
+	{
+		SceneNode* node = ordered[i];
+		sSceneBinNode& info = file_nodes[i]; //zeroed by the vector
+		info.name = strings.add(node->name);
+		info.type = node->type == NODE_LIGHT ? NODE_LIGHT : NODE_BASE;
+		info.flags = scene->flags[node->entity] & (ENTITY_VISIBLE | ENTITY_STATIC);
+		info.mesh = info.material = SCENE_NONE;
+
+		//a parent left out of the file is baked into the matrix
+		auto parent = node->parent ? saved.find(node->parent) : saved.end();
+		info.parent = parent != saved.end() ? parent->second : SCENE_NONE;
+		info.local = parent != saved.end() ? node->getLocalMatrix() : node->getGlobalMatrix();
+
+		if (info.type == NODE_LIGHT)
+		{
+			Light* light = (Light*)node;
+			sSceneBinLight light_info = {};
+			light_info.color = light->color;
+			light_info.node = i;
+			light_info.type = light->light_type;
+			light_info.intensity = light->intensity;
+			light_info.shininess = light->shininess;
+			light_info.max_distance = light->max_distance;
+			light_info.cast_shadows = light->cast_shadows;
+			file_lights.push_back(light_info);
+			continue;
+		}
+
+		Mesh* mesh = node->getMesh();
+		if (mesh && mesh->name.empty())
+			num_unnamed++;
+		else if (mesh)
+		{
+			auto it = mesh_indices.find(mesh);
+			if (it == mesh_indices.end())
+			{
+				it = mesh_indices.emplace(mesh, (uint32_t)file_meshes.size()).first;
+				file_meshes.push_back(strings.add(mesh->name));
+			}
+			info.mesh = it->second;
+		}
+
+		Material* material = node->getMaterial();
+		if (material)
+		{
+			auto it = material_indices.find(material);
+			if (it == material_indices.end())
+			{
+				sSceneBinMaterial material_info = {};
+				material_info.color = material->color;
+				material_info.type = dynamic_cast<StandardMaterial*>(material) ? SCENE_MATERIAL_STANDARD : SCENE_MATERIAL_FLAT;
+				material_info.texture = material->texture && material->texture->filename.size() ? strings.add(material->texture->filename) : SCENE_NONE;
+				it = material_indices.emplace(material, (uint32_t)file_materials.size()).first;
+				file_materials.push_back(material_info);
+			}
+			info.material = it->second;
+		}
+	}
+
+	std::vector<sSceneBinParticle> file_particles(particles.size());
+	for (size_t i = 0; i < particles.size(); ++i)
+	{
+		const blue::Particle* particle = particles[i];
+		sSceneBinParticle& info = file_particles[i];
+		memset(&info, 0, sizeof(info));
+		info.position[0] = particle->position.x; info.position[1] = particle->position.y; info.position[2] = particle->position.z;
+		info.velocity[0] = particle->velocity.x; info.velocity[1] = particle->velocity.y; info.velocity[2] = particle->velocity.z;
+		info.acceleration[0] = particle->acceleration.x; info.acceleration[1] = particle->acceleration.y; info.acceleration[2] = particle->acceleration.z;
+		info.damping = particle->damping;
+		info.inverse_mass = particle->inverseMass;
+	}
+
+	sSceneBinHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "SBIN", 4);
+	header.version = SCENE_BIN_VERSION;
+	header.header_bytes = sizeof(header);
+	header.num_nodes = (uint32_t)file_nodes.size();
+	header.num_meshes = (uint32_t)file_meshes.size();
+	header.num_materials = (uint32_t)file_materials.size();
+	header.num_lights = (uint32_t)file_lights.size();
+	header.num_particles = (uint32_t)file_particles.size();
+	header.strings_bytes = (uint32_t)strings.data.size();
+	header.nodes_offset = alignSection(sizeof(header));
+	header.meshes_offset = alignSection(header.nodes_offset + file_nodes.size() * sizeof(sSceneBinNode));
+	header.materials_offset = alignSection(header.meshes_offset + file_meshes.size() * sizeof(uint32_t));
+	header.lights_offset = alignSection(header.materials_offset + file_materials.size() * sizeof(sSceneBinMaterial));
+	header.particles_offset = alignSection(header.lights_offset + file_lights.size() * sizeof(sSceneBinLight));
+	header.strings_offset = alignSection(header.particles_offset + file_particles.size() * sizeof(sSceneBinParticle));
+
+	//laid out in memory first and written at once
+	std::vector<uint8_t> data(header.strings_offset + strings.data.size(), 0);
+	auto copySection = [&data](uint64_t offset, const void* values, size_t bytes) { if (bytes) memcpy(&data[offset], values, bytes); };
+	copySection(0, &header, sizeof(header));
+	copySection(header.nodes_offset, file_nodes.data(), file_nodes.size() * sizeof(sSceneBinNode));
+	copySection(header.meshes_offset, file_meshes.data(), file_meshes.size() * sizeof(uint32_t));
+	copySection(header.materials_offset, file_materials.data(), file_materials.size() * sizeof(sSceneBinMaterial));
+	copySection(header.lights_offset, file_lights.data(), file_lights.size() * sizeof(sSceneBinLight));
+	copySection(header.particles_offset, file_particles.data(), file_particles.size() * sizeof(sSceneBinParticle));
+	copySection(header.strings_offset, strings.data.data(), strings.data.size());
+
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write scene BIN: " << filename << std::endl;
+		return false;
+	}
+	bool written = fwrite(&data[0], 1, data.size(), f) == data.size();
+	fclose(f);
+
+	if (num_unnamed)
+		std::cout << "[WARN] " << num_unnamed << " nodes use meshes not loaded from a file, they are saved without mesh" << std::endl;
+	if (written)
+		std::cout << " + Scene saved: " << filename << " " << header.num_nodes << " nodes" << std::endl;
+	return written;
+}
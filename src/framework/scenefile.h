@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+class SceneNode;
+class Light;
+namespace blue { class Particle; }
+
+#define SCENE_BIN_VERSION 1
+
+/*
+	Binary scene (.sbin): a header, flat arrays of fixed size records and a string table at the end.
+	The nodes are stored parents first and refer to each other, to meshes, materials and names by index,
+	so loading maps the file, validates it and creates everything in one pass without parsing.
+*/
+class SceneFile
+{
+public:
+	//the nodes (lights not included) and the lights are appended to the lists, the caller owns them
+	static bool Load(const char* filename, std::vector<SceneNode*>& nodes, std::vector<Light*>& lights, std::vector<blue::Particle*>& particles);
+	//the children of the nodes are saved too, meshes are stored by name so procedural ones are skipped
+	static bool Save(const char* filename, const std::vector<SceneNode*>& nodes, const std::vector<Light*>& lights, const std::vector<blue::Particle*>& particles);
+};
@@ -0,0 +1,251 @@
+#include "scenegraph.h"
+
+#include <cassert>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "scenenode.h"
+#include "../graphics/mesh.h"
+
+SceneGraph* SceneGraph::get()
+{
+	static SceneGraph* scene_graph = new SceneGraph();
+	return scene_graph;
+}
+
+//the same reordering applied to every component array
+template<typename T> static void permute(std::vector<T>& values, const std::vector<int>& new_index, size_t count)
+{
+	std::vector<T> result(values.size());
+	for (size_t i = 0; i < count; ++i)
+		result[new_index[i]] = values[i];
+	values.swap(result);
+}
+
+template<typename T> static void moveLast(std::vector<T>& values, int to, size_t last)
+{
+	values[to] = values[last];
+}
+
+void SceneGraph::reserve(size_t count)
+{
+	size_t padded = (count + 3) & ~(size_t)3;
+	this->local.reserve(count);
+	this->world.reserve(count);
+	this->parent.reserve(count);
+	this->depth.reserve(count);
+	this->dirty.reserve(count);
+	this->mesh.reserve(count);
+	this->material.reserve(count);
+	this->flags.reserve(count);
+	this->nodes.reserve(count);
+	this->center_x.reserve(padded);
+	this->center_y.reserve(padded);
+	this->center_z.reserve(padded);
+	this->halfsize_x.reserve(padded);
+	this->halfsize_y.reserve(padded);
+	this->halfsize_z.reserve(padded);
+}
+
+int SceneGraph::add(SceneNode* node)
+{
+	//the roots have depth 0, so appending keeps the order
+	int entity = (int)this->nodes.size();
+	this->local.push_back(glm::mat4(1.f));
+	this->world.push_back(glm::mat4(1.f));
+	this->parent.push_back(-1);
+	this->depth.push_back(0);
+	this->dirty.push_back(1);
+	this->mesh.push_back(NULL);
+	this->material.push_back(NULL);
+	this->flags.push_back(ENTITY_VISIBLE);
+	this->nodes.push_back(node);
+	padBounds();
+	this->layout_version++;
+	return entity;
+}
+
+void SceneGraph::remove(SceneNode* node)
+{
+	int entity = node->entity;
+	assert(entity >= 0 && this->nodes[entity] == node);
+	assert(node->children.empty() && !node->parent && "detach the node before removing it");
+
+	//the last one takes its place, the depth order is restored on the next update
+	size_t last = this->nodes.size() - 1;
+	if ((size_t)entity != last)
+	{
+		moveLast(this->local, entity, last);
+		moveLast(this->world, entity, last);
+		moveLast(this->parent, entity, last);
+		moveLast(this->depth, entity, last);
+		moveLast(this->dirty, entity, last);
+		moveLast(this->mesh, entity, last);
+		moveLast(this->material, entity, last);
+		moveLast(this->flags, entity, last);
+		moveLast(this->center_x, entity, last);
+		moveLast(this->center_y, entity, last);
+		moveLast(this->center_z, entity, last);
+		moveLast(this->halfsize_x, entity, last);
+		moveLast(this->halfsize_y, entity, last);
+		moveLast(this->halfsize_z, entity, last);
+
+		SceneNode* moved = this->nodes[last];
+		this->nodes[entity] = moved;
+		moved->entity = entity;
+		for (SceneNode* child : moved->children)
+			this->parent[child->entity] = entity;
+		this->sorted = false;
+	}
+
+	this->local.pop_back();
+	this->world.pop_back();
+	this->parent.pop_back();
+	this->depth.pop_back();
+	this->dirty.pop_back();
+	this->mesh.pop_back();
+	this->material.pop_back();
+	this->flags.pop_back();
+	this->nodes.pop_back();
+	padBounds();
+	this->layout_version++;
+	node->entity = -1;
+}
+
+void SceneGraph::setParent(SceneNode* node, SceneNode* parent)
+{
+	int entity = node->entity;
+	this->parent[entity] = parent ? parent->entity : -1;
+	this->dirty[entity] = 1;
+	setDepth(node, parent ? this->depth[parent->entity] + 1 : 0);
+	this->sorted = false;
+}
+
+void SceneGraph::setMesh(int entity, Mesh* mesh)
+{
+	this->mesh[entity] = mesh;
+	setFlag(entity, ENTITY_BOUNDS_READY, false);
+}
+
+void SceneGraph::setDepth(SceneNode* node, uint16_t depth)
+{
+	this->depth[node->entity] = depth;
+	for (SceneNode* child : node->children)
+		setDepth(child, depth + 1);
+}
+
+//the padding boxes are empty, the culler reads 4 at a time
+void SceneGraph::padBounds()
+{
+	size_t count = this->nodes.size();
+	size_t padded = (count + 3) & ~(size_t)3;
+	std::vector<float>* arrays[6] = { &this->center_x, &this->center_y, &this->center_z, &this->halfsize_x, &this->halfsize_y, &this->halfsize_z };
+	for (std::vector<float>* values : arrays)
+	{
+		values->resize(padded, 0.f);
+		std::fill(values->begin() + count, values->end(), 0.f);
+	}
+}
+
+//counting sort by depth, stable so the siblings keep their order
+void SceneGraph::sort()
+{
+	size_t count = this->nodes.size();
+	uint16_t max_depth = 0;
+	for (size_t i = 0; i < count; ++i)
+		max_depth = std::max(max_depth, this->depth[i]);
+
+	std::vector<int> starts(max_depth + 2, 0);
+	for (size_t i = 0; i < count; ++i)
+		starts[this->depth[i] + 1]++;
+	for (size_t d = 1; d < starts.size(); ++d)
+		starts[d] += starts[d - 1];
+
+	std::vector<int> new_index(count);
+	for (size_t i = 0; i < count; ++i)
+		new_index[i] = starts[this->depth[i]]++;
+
+	for (size_t i = 0; i < count; ++i)
+		if (this->parent[i] != -1)
+			this->parent[i] = new_index[this->parent[i]];
+
+	permute(this->local, new_index, count);
+	permute(this->world, new_index, count);
+	permute(this->parent, new_index, count);
+	permute(this->depth, new_index, count);
+	permute(this->dirty, new_index, count);
+	permute(this->mesh, new_index, count);
+	permute(this->material, new_index, count);
+	permute(this->flags, new_index, count);
+	permute(this->center_x, new_index, count);
+	permute(this->center_y, new_index, count);
+	permute(this->center_z, new_index, count);
+	permute(this->halfsize_x, new_index, count);
+	permute(this->halfsize_y, new_index, count);
+	permute(this->halfsize_z, new_index, count);
+	permute(this->nodes, new_index, count);
+	for (size_t i = 0; i < count; ++i)
+		this->nodes[i]->entity = (int)i;
+
+	this->sorted = true;
+	this->layout_version++;
+}
+
+//world AABB of the local box (Arvo): the center is transformed and the halfsize uses the absolute rotation
+void SceneGraph::computeBounds(int entity)
+{
+	this->bounds_changed.push_back(entity);
+	Mesh* mesh = this->mesh[entity];
+	if (!mesh || !mesh->isReady())
+	{
+		this->center_x[entity] = this->center_y[entity] = this->center_z[entity] = 0.f;
+		this->halfsize_x[entity] = this->halfsize_y[entity] = this->halfsize_z[entity] = 0.f;
+		setFlag(entity, ENTITY_BOUNDS_READY, false);
+		return;
+	}
+
+	const glm::mat4& m = this->world[entity];
+	const BoundingBox& box = mesh->box;
+	glm::vec3 center = glm::vec3(m * glm::vec4(box.center, 1.f));
+	this->center_x[entity] = center.x;
+	this->center_y[entity] = center.y;
+	this->center_z[entity] = center.z;
+	this->halfsize_x[entity] = fabsf(m[0][0]) * box.halfsize.x + fabsf(m[1][0]) * box.halfsize.y + fabsf(m[2][0]) * box.halfsize.z;
+	this->halfsize_y[entity] = fabsf(m[0][1]) * box.halfsize.x + fabsf(m[1][1]) * box.halfsize.y + fabsf(m[2][1]) * box.halfsize.z;
+	this->halfsize_z[entity] = fabsf(m[0][2]) * box.halfsize.x + fabsf(m[1][2]) * box.halfsize.y + fabsf(m[2][2]) * box.halfsize.z;
+	setFlag(entity, ENTITY_BOUNDS_READY, true);
+}
+
+void SceneGraph::update()
+{
+	if (!this->sorted)
+		sort();
+
+	//the parent of every entity was already visited, its dirty flag tells if its world matrix changed
+	this->num_updated = 0;
+	this->bounds_changed.clear();
+	this->batched_changed.clear();
+	size_t count = this->nodes.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		int p = this->parent[i];
+		if (p != -1 && this->dirty[p])
+			this->dirty[i] = 1;
+
+		//meshes loaded in background get their box once they are ready
+		if (!this->dirty[i])
+		{
+			if (this->mesh[i] && !(this->flags[i] & ENTITY_BOUNDS_READY))
+				computeBounds((int)i);
+			continue;
+		}
+		this->world[i] = p == -1 ? this->local[i] : this->world[p] * this->local[i];
+		computeBounds((int)i);
+		this->num_updated++;
+		if (this->flags[i] & ENTITY_BATCHED)
+			this->batched_changed.push_back((int)i);
+	}
+	if (count)
+		memset(&this->dirty[0], 0, count);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <glm/mat4x4.hpp>
+
+class SceneNode;
+class Mesh;
+class Material;
+
+enum eEntityFlags {
+	ENTITY_VISIBLE = 1,
+	ENTITY_STATIC = 2, //never moves, it is drawn by the static batch when the GPU supports it
+	ENTITY_BATCHED = 4, //set by StaticBatch::add, the queue skips its opaque draw
+	ENTITY_BOUNDS_READY = 8 //the world box is computed, its mesh was ready
+};
+
+//Components of all the scene nodes in dense arrays indexed by entity, the SceneNode objects are only a facade.
+//The entities are ordered by depth, the parents always before their children, so the world matrices are
+//updated in one linear pass: changing a local matrix only marks it dirty and update() recomputes the dirty
+//entities and everything below them, the rest of the scene is not touched.
+//The world boxes are stored as structure of arrays padded to 4, like the FrustumCuller reads them.
+class SceneGraph
+{
+public:
+	static SceneGraph* get(); //global store, every SceneNode is added when constructed
+
+	//transforms
+	std::vector<glm::mat4> local;
+	std::vector<glm::mat4> world;
+	std::vector<int> parent; //entity, -1 for the roots
+	std::vector<uint16_t> depth;
+	std::vector<uint8_t> dirty;
+
+	//rendering
+	std::vector<Mesh*> mesh;
+	std::vector<Material*> material;
+	std::vector<uint8_t> flags; //eEntityFlags
+
+	//world AABB, padded to a multiple of 4 with empty boxes
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> halfsize_x, halfsize_y, halfsize_z;
+
+	std::vector<SceneNode*> nodes; //facade of every entity
+
+	//stats
+	unsigned int num_updated = 0; //world matrices recomputed in the last update
+
+	//for the structures built over the entities
+	unsigned int layout_version = 0; //increased when entities are added, removed or reordered
+	std::vector<int> bounds_changed; //entities whose world box was computed in the last update
+	std::vector<int> batched_changed; //of the world matrices recomputed, the ones drawn by the static batch, it must upload them again
+
+	size_t size() const { return nodes.size(); }
+	bool hasFlag(int entity, eEntityFlags flag) const { return (flags[entity] & flag) != 0; }
+	void setFlag(int entity, eEntityFlags flag, bool value) { flags[entity] = value ? (flags[entity] | flag) : (flags[entity] & ~flag); }
+
+	void reserve(size_t count); //before adding many nodes at once
+	int add(SceneNode* node); //as a root, returns its entity
+	void remove(SceneNode* node);
+	void setParent(SceneNode* node, SceneNode* parent); //NULL makes it a root, the local matrix is kept
+	void setLocal(int entity, const glm::mat4& m) { local[entity] = m; dirty[entity] = 1; }
+	void setMesh(int entity, Mesh* mesh); //its box is computed on the next update
+	void update(); //call it once per frame before anything reads the world matrices or boxes
+
+private:
+	bool sorted = true; //false after the hierarchy changed
+
+	void setDepth(SceneNode* node, uint16_t depth); //also the whole subtree
+	void sort();
+	void padBounds();
+	void computeBounds(int entity);
+};
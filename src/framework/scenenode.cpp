@@ -16,26 +16,112 @@ SceneNode::SceneNode()
 {
 	this->type = NODE_BASE;
 	this->name = std::string("Node" + std::to_string(this->lastNameId++));
+	this->entity = SceneGraph::get()->add(this);
 }
 
 SceneNode::SceneNode(const char* name)
 {
 	this->type = NODE_BASE;
 	this->name = name;
+	this->entity = SceneGraph::get()->add(this);
 }
 
-SceneNode::~SceneNode() { }
+SceneNode::~SceneNode()
+{
+	setMesh(NULL);
+	setMaterial(NULL);
+
+	//the children stay in the scene as roots
+	while (this->children.size())
+		removeChild(this->children.back());
+	if (this->parent)
+		this->parent->removeChild(this);
+	SceneGraph::get()->remove(this);
+}
+
+void SceneNode::addChild(SceneNode* child)
+{
+	assert(child && child != this);
+	if (child->parent == this)
+		return;
+	if (child->parent)
+		child->parent->removeChild(child);
+
+	//a node cannot hang from its own subtree
+	for (SceneNode* ancestor = this; ancestor; ancestor = ancestor->parent)
+		assert(ancestor != child && "cycle in the scene graph");
+
+	child->parent = this;
+	this->children.push_back(child);
+	SceneGraph::get()->setParent(child, this);
+}
+
+void SceneNode::removeChild(SceneNode* child)
+{
+	auto it = std::find(this->children.begin(), this->children.end(), child);
+	if (it == this->children.end())
+		return;
+	this->children.erase(it);
+	child->parent = NULL;
+	SceneGraph::get()->setParent(child, NULL);
+}
+
+void SceneNode::setMesh(Mesh* mesh)
+{
+	Mesh* previous = getMesh();
+	if (previous == mesh)
+		return;
+	if (previous)
+		previous->removeRef();
+	SceneGraph::get()->setMesh(this->entity, mesh);
+}
+
+void SceneNode::setMaterial(Material* material)
+{
+	Material* previous = getMaterial();
+	if (previous == material)
+		return;
+	if (material)
+		material->addRef();
+	SceneGraph::get()->material[this->entity] = material;
+	if (previous)
+		previous->removeRef();
+}
 
 void SceneNode::render(Camera* camera)
 {
-	if (this->material && this->visible)
-		this->material->render(this->mesh, this->model, camera);
+	//skip meshes still loading in background
+	Mesh* mesh = getMesh();
+	if (mesh && !mesh->isReady())
+		return;
+
+	Material* material = getMaterial();
+	if (material && isVisible())
+		material->render(mesh, getGlobalMatrix(), camera);
 }
 
 void SceneNode::renderWireframe(Camera* camera)
 {
+	Mesh* mesh = getMesh();
+	if (mesh && !mesh->isReady())
+		return;
+
 	WireframeMaterial mat = WireframeMaterial();
-	mat.render(this->mesh, this->model, camera);
+	mat.render(mesh, getGlobalMatrix(), camera);
+}
+
+void SceneNode::submit(RenderQueue& queue, Camera* camera, bool wireframe)
+{
+	Mesh* mesh = getMesh();
+	if (!mesh || !mesh->isReady())
+		return;
+
+	Material* material = getMaterial();
+	if (material && isVisible() && !isBatched())
+		queue.submit(mesh, material, getGlobalMatrix(), camera, RENDER_PASS_OPAQUE);
+
+	if (wireframe)
+		queue.submit(mesh, WireframeMaterial::GetShared(), getGlobalMatrix(), camera, RENDER_PASS_WIREFRAME);
 }
 
 void SceneNode::renderInMenu()
@@ -43,18 +129,25 @@ void SceneNode::renderInMenu()
 	// Model edit
 	if (ImGui::TreeNode("Model")) 
 	{
+		// relative to the parent, only written back when edited so the subtree is not marked dirty every frame
+		glm::mat4 model = getLocalMatrix();
 		float matrixTranslation[3], matrixRotation[3], matrixScale[3];
-		ImGuizmo::DecomposeMatrixToComponents(glm::value_ptr(this->model), matrixTranslation, matrixRotation, matrixScale);
-		ImGui::DragFloat3("Position", matrixTranslation, 0.1f);
-		ImGui::DragFloat3("Rotation", matrixRotation, 0.1f);
-		ImGui::DragFloat3("Scale", matrixScale, 0.1f);
-		ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, glm::value_ptr(this->model));
+		ImGuizmo::DecomposeMatrixToComponents(glm::value_ptr(model), matrixTranslation, matrixRotation, matrixScale);
+		bool changed = ImGui::DragFloat3("Position", matrixTranslation, 0.1f);
+		changed |= ImGui::DragFloat3("Rotation", matrixRotation, 0.1f);
+		changed |= ImGui::DragFloat3("Scale", matrixScale, 0.1f);
+		if (changed)
+		{
+			ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, glm::value_ptr(model));
+			setLocalMatrix(model);
+		}
 		
 		ImGui::TreePop();
 	}
 
 	// Material
-	if (this->material && ImGui::TreeNode("Material"))
+	Material* material = getMaterial();
+	if (material && ImGui::TreeNode("Material"))
 	{
 		material->renderInMenu();
 		ImGui::TreePop();
@@ -6,7 +6,9 @@
 #include "../graphics/shader.h"
 #include "../graphics/mesh.h"
 #include "../graphics/material.h"
+#include "../graphics/renderqueue.h"
 #include "framework/utils.h"
+#include "scenegraph.h"
 
 class Light;
 enum eType { NODE_BASE, NODE_VOLUME, NODE_LIGHT };
@@ -18,17 +20,35 @@ public:
 	static unsigned int lastNameId;
 	std::string name;
 
-	glm::mat4 model = glm::mat4(1.f);
-	Mesh* mesh = NULL;
-	Material* material = NULL;
-
-	bool visible = true;
+	//the components live in the SceneGraph arrays, the local matrix is relative to the parent
+	SceneNode* parent = NULL;
+	std::vector<SceneNode*> children;
+	int entity = -1;
 
 	SceneNode();
 	SceneNode(const char* name);
-	~SceneNode();
+	virtual ~SceneNode();
+
+	void addChild(SceneNode* child); //its local matrix is now relative to this node
+	void removeChild(SceneNode* child); //it becomes a root
+	const glm::mat4& getLocalMatrix() const { return SceneGraph::get()->local[this->entity]; }
+	void setLocalMatrix(const glm::mat4& m) { SceneGraph::get()->setLocal(this->entity, m); }
+	const glm::mat4& getGlobalMatrix() const { return SceneGraph::get()->world[this->entity]; } //as of the last SceneGraph::update
+
+	Mesh* getMesh() const { return SceneGraph::get()->mesh[this->entity]; }
+	void setMesh(Mesh* mesh); //takes over the reference of Mesh::Get, the previous mesh is released
+	Material* getMaterial() const { return SceneGraph::get()->material[this->entity]; }
+	void setMaterial(Material* material); //adds a reference, the previous material is released
+
+	bool isVisible() const { return SceneGraph::get()->hasFlag(this->entity, ENTITY_VISIBLE); }
+	void setVisible(bool visible) { SceneGraph::get()->setFlag(this->entity, ENTITY_VISIBLE, visible); }
+	bool isStatic() const { return SceneGraph::get()->hasFlag(this->entity, ENTITY_STATIC); }
+	void setStatic(bool is_static) { SceneGraph::get()->setFlag(this->entity, ENTITY_STATIC, is_static); }
+	bool isBatched() const { return SceneGraph::get()->hasFlag(this->entity, ENTITY_BATCHED); }
+	void setBatched(bool batched) { SceneGraph::get()->setFlag(this->entity, ENTITY_BATCHED, batched); }
 
 	virtual void render(Camera* camera);
 	virtual void renderWireframe(Camera* camera);
+	virtual void submit(RenderQueue& queue, Camera* camera, bool wireframe = false); //adds its draws to the queue instead of rendering
 	virtual void renderInMenu();
 };
\ No newline at end of file
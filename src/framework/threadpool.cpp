@@ -0,0 +1,113 @@
+#include "threadpool.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+ThreadPool* ThreadPool::get()
+{
+	static ThreadPool pool;
+	return &pool;
+}
+
+ThreadPool::ThreadPool(unsigned int num_threads)
+{
+	this->stopping = false;
+
+	if (num_threads == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		num_threads = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < num_threads; ++i)
+		this->workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->condition.notify_all();
+
+	for (std::thread& worker : this->workers)
+		worker.join();
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->jobs.push(std::move(job));
+	}
+	this->condition.notify_one();
+}
+
+//shared with the helpers, they can start after parallelFor has returned if the pool was busy
+struct sParallelForState
+{
+	std::atomic<size_t> next_chunk{ 0 };
+	std::atomic<size_t> chunks_done{ 0 };
+	std::mutex mutex;
+	std::condition_variable finished;
+};
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	size_t num_chunks = (count + grain - 1) / grain;
+	if (num_chunks == 1 || this->workers.empty())
+	{
+		func(0, count);
+		return;
+	}
+
+	std::shared_ptr<sParallelForState> state = std::make_shared<sParallelForState>();
+
+	//every thread takes chunks until there are none left, so we never wait for a helper that did not start
+	auto work = [state, count, grain, num_chunks, &func]() {
+		size_t chunk;
+		while ((chunk = state->next_chunk++) < num_chunks)
+		{
+			size_t begin = chunk * grain;
+			func(begin, std::min(begin + grain, count));
+			if (++state->chunks_done == num_chunks)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	size_t num_helpers = std::min(this->workers.size(), num_chunks - 1);
+	for (size_t i = 0; i < num_helpers; ++i)
+		enqueue(work);
+
+	work();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state, num_chunks] { return state->chunks_done == num_chunks; });
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->condition.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+			if (this->stopping && this->jobs.empty())
+				return;
+			job = std::move(this->jobs.front());
+			this->jobs.pop();
+		}
+		job();
+	}
+}
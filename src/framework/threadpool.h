@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+//Simple pool of worker threads that run jobs in FIFO order
+//Jobs must not call OpenGL, only the main thread owns the context
+class ThreadPool
+{
+public:
+	static ThreadPool* get(); //global pool, created on first use
+
+	ThreadPool(unsigned int num_threads = 0); //0 uses one thread less than the cores available
+	~ThreadPool();
+
+	void enqueue(std::function<void()> job);
+
+	//splits [0, count) in chunks of grain elements and runs them in the workers and the calling thread,
+	//returns when all are done, func receives the begin and end of every chunk
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func);
+	unsigned int getNumThreads() const { return (unsigned int)workers.size(); }
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+
+	void workerLoop();
+};
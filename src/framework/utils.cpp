@@ -15,6 +15,9 @@
 
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
+#include <cstring>
+
 long getTime()
 {
 	#ifdef _WIN32
@@ -155,6 +158,131 @@ bool readFile(const std::string& filename, std::string& content)
 	return true;
 }
 
+//LZ77 block codec, layout similar to LZ4: every sequence is a token (4 bits literals length, 4 bits match length),
+//the literals and a 16 bits offset to the match. Lengths of 15 or more continue in extra bytes. The last sequence has no match.
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+
+static inline uint32_t readU32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint32_t hashLZ(uint32_t v) { return (v * 2654435761u) >> (32 - LZ_HASH_BITS); }
+
+static void writeLengthLZ(std::vector<uint8_t>& out, size_t length)
+{
+	while (length >= 255) { out.push_back(255); length -= 255; }
+	out.push_back((uint8_t)length);
+}
+
+size_t compressLZ(const uint8_t* src, size_t size, std::vector<uint8_t>& out)
+{
+	size_t start = out.size();
+	std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0xFFFFFFFF);
+
+	size_t anchor = 0; //first literal not emitted yet
+	size_t i = 0;
+	while (size >= LZ_MIN_MATCH && i <= size - LZ_MIN_MATCH)
+	{
+		uint32_t v = readU32(src + i);
+		uint32_t h = hashLZ(v);
+		uint32_t candidate = table[h];
+		table[h] = (uint32_t)i;
+
+		if (candidate == 0xFFFFFFFF || i - candidate > LZ_MAX_OFFSET || readU32(src + candidate) != v)
+		{
+			i++;
+			continue;
+		}
+
+		//extend the match
+		size_t length = LZ_MIN_MATCH;
+		while (i + length < size && src[candidate + length] == src[i + length])
+			length++;
+
+		size_t literals = i - anchor;
+		uint8_t token = (uint8_t)((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(length - LZ_MIN_MATCH, 15));
+		out.push_back(token);
+		if (literals >= 15)
+			writeLengthLZ(out, literals - 15);
+		out.insert(out.end(), src + anchor, src + i);
+
+		uint16_t offset = (uint16_t)(i - candidate);
+		out.push_back((uint8_t)(offset & 0xFF));
+		out.push_back((uint8_t)(offset >> 8));
+		if (length - LZ_MIN_MATCH >= 15)
+			writeLengthLZ(out, length - LZ_MIN_MATCH - 15);
+
+		i += length;
+		anchor = i;
+	}
+
+	//trailing literals
+	size_t literals = size - anchor;
+	out.push_back((uint8_t)(std::min<size_t>(literals, 15) << 4));
+	if (literals >= 15)
+		writeLengthLZ(out, literals - 15);
+	out.insert(out.end(), src + anchor, src + size);
+
+	return out.size() - start;
+}
+
+bool decompressLZ(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size)
+{
+	const uint8_t* src_end = src + size;
+	uint8_t* dst_start = dst;
+	uint8_t* dst_end = dst + dst_size;
+
+	while (src < src_end)
+	{
+		uint8_t token = *src++;
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+		{
+			uint8_t b;
+			do {
+				if (src >= src_end) return false;
+				b = *src++;
+				literals += b;
+			} while (b == 255);
+		}
+		if (literals > (size_t)(src_end - src) || literals > (size_t)(dst_end - dst))
+			return false;
+		memcpy(dst, src, literals);
+		src += literals;
+		dst += literals;
+
+		if (src == src_end) //last sequence has no match
+			break;
+
+		if (src_end - src < 2)
+			return false;
+		size_t offset = src[0] | (src[1] << 8);
+		src += 2;
+		size_t length = (token & 15) + LZ_MIN_MATCH;
+		if ((token & 15) == 15)
+		{
+			uint8_t b;
+			do {
+				if (src >= src_end) return false;
+				b = *src++;
+				length += b;
+			} while (b == 255);
+		}
+		if (offset == 0 || offset > (size_t)(dst - dst_start) || length > (size_t)(dst_end - dst))
+			return false;
+
+		const uint8_t* match = dst - offset;
+		if (offset >= length)
+			memcpy(dst, match, length);
+		else //overlapping copy, repeats the pattern
+			for (size_t j = 0; j < length; ++j)
+				dst[j] = match[j];
+		dst += length;
+	}
+
+	return dst == dst_end;
+}
+
 char const* gl_error_string(GLenum const err) noexcept
 {
 	switch (err)
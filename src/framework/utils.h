@@ -19,6 +19,10 @@ long getTime();
 float* snapshot();
 bool readFile(const std::string& filename, std::string& content);
 
+//fast LZ block compression (used by the binary formats)
+size_t compressLZ(const uint8_t* src, size_t size, std::vector<uint8_t>& out);
+bool decompressLZ(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size);
+
 //generic purposes fuctions
 void drawGrid();
 glm::vec3 transformQuat(const glm::vec3& a, const glm::quat& q);
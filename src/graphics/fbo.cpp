@@ -0,0 +1,212 @@
+#include "fbo.h"
+
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+
+#include "texture.h"
+
+//renderbuffers need a sized format
+static GLenum getSizedFormat(int format, int type)
+{
+	bool rgb = format == GL_RGB;
+	if (type == GL_FLOAT)
+		return rgb ? GL_RGB32F : GL_RGBA32F;
+	if (type == GL_HALF_FLOAT)
+		return rgb ? GL_RGB16F : GL_RGBA16F;
+	return rgb ? GL_RGB8 : GL_RGBA8;
+}
+
+FBO::FBO()
+{
+	this->fbo_id = 0;
+	this->resolve_id = 0;
+	this->depth_texture = NULL;
+	this->num_color_textures = 0;
+	this->renderbuffer_depth = 0;
+	this->width = this->height = 0;
+	this->samples = 0;
+	for (int i = 0; i < FBO_MAX_COLOR_TEXTURES; ++i)
+	{
+		this->color_textures[i] = NULL;
+		this->renderbuffer_color[i] = 0;
+		this->buffers[i] = GL_NONE;
+	}
+}
+
+FBO::~FBO()
+{
+	release();
+}
+
+void FBO::release()
+{
+	for (int i = 0; i < FBO_MAX_COLOR_TEXTURES; ++i)
+	{
+		if (this->color_textures[i])
+			delete this->color_textures[i];
+		this->color_textures[i] = NULL;
+		if (this->renderbuffer_color[i])
+			glDeleteRenderbuffers(1, &this->renderbuffer_color[i]);
+		this->renderbuffer_color[i] = 0;
+	}
+	if (this->depth_texture)
+		delete this->depth_texture;
+	this->depth_texture = NULL;
+	if (this->renderbuffer_depth)
+		glDeleteRenderbuffers(1, &this->renderbuffer_depth);
+	this->renderbuffer_depth = 0;
+
+	if (this->fbo_id)
+		glDeleteFramebuffers(1, &this->fbo_id);
+	if (this->resolve_id)
+		glDeleteFramebuffers(1, &this->resolve_id);
+	this->fbo_id = this->resolve_id = 0;
+	this->num_color_textures = 0;
+}
+
+bool FBO::create(int width, int height, int num_textures, int format, int type, bool use_depth_texture, int samples)
+{
+	assert(width > 0 && height > 0 && num_textures >= 0 && num_textures <= FBO_MAX_COLOR_TEXTURES);
+	release();
+
+	GLint max_samples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+	this->samples = samples > 1 ? std::min(samples, (int)max_samples) : 0;
+	this->width = width;
+	this->height = height;
+	this->num_color_textures = num_textures;
+
+	//the textures are what gets sampled after rendering, resolved there when multisampled
+	GLenum sized_format = getSizedFormat(format, type);
+	for (int i = 0; i < num_textures; ++i)
+	{
+		this->color_textures[i] = new Texture(width, height, format, type, false, NULL, sized_format);
+		this->buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	if (use_depth_texture)
+		this->depth_texture = new Texture(width, height, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, false, NULL, GL_DEPTH_COMPONENT24);
+
+	glGenFramebuffers(1, &this->fbo_id);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo_id);
+	if (this->samples)
+	{
+		for (int i = 0; i < num_textures; ++i)
+		{
+			glGenRenderbuffers(1, &this->renderbuffer_color[i]);
+			glBindRenderbuffer(GL_RENDERBUFFER, this->renderbuffer_color[i]);
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->samples, sized_format, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_RENDERBUFFER, this->renderbuffer_color[i]);
+		}
+		glGenRenderbuffers(1, &this->renderbuffer_depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->renderbuffer_depth);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->samples, GL_DEPTH_COMPONENT24, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->renderbuffer_depth);
+	}
+	else
+	{
+		for (int i = 0; i < num_textures; ++i)
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, this->color_textures[i]->texture_id, 0);
+		if (this->depth_texture)
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depth_texture->texture_id, 0);
+		else
+		{
+			glGenRenderbuffers(1, &this->renderbuffer_depth);
+			glBindRenderbuffer(GL_RENDERBUFFER, this->renderbuffer_depth);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->renderbuffer_depth);
+		}
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	if (num_textures)
+		glDrawBuffers(num_textures, this->buffers);
+	else
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status == GL_FRAMEBUFFER_COMPLETE && this->samples)
+	{
+		//the textures get their own framebuffer to be the target of the blits
+		glGenFramebuffers(1, &this->resolve_id);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->resolve_id);
+		for (int i = 0; i < num_textures; ++i)
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, this->color_textures[i]->texture_id, 0);
+		if (this->depth_texture)
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depth_texture->texture_id, 0);
+		if (num_textures)
+			glDrawBuffers(num_textures, this->buffers);
+		status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "[ERROR] FBO not complete: " << std::hex << status << std::dec << std::endl;
+		release();
+		return false;
+	}
+	return true;
+}
+
+void FBO::bind()
+{
+	assert(this->fbo_id && "FBO not created");
+	glGetIntegerv(GL_VIEWPORT, this->previous_viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->fbo_id);
+	glViewport(0, 0, this->width, this->height);
+}
+
+void FBO::unbind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(this->previous_viewport[0], this->previous_viewport[1], this->previous_viewport[2], this->previous_viewport[3]);
+}
+
+void FBO::bindRead()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, this->resolve_id ? this->resolve_id : this->fbo_id);
+	glReadBuffer(this->num_color_textures ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+}
+
+void FBO::resolve()
+{
+	if (!this->resolve_id)
+		return;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, this->fbo_id);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->resolve_id);
+
+	//one attachment per blit, the blit writes to every draw buffer enabled
+	for (int i = 0; i < this->num_color_textures; ++i)
+	{
+		GLenum buffers[FBO_MAX_COLOR_TEXTURES] = { GL_NONE, GL_NONE, GL_NONE, GL_NONE };
+		buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+		glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+		glDrawBuffers(i + 1, buffers);
+		glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	if (this->depth_texture)
+		glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	if (this->num_color_textures)
+		glDrawBuffers(this->num_color_textures, this->buffers);
+	glReadBuffer(this->num_color_textures ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FBO::enableSingleBuffer(int num)
+{
+	assert(num < this->num_color_textures);
+	GLenum buffers[FBO_MAX_COLOR_TEXTURES] = { GL_NONE, GL_NONE, GL_NONE, GL_NONE };
+	buffers[num] = GL_COLOR_ATTACHMENT0 + num;
+	glDrawBuffers(num + 1, buffers);
+}
+
+void FBO::enableAllBuffers()
+{
+	glDrawBuffers(this->num_color_textures, this->buffers);
+}
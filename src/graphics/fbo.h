@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../framework/includes.h"
+
+#define FBO_MAX_COLOR_TEXTURES 4
+
+class Texture;
+
+//Offscreen render target with up to FBO_MAX_COLOR_TEXTURES color textures and a depth texture (or renderbuffer).
+//With samples > 1 it renders to multisampled renderbuffers and resolve() blits them to the textures.
+class FBO
+{
+public:
+	GLuint fbo_id;
+	GLuint resolve_id; //framebuffer with the textures when multisampled, 0 otherwise
+	Texture* color_textures[FBO_MAX_COLOR_TEXTURES];
+	Texture* depth_texture;
+	int num_color_textures;
+	GLenum buffers[FBO_MAX_COLOR_TEXTURES];
+	GLuint renderbuffer_color[FBO_MAX_COLOR_TEXTURES]; //multisampled only
+	GLuint renderbuffer_depth; //without depth texture or multisampled
+	int width;
+	int height;
+	int samples;
+
+	FBO();
+	~FBO();
+
+	//format and type of the color textures: GL_RGBA with GL_UNSIGNED_BYTE, GL_HALF_FLOAT or GL_FLOAT
+	bool create(int width, int height, int num_textures = 1, int format = GL_RGBA, int type = GL_UNSIGNED_BYTE, bool use_depth_texture = true, int samples = 0);
+	void release();
+
+	void bind(); //also sets the viewport to its size
+	void unbind(); //back to the default framebuffer and the previous viewport
+	void bindRead(); //GL_READ_FRAMEBUFFER with the textures (resolved if multisampled) for glReadPixels
+	void resolve(); //copies the samples to the textures, nothing to do if not multisampled
+
+	void enableSingleBuffer(int num);
+	void enableAllBuffers();
+
+private:
+	GLint previous_viewport[4];
+};
@@ -0,0 +1,307 @@
+#include "framecapture.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "imageops.h"
+
+#ifdef _WIN32
+	#define popen _popen
+	#define pclose _pclose
+	#define PIPE_WRITE_MODE "wb"
+#else
+	#include <csignal>
+	#define PIPE_WRITE_MODE "w"
+#endif
+
+unsigned int FrameCapture::max_queued_frames = 8;
+
+FrameCapture* FrameCapture::get()
+{
+	static FrameCapture* frame_capture = new FrameCapture();
+	return frame_capture;
+}
+
+FrameCapture::FrameCapture()
+{
+	this->mode = CAPTURE_NONE;
+	this->current = 0;
+	this->pipe = NULL;
+	this->pipe_width = this->pipe_height = 0;
+	this->encoding = false;
+	this->stopping = false;
+}
+
+FrameCapture::~FrameCapture()
+{
+	stop();
+
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->condition.notify_all();
+	if (this->encoder.joinable())
+		this->encoder.join();
+
+	for (int i = 0; i < FRAME_CAPTURE_BUFFERS; ++i)
+		if (this->readbacks[i].pbo)
+			glDeleteBuffers(1, &this->readbacks[i].pbo);
+	for (sFrameJob* job : this->free_jobs)
+		delete job;
+}
+
+bool FrameCapture::startTGASequence(const char* prefix)
+{
+	stop();
+	this->prefix = prefix;
+	this->num_captured = this->num_written = 0;
+	this->mode = CAPTURE_TGA_SEQUENCE;
+	std::cout << " + Recording frames to " << prefix << "*.tga" << std::endl;
+	return true;
+}
+
+bool FrameCapture::startPipe(const char* command)
+{
+	stop();
+#ifndef _WIN32
+	signal(SIGPIPE, SIG_IGN); //a process that exits makes the writes fail instead of killing us
+#endif
+	this->pipe = popen(command, PIPE_WRITE_MODE);
+	if (!this->pipe)
+	{
+		std::cout << "[ERROR] Cannot start the capture process: " << command << std::endl;
+		return false;
+	}
+	this->pipe_width = this->pipe_height = 0;
+	this->num_captured = this->num_written = 0;
+	this->mode = CAPTURE_PIPE;
+	std::cout << " + Recording frames to: " << command << std::endl;
+	return true;
+}
+
+void FrameCapture::stop()
+{
+	flush();
+
+	//the encoder owns the pipe until its queue is empty
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->condition.wait(lock, [this]() { return this->queue.empty() && !this->encoding; });
+	}
+
+	if (this->pipe)
+	{
+		pclose(this->pipe);
+		this->pipe = NULL;
+	}
+	if (this->mode != CAPTURE_NONE)
+		std::cout << " + Recording stopped, " << this->num_written << " frames written" << std::endl;
+	this->mode = CAPTURE_NONE;
+}
+
+void FrameCapture::screenshot(const char* filename)
+{
+	this->screenshots.push_back(filename);
+}
+
+void FrameCapture::captureFrame(int width, int height)
+{
+	//the frames in flight are copied out in order, as soon as the GPU is done with them
+	for (int i = 0; i < FRAME_CAPTURE_BUFFERS; ++i)
+		if (!collect(this->readbacks[(this->current + i) % FRAME_CAPTURE_BUFFERS], false))
+			break;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	for (const std::string& filename : this->screenshots)
+		readFrame(width, height, filename);
+	this->screenshots.clear();
+
+	if (this->mode == CAPTURE_TGA_SEQUENCE)
+	{
+		char number[16];
+		snprintf(number, sizeof(number), "%05u.tga", this->num_captured);
+		readFrame(width, height, this->prefix + number);
+		this->num_captured++;
+	}
+	else if (this->mode == CAPTURE_PIPE)
+	{
+		//the process was told the size when it started
+		if (!this->pipe_width)
+		{
+			this->pipe_width = width;
+			this->pipe_height = height;
+		}
+		if (width != this->pipe_width || height != this->pipe_height)
+		{
+			std::cout << "[WARN] Framebuffer resized while piping frames, recording stopped" << std::endl;
+			stop();
+			return;
+		}
+		readFrame(width, height, "");
+		this->num_captured++;
+	}
+}
+
+void FrameCapture::readFrame(int width, int height, const std::string& filename)
+{
+	//the oldest readback is reused, normally finished frames ago
+	sReadback& readback = this->readbacks[this->current];
+	collect(readback, true);
+
+	unsigned int size = (unsigned int)width * height * 4;
+	if (!readback.pbo)
+		glGenBuffers(1, &readback.pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	if (readback.size != size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		readback.size = size;
+	}
+
+	//BGRA is the order of the TGA files, the pipe gets RGBA
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, filename.empty() ? GL_RGBA : GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.width = width;
+	readback.height = height;
+	readback.filename = filename;
+	this->current = (this->current + 1) % FRAME_CAPTURE_BUFFERS;
+}
+
+bool FrameCapture::collect(sReadback& readback, bool wait)
+{
+	if (!readback.fence)
+		return true;
+
+	GLenum result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		if (!wait)
+			return false;
+		this->num_waits++;
+		do {
+			result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); //1ms
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(readback.fence);
+	readback.fence = NULL;
+
+	//a slow encoder holds the frame rate instead of growing the queue without limit
+	sFrameJob* job = NULL;
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->condition.wait(lock, [this]() { return this->queue.size() < max_queued_frames; });
+		if (this->free_jobs.size())
+		{
+			job = this->free_jobs.back();
+			this->free_jobs.pop_back();
+		}
+		if (!this->encoder.joinable())
+			this->encoder = std::thread(&FrameCapture::encoderLoop, this);
+	}
+	if (!job)
+		job = new sFrameJob();
+
+	unsigned int size = (unsigned int)readback.width * readback.height * 4;
+	job->pixels.resize(size);
+	job->width = readback.width;
+	job->height = readback.height;
+	job->filename = readback.filename;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (mapped)
+	{
+		memcpy(&job->pixels[0], mapped, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	if (!mapped)
+	{
+		std::cout << "[ERROR] Cannot map the capture buffer" << std::endl;
+		this->free_jobs.push_back(job);
+		return true;
+	}
+	this->queue.push_back(job);
+	this->condition.notify_all();
+	return true;
+}
+
+void FrameCapture::flush()
+{
+	for (int i = 0; i < FRAME_CAPTURE_BUFFERS; ++i)
+		collect(this->readbacks[(this->current + i) % FRAME_CAPTURE_BUFFERS], true);
+}
+
+void FrameCapture::encoderLoop()
+{
+	while (true)
+	{
+		sFrameJob* job = NULL;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->condition.wait(lock, [this]() { return this->stopping || !this->queue.empty(); });
+			if (this->queue.empty())
+				return;
+			job = this->queue.front();
+			this->queue.pop_front();
+			this->encoding = true;
+		}
+		this->condition.notify_all(); //room in the queue
+
+		writeFrame(job);
+
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->free_jobs.push_back(job);
+			this->encoding = false;
+		}
+		this->condition.notify_all();
+	}
+}
+
+void FrameCapture::writeFrame(sFrameJob* job)
+{
+	//the alpha of the framebuffer is not meant to be seen
+	uint32_t* texels = (uint32_t*)&job->pixels[0];
+	size_t num_texels = (size_t)job->width * job->height;
+	for (size_t i = 0; i < num_texels; ++i)
+		texels[i] |= 0xFF000000;
+
+	if (job->filename.empty())
+	{
+		//raw video is stored from the top row
+		flipRows(&job->pixels[0], job->width, job->height, 4);
+		if (this->pipe && fwrite(&job->pixels[0], 1, job->pixels.size(), this->pipe) == job->pixels.size())
+			this->num_written++;
+		else
+			std::cout << "[ERROR] Cannot write to the capture process" << std::endl;
+		return;
+	}
+
+	//uncompressed true color, bottom left origin like glReadPixels, 8 bits of alpha
+	uint8_t header[18] = {};
+	header[2] = 2;
+	header[12] = (uint8_t)(job->width & 0xFF);
+	header[13] = (uint8_t)(job->width >> 8);
+	header[14] = (uint8_t)(job->height & 0xFF);
+	header[15] = (uint8_t)(job->height >> 8);
+	header[16] = 32;
+	header[17] = 8;
+
+	FILE* file = fopen(job->filename.c_str(), "wb");
+	if (!file || fwrite(header, 1, sizeof(header), file) != sizeof(header) || fwrite(&job->pixels[0], 1, job->pixels.size(), file) != job->pixels.size())
+		std::cout << "[ERROR] Cannot write frame: " << job->filename << std::endl;
+	else
+		this->num_written++;
+	if (file)
+		fclose(file);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../framework/includes.h"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+
+#define FRAME_CAPTURE_BUFFERS 3 //readbacks in flight, a frame is copied out up to this many frames after it was read
+
+enum eCaptureMode { CAPTURE_NONE, CAPTURE_TGA_SEQUENCE, CAPTURE_PIPE };
+
+//Records the framebuffer without stalling: glReadPixels goes to a ring of pixel pack buffers,
+//their fences are polled on the next frames and the pixels are handed to an encoder thread
+//that writes TGA files or raw RGBA frames (top row first) to the stdin of an external process.
+class FrameCapture
+{
+public:
+	static FrameCapture* get(); //global capture, the GL objects are created on the first frame captured
+	static unsigned int max_queued_frames; //frames waiting for the encoder before captureFrame blocks
+
+	eCaptureMode mode;
+
+	//stats
+	unsigned int num_captured = 0;
+	std::atomic<unsigned int> num_written{ 0 }; //by the encoder thread
+	unsigned int num_waits = 0; //times a readback was not finished when its buffer was needed
+
+	FrameCapture();
+	~FrameCapture();
+
+	bool isRecording() const { return mode != CAPTURE_NONE; }
+	bool startTGASequence(const char* prefix); //prefix + 00000.tga, 00001.tga...
+	bool startPipe(const char* command); //e.g. ffmpeg -f rawvideo -pixel_format rgba -video_size 1280x720 -i - out.mp4
+	void stop(); //finishes the frames in flight and waits until everything is written
+	void screenshot(const char* filename); //one TGA of the next frame captured, also when not recording
+
+	void captureFrame(int width, int height); //after rendering, reads the bottom left width x height of the framebuffer
+
+private:
+	struct sReadback
+	{
+		GLuint pbo = 0;
+		GLsync fence = NULL;
+		unsigned int size = 0; //of the buffer
+		int width = 0;
+		int height = 0;
+		std::string filename; //empty for the frames of the pipe
+	};
+
+	struct sFrameJob
+	{
+		std::vector<uint8_t> pixels;
+		int width;
+		int height;
+		std::string filename;
+	};
+
+	sReadback readbacks[FRAME_CAPTURE_BUFFERS];
+	unsigned int current; //next readback to use, also the oldest in flight
+	std::string prefix;
+	std::vector<std::string> screenshots;
+	int pipe_width, pipe_height;
+	FILE* pipe;
+
+	std::thread encoder;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<sFrameJob*> queue;
+	std::vector<sFrameJob*> free_jobs;
+	bool encoding; //the encoder is writing a job already out of the queue
+	bool stopping;
+
+	void readFrame(int width, int height, const std::string& filename);
+	bool collect(sReadback& readback, bool wait); //false if not finished and wait is false
+	void flush(); //collects every readback in flight, oldest first
+	void encoderLoop();
+	void writeFrame(sFrameJob* job);
+};
@@ -0,0 +1,183 @@
+#include "imageops.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define IMAGEOPS_SSE2
+	#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+	#define IMAGEOPS_SSSE3
+	#include <tmmintrin.h>
+#endif
+
+void flipRows(uint8_t* data, int width, int height, int bytes_per_pixel)
+{
+	size_t row_size = (size_t)width * bytes_per_pixel;
+	for (int y = 0; y < height / 2; ++y)
+	{
+		uint8_t* top = data + y * row_size;
+		uint8_t* bottom = data + (height - y - 1) * row_size;
+		size_t i = 0;
+#ifdef IMAGEOPS_SSE2
+		for (; i + 16 <= row_size; i += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+			_mm_storeu_si128((__m128i*)(top + i), b);
+			_mm_storeu_si128((__m128i*)(bottom + i), a);
+		}
+#endif
+		for (; i < row_size; ++i)
+			std::swap(top[i], bottom[i]);
+	}
+}
+
+void swizzleRB(uint8_t* data, size_t num_pixels, int bytes_per_pixel)
+{
+	size_t size = num_pixels * bytes_per_pixel;
+	size_t i = 0;
+#ifdef IMAGEOPS_SSE2
+	if (bytes_per_pixel == 4)
+	{
+		//per 32 bits: keep G and A, move R up and B down
+		const __m128i mask_ga = _mm_set1_epi32((int)0xFF00FF00);
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(data + i));
+			__m128i rb = _mm_andnot_si128(mask_ga, pixels);
+			__m128i swapped = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+			_mm_storeu_si128((__m128i*)(data + i), _mm_or_si128(_mm_and_si128(pixels, mask_ga), swapped));
+		}
+	}
+#endif
+#ifdef IMAGEOPS_SSSE3
+	if (bytes_per_pixel == 3)
+	{
+		//5 pixels per load, the 16th byte is stored back as it was
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		for (; i + 16 <= size; i += 15)
+			_mm_storeu_si128((__m128i*)(data + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i)), shuffle));
+	}
+#endif
+	for (; i < size; i += bytes_per_pixel)
+		std::swap(data[i], data[i + 2]);
+}
+
+void expandRGBToRGBA(const uint8_t* src, uint8_t* dst, size_t num_pixels, uint8_t alpha)
+{
+	size_t i = 0;
+#ifdef IMAGEOPS_SSSE3
+	//4 pixels per step, the load reads 4 bytes of the next ones
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha_mask = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+	for (; i * 3 + 16 <= num_pixels * 3; i += 4)
+	{
+		__m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 3)), shuffle);
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(pixels, alpha_mask));
+	}
+#endif
+	for (; i < num_pixels; ++i)
+	{
+		dst[i * 4] = src[i * 3];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 2];
+		dst[i * 4 + 3] = alpha;
+	}
+}
+
+static inline int wrapCoord(int value, int size, bool repeat)
+{
+	if (!repeat)
+		return std::clamp(value, 0, size - 1);
+	value %= size;
+	return value < 0 ? value + size : value;
+}
+
+void sampleBilinear(const uint8_t* data, int width, int height, int bytes_per_pixel, const glm::vec2* uvs, glm::vec4* out, size_t count, bool repeat)
+{
+	size_t row_size = (size_t)width * bytes_per_pixel;
+	for (size_t i = 0; i < count; ++i)
+	{
+		float x = uvs[i].x * width - 0.5f;
+		float y = uvs[i].y * height - 0.5f;
+		float fx = floorf(x);
+		float fy = floorf(y);
+		float tx = x - fx;
+		float ty = y - fy;
+		int x0 = wrapCoord((int)fx, width, repeat);
+		int x1 = wrapCoord((int)fx + 1, width, repeat);
+		const uint8_t* row0 = data + wrapCoord((int)fy, height, repeat) * row_size;
+		const uint8_t* row1 = data + wrapCoord((int)fy + 1, height, repeat) * row_size;
+		const uint8_t* texels[4] = { row0 + x0 * bytes_per_pixel, row0 + x1 * bytes_per_pixel, row1 + x0 * bytes_per_pixel, row1 + x1 * bytes_per_pixel };
+
+#ifdef IMAGEOPS_SSE2
+		//the 4 channels of a texel in one register
+		__m128 t[4];
+		const __m128i zero = _mm_setzero_si128();
+		for (int j = 0; j < 4; ++j)
+		{
+			uint32_t value = 0xFF000000;
+			memcpy(&value, texels[j], bytes_per_pixel);
+			__m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)value), zero), zero);
+			t[j] = _mm_cvtepi32_ps(wide);
+		}
+		__m128 wx = _mm_set1_ps(tx);
+		__m128 top = _mm_add_ps(t[0], _mm_mul_ps(_mm_sub_ps(t[1], t[0]), wx));
+		__m128 bottom = _mm_add_ps(t[2], _mm_mul_ps(_mm_sub_ps(t[3], t[2]), wx));
+		_mm_storeu_ps(&out[i].x, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(ty))));
+#else
+		glm::vec4 t[4];
+		for (int j = 0; j < 4; ++j)
+			t[j] = glm::vec4(texels[j][0], texels[j][1], texels[j][2], bytes_per_pixel == 4 ? texels[j][3] : 255);
+		glm::vec4 top = t[0] + (t[1] - t[0]) * tx;
+		glm::vec4 bottom = t[2] + (t[3] - t[2]) * tx;
+		out[i] = top + (bottom - top) * ty;
+#endif
+	}
+}
+
+void downsampleBox(const uint8_t* src, int width, int height, int bytes_per_pixel, uint8_t* dst)
+{
+	int dst_width = std::max(width / 2, 1);
+	int dst_height = std::max(height / 2, 1);
+	int bpp = bytes_per_pixel;
+
+	//a side of 1 repeats the texel instead of reading out of the row
+	size_t dx = width > 1 ? bpp : 0;
+	size_t dy = height > 1 ? (size_t)width * bpp : 0;
+
+	for (int y = 0; y < dst_height; ++y)
+	{
+		const uint8_t* row = src + (size_t)(y * 2) * width * bpp;
+		uint8_t* out = dst + (size_t)y * dst_width * bpp;
+		int x = 0;
+#ifdef IMAGEOPS_SSE2
+		if (bpp == 4 && dx && dy)
+		{
+			//4 texels of each row give 2, the sums in 16 bits
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i rounding = _mm_set1_epi16(2);
+			for (; x + 2 <= dst_width; x += 2)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(row + x * 8));
+				__m128i b = _mm_loadu_si128((const __m128i*)(row + dy + x * 8));
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				__m128i mean = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+				_mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(mean, mean));
+			}
+		}
+#endif
+		for (; x < dst_width; ++x)
+		{
+			const uint8_t* p = row + (size_t)x * 2 * bpp;
+			for (int c = 0; c < bpp; ++c)
+				out[x * bpp + c] = (uint8_t)((p[c] + p[c + dx] + p[c + dy] + p[c + dx + dy] + 2) / 4);
+		}
+	}
+}
@@ -0,0 +1,28 @@
+/*
+	Pixel kernels for the CPU side of the images: row flip, channel swizzle, RGB to RGBA expansion,
+	batch bilinear sampling and the box filter used to build the mipmaps.
+	SSE2 is used when available (SSSE3 for the 3 bytes per pixel shuffles), the rest is scalar.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+//swaps the rows in place, without a temporary row
+void flipRows(uint8_t* data, int width, int height, int bytes_per_pixel);
+
+//swaps the first and third channel (BGR <-> RGB), bytes_per_pixel 3 or 4
+void swizzleRB(uint8_t* data, size_t num_pixels, int bytes_per_pixel);
+
+//dst has num_pixels * 4 bytes and can not overlap src
+void expandRGBToRGBA(const uint8_t* src, uint8_t* dst, size_t num_pixels, uint8_t alpha = 255);
+
+//uvs in 0..1 (texel centers at 0.5 / size), out in 0..255 with alpha 255 if there is none
+void sampleBilinear(const uint8_t* data, int width, int height, int bytes_per_pixel, const glm::vec2* uvs, glm::vec4* out, size_t count, bool repeat = false);
+
+//half size (a side of 1 stays 1) with every texel the rounded mean of 2x2, dst has the size of the level
+void downsampleBox(const uint8_t* src, int width, int height, int bytes_per_pixel, uint8_t* dst);
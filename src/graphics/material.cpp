@@ -1,16 +1,90 @@
 #include "material.h"
 
 #include "application.h"
+#include "staticbatch.h"
+#include "streambuffer.h"
 
 #include <istream>
 #include <fstream>
 #include <algorithm>
+#include <cassert>
+
+//resolved once, they are set on every draw
+static const UniformHandle u_viewprojection = Shader::GetUniform("u_viewprojection");
+static const UniformHandle u_camera_position = Shader::GetUniform("u_camera_position");
+static const UniformHandle u_model = Shader::GetUniform("u_model");
+static const UniformHandle u_color = Shader::GetUniform("u_color");
+static const UniformHandle u_texture = Shader::GetUniform("u_texture");
+static const UniformHandle u_ambient_light = Shader::GetUniform("u_ambient_light");
+static const UniformHandle u_first_pass = Shader::GetUniform("u_first_pass");
+static const UniformHandle u_light_intensity = Shader::GetUniform("u_light_intensity");
+static const UniformHandle u_light_shininess = Shader::GetUniform("u_light_shininess");
+static const UniformHandle u_light_color = Shader::GetUniform("u_light_color");
+
+unsigned int Material::last_id = 0;
+
+Material::Material()
+{
+	this->id = last_id++;
+}
+
+Material::~Material()
+{
+	if (this->shader)
+		this->shader->removeRef();
+	if (this->texture)
+		this->texture->removeRef();
+}
+
+void Material::removeRef()
+{
+	assert(this->num_refs > 0);
+	if (--this->num_refs == 0)
+		delete this;
+}
+
+void Material::render(Mesh* mesh, glm::mat4 model, Camera* camera)
+{
+	if (!mesh || !this->shader)
+		return;
+
+	this->shader->enable();
+	bind();
+	draw(mesh, model, camera);
+	this->shader->disable();
+}
 
+void Material::drawBatch(StaticBatch* batch, const sBatchGroup& group)
+{
+	batch->drawGroup(group);
+}
+
+void Material::setCommonUniforms(Camera* camera, const glm::mat4& model)
+{
+	if (!this->shader->hasUniformBlock(UNIFORM_BLOCK_FRAME))
+	{
+		this->shader->setUniform(u_viewprojection, camera->viewprojection_matrix);
+		this->shader->setUniform(u_camera_position, camera->eye);
+	}
+
+	if (this->shader->hasUniformBlock(UNIFORM_BLOCK_OBJECT))
+	{
+		sObjectBlock object;
+		object.model = model;
+		object.color = this->color;
+		StreamBuffer::get()->pushUniformBlock(&object, sizeof(object), UNIFORM_BLOCK_OBJECT);
+	}
+	else
+	{
+		this->shader->setUniform(u_model, model);
+		this->shader->setUniform(u_color, this->color);
+	}
+}
 
 FlatMaterial::FlatMaterial(glm::vec4 color)
 {
 	this->color = color;
-	this->shader = Shader::Get("res/shaders/basic.vs", "res/shaders/flat.fs");
+	this->shader = Shader::GetAsync("res/shaders/basic.vs", "res/shaders/flat.fs");
 }
 
 FlatMaterial::~FlatMaterial() { }
@@ -18,27 +92,16 @@ FlatMaterial::~FlatMaterial() { }
 void FlatMaterial::setUniforms(Camera* camera, glm::mat4 model)
 {
 	//upload node uniforms
-	this->shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
-	this->shader->setUniform("u_camera_position", camera->eye);
-	this->shader->setUniform("u_model", model);
-
-	this->shader->setUniform("u_color", this->color);
+	setCommonUniforms(camera, model);
 }
 
-void FlatMaterial::render(Mesh* mesh, glm::mat4 model, Camera* camera)
+void FlatMaterial::draw(Mesh* mesh, const glm::mat4& model, Camera* camera)
 {
-	if (mesh && this->shader) {
-		// enable shader
-		this->shader->enable();
+	// upload uniforms
+	setUniforms(camera, model);
 
-		// upload uniforms
-		setUniforms(camera, model);
-
-		// do the draw call
-		mesh->render(GL_TRIANGLES);
-
-		this->shader->disable();
-	}
+	// do the draw call
+	mesh->render(GL_TRIANGLES);
 }
 
 void FlatMaterial::renderInMenu()
@@ -48,37 +111,33 @@ void FlatMaterial::renderInMenu()
 
 WireframeMaterial::WireframeMaterial()
 {
+	//the shader is already taken by FlatMaterial
 	this->color = glm::vec4(1.f);
-	this->shader = Shader::Get("res/shaders/basic.vs", "res/shaders/flat.fs");
 }
 
 WireframeMaterial::~WireframeMaterial() { }
 
-void WireframeMaterial::render(Mesh* mesh, glm::mat4 model, Camera* camera)
+WireframeMaterial* WireframeMaterial::GetShared()
 {
-	if (this->shader && mesh)
-	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glDisable(GL_CULL_FACE);
-
-		//enable shader
-		this->shader->enable();
+	static WireframeMaterial* material = new WireframeMaterial();
+	return material;
+}
 
-		//upload material specific uniforms
-		setUniforms(camera, model);
+void WireframeMaterial::draw(Mesh* mesh, const glm::mat4& model, Camera* camera)
+{
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	glDisable(GL_CULL_FACE);
 
-		//do the draw call
-		mesh->render(GL_TRIANGLES);
+	FlatMaterial::draw(mesh, model, camera);
 
-		glEnable(GL_CULL_FACE);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	}
+	glEnable(GL_CULL_FACE);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
-StandardMaterial::StandardMaterial(glm::vec4 color)
+StandardMaterial::StandardMaterial(glm::vec4 color, bool clustered)
 {
 	this->color = color;
-	this->shader = Shader::Get("res/shaders/basic.vs", "res/shaders/normal.fs");
+	this->shader = Shader::GetAsync("res/shaders/basic.vs", "res/shaders/normal.fs", clustered ? "#define USE_LIGHT_CLUSTERS" : NULL);
 }
 
 StandardMaterial::~StandardMaterial() { }
@@ -86,60 +145,80 @@ StandardMaterial::~StandardMaterial() { }
 void StandardMaterial::setUniforms(Camera* camera, glm::mat4 model)
 {
 	//upload node uniforms
-	this->shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
-	this->shader->setUniform("u_camera_position", camera->eye);
-	this->shader->setUniform("u_model", model);
+	setCommonUniforms(camera, model);
+}
 
-	this->shader->setUniform("u_color", this->color);
+void StandardMaterial::bind()
+{
+	if (this->texture && this->texture->isLoaded())
+		this->shader->setUniform(u_texture, this->texture, 0);
+}
 
-	if (this->texture)
-		this->shader->setUniform("u_texture", this->texture);
+void StandardMaterial::draw(Mesh* mesh, const glm::mat4& model, Camera* camera)
+{
+	// upload uniforms, they are the same for all the passes
+	setUniforms(camera, model);
+
+	renderPasses(model, [mesh]() { mesh->render(GL_TRIANGLES); });
 }
 
-void StandardMaterial::render(Mesh* mesh, glm::mat4 model, Camera* camera)
+void StandardMaterial::drawBatch(StaticBatch* batch, const sBatchGroup& group)
 {
-	bool first_pass = true;
-	if (mesh && this->shader)
+	// the batched vertices are transformed in the shader, the lights see them in world space
+	renderPasses(glm::mat4(1.f), [batch, &group]() { batch->drawGroup(group); });
+}
+
+void StandardMaterial::renderPasses(const glm::mat4& model, const std::function<void()>& draw_call)
+{
+	// the shader loops over the lights of its cluster, or over all the lights of the LightsBlock
+	if (this->shader->hasUniformBlock(UNIFORM_BLOCK_CLUSTERS) || this->shader->hasUniformBlock(UNIFORM_BLOCK_LIGHTS))
 	{
-		// enable shader
-		this->shader->enable();
-
-		// Multi pass render
-		int num_lights = Application::instance->light_list.size();
-		int i = 0;
-		do {
-			// upload uniforms
-			setUniforms(camera, model);
-
-			// upload light uniforms
-			if (!first_pass) {
-				glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-				glDepthFunc(GL_LEQUAL);
-			}
-			this->shader->setUniform("u_ambient_light", Application::instance->ambient_light * (float)first_pass);
-
-			if (i < num_lights)
-			{
-				Light* light = Application::instance->light_list[i];
-				light->setUniforms(this->shader, model);
-			}
-			// Set some uniforms in case there is no light
-			else {
-				this->shader->setUniform("u_light_intensity", 1.f);
-				this->shader->setUniform("u_light_shininess", 1.f);
-				this->shader->setUniform("u_light_color", glm::vec4(0.f));
-			}
-
-			// do the draw call
-			mesh->render(GL_TRIANGLES);
-
-			first_pass = false;
-
-		} while (i < num_lights);
-
-		// disable shader
-		this->shader->disable();
+		draw_call();
+		return;
 	}
+
+	bool first_pass = true;
+
+	// Multi pass render
+	int num_lights = Application::instance->light_list.size();
+	bool light_block = this->shader->hasUniformBlock(UNIFORM_BLOCK_LIGHT);
+	int i = 0;
+	do {
+		// upload light uniforms
+		if (!first_pass) {
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+			glDepthFunc(GL_LEQUAL);
+		}
+
+		// the ambient light is only added in the first pass
+		if (this->shader->hasUniformBlock(UNIFORM_BLOCK_FRAME))
+			this->shader->setUniform(u_first_pass, first_pass);
+		else
+			this->shader->setUniform(u_ambient_light, Application::instance->ambient_light * (float)first_pass);
+
+		if (i < num_lights)
+		{
+			Light* light = Application::instance->light_list[i];
+			if (light_block)
+				Application::instance->bindLightBlock(i);
+			light->setUniforms(this->shader, model);
+		}
+		// Set some uniforms in case there is no light
+		else if (light_block)
+			Application::instance->bindLightBlock(-1);
+		else {
+			this->shader->setUniform(u_light_intensity, 1.f);
+			this->shader->setUniform(u_light_shininess, 1.f);
+			this->shader->setUniform(u_light_color, glm::vec4(0.f));
+		}
+
+		// do the draw call
+		draw_call();
+
+		first_pass = false;
+		i++;
+
+	} while (i < num_lights);
 }
 
 void StandardMaterial::renderInMenu()
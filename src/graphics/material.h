@@ -9,16 +9,40 @@
 #include "texture.h"
 #include "shader.h"
 
+#include <functional>
+
+class StaticBatch;
+struct sBatchGroup;
+
 class Material {
 public:
 
+	unsigned int id; //unique, used to sort the draws
 	Shader* shader = NULL;
 	Texture* texture = NULL;
 	glm::vec4 color;
 
+	Material();
+	virtual ~Material(); //drops the references to its shader and texture
+
+	//the nodes that use it, SceneNode::setMaterial takes one
+	void addRef() { num_refs++; }
+	void removeRef(); //deleted when the last one is dropped
+
+	//camera and node uniforms, uses the frame and object blocks when the shader has them
+	//(the frame block holds the camera passed to Application::uploadFrameUniforms)
+	void setCommonUniforms(Camera* camera, const glm::mat4& model);
+
 	virtual void setUniforms(Camera* camera, glm::mat4 model) = 0;
-	virtual void render(Mesh* mesh, glm::mat4 model, Camera* camera) = 0;
+	virtual void bind() {} //state shared by all its draws, the shader must be enabled
+	virtual void draw(Mesh* mesh, const glm::mat4& model, Camera* camera) = 0; //the shader must be enabled and the material bound
+	virtual void render(Mesh* mesh, glm::mat4 model, Camera* camera); //enables the shader, binds and draws
+	virtual void drawBatch(StaticBatch* batch, const sBatchGroup& group); //draws of a static batch, the model comes from the object buffer
 	virtual void renderInMenu() = 0;
+
+private:
+	static unsigned int last_id;
+	unsigned int num_refs = 0;
 };
 
 class FlatMaterial : public Material {
@@ -28,7 +52,7 @@ public:
 	~FlatMaterial();
 
 	void setUniforms(Camera* camera, glm::mat4 model);
-	void render(Mesh* mesh, glm::mat4 model, Camera* camera);
+	void draw(Mesh* mesh, const glm::mat4& model, Camera* camera);
 	void renderInMenu();
 };
 
@@ -38,7 +62,9 @@ public:
 	WireframeMaterial();
 	~WireframeMaterial();
 
-	void render(Mesh* mesh, glm::mat4 model, Camera* camera);
+	static WireframeMaterial* GetShared(); //one instance for every queued wireframe draw, the queue keeps pointers until it renders
+
+	void draw(Mesh* mesh, const glm::mat4& model, Camera* camera);
 };
 
 class StandardMaterial : public Material {
@@ -46,10 +72,15 @@ public:
 
 	bool first_pass = false;
 
-	StandardMaterial(glm::vec4 color = glm::vec4(1.f));
+	StandardMaterial(glm::vec4 color = glm::vec4(1.f), bool clustered = true); //without clusters the shader loops over all the lights, up to MAX_LIGHTS
 	~StandardMaterial();
 
 	void setUniforms(Camera* camera, glm::mat4 model);
-	void render(Mesh* mesh, glm::mat4 model, Camera* camera);
+	void bind();
+	void draw(Mesh* mesh, const glm::mat4& model, Camera* camera);
+	void drawBatch(StaticBatch* batch, const sBatchGroup& group);
 	void renderInMenu();
+
+private:
+	void renderPasses(const glm::mat4& model, const std::function<void()>& draw_call); //one pass per light, or a single one if the shader has the ClusterBlock or the LightsBlock
 };
\ No newline at end of file
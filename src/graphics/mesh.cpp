@@ -3,21 +3,33 @@
 #include <cassert>
 #include <iostream>
 #include <limits>
+#include <cstdint>
 #include <sys/stat.h>
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <thread>
 
 #include "shader.h"
 #include "texture.h"
+#include "meshcodec.h"
+#include "streambuffer.h"
 #include "../framework/includes.h"
 #include "../framework/utils.h"
 #include "../framework/camera.h"
+#include "../framework/threadpool.h"
+#include "../framework/bvh.h"
 
 bool Mesh::use_binary = true;			//checks if there is .wbin, it there is one tries to read it instead of the other file
 bool Mesh::auto_upload_to_vram = true;	//uploads the mesh to the GPU VRAM to speed up rendering
 bool Mesh::interleave_meshes = true;	//places the geometry in an interleaved array
+bool Mesh::compress_binary = false;		//quantizes and compresses the streams when writing .mbin files
+bool Mesh::build_bvh = true;			//builds the triangle BVH of the loaded meshes, picking uses their box otherwise
 
-std::map<std::string, Mesh*> Mesh::sMeshesLoaded;
 long Mesh::num_meshes_rendered = 0;
 long Mesh::num_triangles_rendered = 0;
+float Mesh::async_upload_budget = 2.0f;
+unsigned int Mesh::num_async_loads = 0;
 
 #define FORMAT_ASE 1
 #define FORMAT_OBJ 2
@@ -44,20 +56,22 @@ BoundingBox transformBoundingBox(const glm::mat4 m, const BoundingBox& box)
 		if (corner.z < box_min.z) box_min.z = corner.z;
 
 		//box_max.setMax(corner);
-		if (corner.x > box_min.x) box_min.x = corner.x;
-		if (corner.y > box_min.y) box_min.y = corner.y;
-		if (corner.z > box_min.z) box_min.z = corner.z;
+		if (corner.x > box_max.x) box_max.x = corner.x;
+		if (corner.y > box_max.y) box_max.y = corner.y;
+		if (corner.z > box_max.z) box_max.z = corner.z;
 	}
 
 	glm::vec3 halfsize = (box_max - box_min) * 0.5f;
 	return BoundingBox(box_max - halfsize, halfsize);
 }
 
-Mesh::Mesh()
+Mesh::Mesh() : Resource(RESOURCE_MESH)
 {
 	radius = 0;
 	vertices_vbo_id = uvs_vbo_id = uvs1_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = bones_vbo_id = weights_vbo_id = 0;
+	vao_id = 0;
 	collision_model = NULL;
+	bvh = NULL;
 	clear();
 }
 
@@ -68,7 +82,10 @@ Mesh::~Mesh()
 
 void Mesh::clear()
 {
-	//Free VBOs
+	//Free VAO and VBOs
+	if (vao_id)
+		glDeleteVertexArrays(1, &vao_id);
+	vao_id = 0;
 	if (vertices_vbo_id)
 		glDeleteBuffersARB(1, &vertices_vbo_id);
 	if (uvs_vbo_id)
@@ -101,8 +118,53 @@ void Mesh::clear()
 	bones.clear();
 	weights.clear();
 	uvs1.clear();
+
+	delete bvh;
+	bvh = NULL;
+}
+
+size_t Mesh::getCPUSize()
+{
+	if (state != MESH_READY)
+		return 0;
+	return vertices.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) + uvs.capacity() * sizeof(glm::vec2) +
+		uvs1.capacity() * sizeof(glm::vec2) + colors.capacity() * sizeof(glm::vec4) + interleaved.capacity() * sizeof(tInterleaved) +
+		indices.capacity() * sizeof(glm::vec3) + bones.capacity() * sizeof(glm::vec4) + weights.capacity() * sizeof(glm::vec4) +
+		(bvh ? bvh->triangles.capacity() * sizeof(glm::vec3) + bvh->bvh.nodes.capacity() * sizeof(sBVHNode) : 0);
 }
 
+//done while loading so a pick never pays for it
+void Mesh::buildBVH()
+{
+	delete bvh;
+	bvh = new MeshBVH();
+	if (!bvh->build(this))
+	{
+		delete bvh;
+		bvh = NULL;
+	}
+}
+
+//the buffers uploaded have the same size as the streams kept in RAM
+size_t Mesh::getVRAMSize()
+{
+	size_t size = 0;
+	if (interleaved_vbo_id) size += interleaved.size() * sizeof(tInterleaved);
+	if (vertices_vbo_id) size += vertices.size() * sizeof(glm::vec3);
+	if (normals_vbo_id) size += normals.size() * sizeof(glm::vec3);
+	if (uvs_vbo_id) size += uvs.size() * sizeof(glm::vec2);
+	if (uvs1_vbo_id) size += uvs1.size() * sizeof(glm::vec2);
+	if (colors_vbo_id) size += colors.size() * sizeof(glm::vec4);
+	if (indices_vbo_id) size += indices.size() * sizeof(glm::vec3);
+	if (bones_vbo_id) size += bones.size() * sizeof(glm::vec4);
+	if (weights_vbo_id) size += weights.size() * sizeof(glm::vec4);
+	return size;
+}
+
+static const UniformHandle u_Ka = Shader::GetUniform("u_Ka");
+static const UniformHandle u_Kd = Shader::GetUniform("u_Kd");
+static const UniformHandle u_Ks = Shader::GetUniform("u_Ks");
+
 int vertex_location = -1;
 int normal_location = -1;
 int uv_location = -1;
@@ -110,9 +172,27 @@ int color_location = -1;
 int bones_location = -1;
 int weights_location = -1;
 int uv1_location = -1;
+bool vao_in_use = false;
+
+bool Mesh::bindVAO(Shader* sh)
+{
+	//client side arrays cannot be stored in a VAO
+	if (!sh->fixed_attributes || (!vertices_vbo_id && !interleaved_vbo_id))
+		return false;
+
+	if (!vao_id)
+		createVAO();
+	glBindVertexArray(vao_id);
+	return true;
+}
 
 void Mesh::enableBuffers(Shader* sh)
 {
+	//all the attribute setup is already stored in the VAO
+	vao_in_use = bindVAO(sh);
+	if (vao_in_use)
+		return;
+
 	vertex_location = sh->getAttribLocation("a_vertex");
 	assert(vertex_location != -1 && "No a_vertex found in shader");
 
@@ -245,6 +325,10 @@ void Mesh::enableBuffers(Shader* sh)
 
 void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 {
+	//still loading in background (or failed)
+	if (state != MESH_READY)
+		return;
+
 	Shader* shader = Shader::current;
 	if (!shader || !shader->compiled)
 	{
@@ -264,9 +348,9 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 			for (uint32_t j = 0; j < submesh.num_draw_calls; ++j) {
 				const sSubmeshDrawCallInfo& dc = submesh.draw_calls[j];
 				if (materials.count(dc.material) > 0) {
-					shader->setUniform("u_Ka", materials[dc.material].Ka);
-					shader->setUniform("u_Kd", materials[dc.material].Kd);
-					shader->setUniform("u_Ks", materials[dc.material].Ks);
+					shader->setUniform(u_Ka, materials[dc.material].Ka);
+					shader->setUniform(u_Kd, materials[dc.material].Kd);
+					shader->setUniform(u_Ks, materials[dc.material].Ks);
 				}
 				drawCall(primitive, i, j, num_instances);
 			}
@@ -304,17 +388,21 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int draw_call_id, in
 		if (num_instances > 0)
 		{
 			assert(indices_vbo_id && "indices must be uploaded to the GPU");
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+			if (!vao_in_use) //the VAO already has it
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 			glDrawElementsInstanced(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(glm::vec3)), num_instances);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			if (!vao_in_use)
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 		}
 		else
 		{
 			if (indices_vbo_id)
 			{
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+				if (!vao_in_use)
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 				glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(glm::vec3)));
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+				if (!vao_in_use)
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 			}
 			else
 				glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(&indices[0] + start)); //no multiply, its a vector3u pointer)
@@ -334,6 +422,13 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int draw_call_id, in
 
 void Mesh::disableBuffers(Shader* shader)
 {
+	if (vao_in_use)
+	{
+		glBindVertexArray(0);
+		vao_in_use = false;
+		return;
+	}
+
 	glDisableVertexAttribArray(vertex_location);
 	if (normal_location != -1) glDisableVertexAttribArray(normal_location);
 	if (uv_location != -1) glDisableVertexAttribArray(uv_location);
@@ -344,8 +439,6 @@ void Mesh::disableBuffers(Shader* shader)
 	glBindBuffer(GL_ARRAY_BUFFER, 0);    //if crashes here, COMMENT THIS LINE ****************************
 }
 
-GLuint instances_buffer_id = 0;
-
 //should be faster but in some system it is slower
 void Mesh::renderInstanced(unsigned int primitive, const glm::mat4* instanced_models, int num_instances)
 {
@@ -355,21 +448,27 @@ void Mesh::renderInstanced(unsigned int primitive, const glm::mat4* instanced_mo
 	Shader* shader = Shader::current;
 	assert(shader && "shader must be enabled");
 
-	if (instances_buffer_id == 0)
-		glGenBuffersARB(1, &instances_buffer_id);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, instances_buffer_id);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB, num_instances * sizeof(glm::mat4), instanced_models, GL_STREAM_DRAW_ARB);
+	//streamed, the buffer is shared by all the per frame data
+	StreamBuffer* stream = StreamBuffer::get();
+	sStreamRange range = stream->push(instanced_models, num_instances * sizeof(glm::mat4));
+	if (!range.ptr)
+		return;
 
-	int attribLocation = shader->getAttribLocation("u_model");
+	//the shaders with fixed attributes have it bound at link time, the others are asked by name
+	int attribLocation = shader->fixed_attributes ? VERTEX_ATTRIB_INSTANCE_MODEL : shader->getAttribLocation("u_model");
 	assert(attribLocation != -1 && "shader must have attribute mat4 u_model (not a uniform)");
 	if (attribLocation == -1)
 		return; //this shader doesnt support instanced model
 
+	//the instanced attributes must be set in the VAO that render will bind
+	bool use_vao = bindVAO(shader);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, stream->buffer_id);
+
 	//mat4 count as 4 different attributes of vec4... (thanks opengl...)
 	for (int k = 0; k < 4; ++k)
 	{
 		glEnableVertexAttribArray(attribLocation + k);
-		int offset = sizeof(float) * 4 * k;
+		size_t offset = range.offset + sizeof(float) * 4 * k;
 		const uint8_t* addr = (uint8_t*)offset;
 		glVertexAttribPointer(attribLocation + k, 4, GL_FLOAT, false, sizeof(glm::mat4x4), addr);
 		glVertexAttribDivisor(attribLocation + k, 1); // This makes it instanced!
@@ -379,11 +478,15 @@ void Mesh::renderInstanced(unsigned int primitive, const glm::mat4* instanced_mo
 	render(primitive, -1, num_instances);
 
 	//disable instanced attribs
+	if (use_vao)
+		glBindVertexArray(vao_id);
 	for (int k = 0; k < 4; ++k)
 	{
 		glDisableVertexAttribArray(attribLocation + k);
 		glVertexAttribDivisor(attribLocation + k, 0);
 	}
+	if (use_vao)
+		glBindVertexArray(0);
 }
 
 void Mesh::renderInstanced(unsigned int primitive, const std::vector<glm::vec3> positions, const char* uniform_name)
@@ -395,26 +498,34 @@ void Mesh::renderInstanced(unsigned int primitive, const std::vector<glm::vec3>
 	Shader* shader = Shader::current;
 	assert(shader && "shader must be enabled");
 
-	if (instances_buffer_id == 0)
-		glGenBuffersARB(1, &instances_buffer_id);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, instances_buffer_id);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB, num_instances * sizeof(glm::vec3), &positions[0], GL_STREAM_DRAW_ARB);
+	StreamBuffer* stream = StreamBuffer::get();
+	sStreamRange range = stream->push(&positions[0], num_instances * sizeof(glm::vec3));
+	if (!range.ptr)
+		return;
 
 	int attribLocation = shader->getAttribLocation(uniform_name);
 	assert(attribLocation != -1 && "shader uniform not found");
 	if (attribLocation == -1)
 		return; //this shader doesnt have instanced uniform
 
+	//the instanced attribute must be set in the VAO that render will bind
+	bool use_vao = bindVAO(shader);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, stream->buffer_id);
+
 	glEnableVertexAttribArray(attribLocation);
-	glVertexAttribPointer(attribLocation, 3, GL_FLOAT, false, sizeof(glm::vec3), 0);
+	glVertexAttribPointer(attribLocation, 3, GL_FLOAT, false, sizeof(glm::vec3), (void*)(size_t)range.offset);
 	glVertexAttribDivisor(attribLocation, 1); // This makes it instanced!
 
 	//regular render
 	render(primitive, -1, num_instances);
 
 	//disable instanced attribs
+	if (use_vao)
+		glBindVertexArray(vao_id);
 	glDisableVertexAttribArray(attribLocation);
 	glVertexAttribDivisor(attribLocation, 0);
+	if (use_vao)
+		glBindVertexArray(0);
 }
 
 
@@ -517,6 +628,11 @@ void Mesh::uploadToVRAM()
 		exit(0);
 	}
 
+	//buffers may change, the VAO is rebuilt on the next render
+	if (vao_id)
+		glDeleteVertexArrays(1, &vao_id);
+	vao_id = 0;
+
 	if (interleaved.size())
 	{
 		// Vertex,Normal,UV
@@ -604,6 +720,80 @@ void Mesh::uploadToVRAM()
 	//clear buffers to save memory
 }
 
+//stores the layout of the VBOs using the fixed locations of eVertexAttribute
+void Mesh::createVAO()
+{
+	assert((vertices_vbo_id || interleaved_vbo_id) && "mesh must be uploaded to VRAM");
+
+	int spacing = 0;
+	int offset_normal = 0;
+	int offset_uv = 0;
+
+	if (interleaved_vbo_id)
+	{
+		spacing = sizeof(tInterleaved);
+		offset_normal = sizeof(glm::vec3);
+		offset_uv = sizeof(glm::vec3) + sizeof(glm::vec3);
+	}
+
+	glGenVertexArrays(1, &vao_id);
+	glBindVertexArray(vao_id);
+
+	glEnableVertexAttribArray(VERTEX_ATTRIB_POSITION);
+	glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
+	glVertexAttribPointer(VERTEX_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, spacing, 0);
+
+	if (interleaved_vbo_id || normals_vbo_id)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL);
+		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
+		glVertexAttribPointer(VERTEX_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
+	}
+
+	if (interleaved_vbo_id || uvs_vbo_id)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_UV);
+		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
+		glVertexAttribPointer(VERTEX_ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
+	}
+
+	if (uvs1_vbo_id)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_UV1);
+		glBindBuffer(GL_ARRAY_BUFFER, uvs1_vbo_id);
+		glVertexAttribPointer(VERTEX_ATTRIB_UV1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+
+	if (colors_vbo_id)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_COLOR);
+		glBindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
+		glVertexAttribPointer(VERTEX_ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+
+	if (bones_vbo_id)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_BONES);
+		glBindBuffer(GL_ARRAY_BUFFER, bones_vbo_id);
+		glVertexAttribPointer(VERTEX_ATTRIB_BONES, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, NULL);
+	}
+
+	if (weights_vbo_id)
+	{
+		glEnableVertexAttribArray(VERTEX_ATTRIB_WEIGHTS);
+		glBindBuffer(GL_ARRAY_BUFFER, weights_vbo_id);
+		glVertexAttribPointer(VERTEX_ATTRIB_WEIGHTS, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+
+	//the element buffer binding is part of the VAO state
+	if (indices_vbo_id)
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
 bool Mesh::interleaveBuffers()
 {
 	if (!vertices.size() || !normals.size() || !uvs.size())
@@ -642,9 +832,47 @@ struct sMeshInfo
 	size_t num_submeshes = 0;
 	glm::mat4 bind_matrix;
 	char streams[8]; //Vertex/Interlaved|Normal|Uvs|Color|Indices|Bones|Weights|Extra|Uvs1
-	char extra[32]; //unused
+	int encoding; //eMeshEncoding, positions are quantized relative to aabb_min/aabb_max
+	unsigned int encoded_bytes; //size of the streams once decompressed
+	unsigned int packed_bytes; //size of the streams in the file
+	char extra[20]; //unused
 };
 
+//bytes of the streams described by the header, in the order readBin reads them, SIZE_MAX if the counts overflow
+static size_t binStreamsBytes(const sMeshInfo& info, bool quantized)
+{
+	size_t total = 0;
+	bool overflow = false;
+	auto add = [&total, &overflow](size_t count, size_t element_bytes) {
+		if (count > (SIZE_MAX - total) / element_bytes)
+			overflow = true;
+		else
+			total += count * element_bytes;
+	};
+
+	if (info.streams[0] == 'I')
+		add(info.size, quantized ? MESH_ENCODED_POSITION_SIZE + MESH_ENCODED_NORMAL_SIZE + MESH_ENCODED_UV_SIZE : sizeof(Mesh::tInterleaved));
+	else if (info.streams[0] == 'V')
+		add(info.size, quantized ? MESH_ENCODED_POSITION_SIZE : sizeof(glm::vec3));
+	if (info.streams[1] == 'N')
+		add(info.size, quantized ? MESH_ENCODED_NORMAL_SIZE : sizeof(glm::vec3));
+	if (info.streams[2] == 'U')
+		add(info.size, quantized ? MESH_ENCODED_UV_SIZE : sizeof(glm::vec2));
+	if (info.streams[3] == 'C')
+		add(info.size, quantized ? MESH_ENCODED_COLOR_SIZE : sizeof(glm::vec4));
+	if (info.streams[4] == 'I')
+		add(info.num_indices, sizeof(glm::vec3));
+	if (info.streams[5] == 'B')
+		add(info.size, sizeof(glm::vec4));
+	if (info.streams[6] == 'W')
+		add(info.size, sizeof(glm::vec4));
+	if (info.streams[7] == 'u')
+		add(info.size, quantized ? MESH_ENCODED_UV_SIZE : sizeof(glm::vec2));
+	add(info.num_bones, sizeof(BoneInfo));
+	add(info.num_submeshes, sizeof(sSubmeshInfo));
+	return overflow ? SIZE_MAX : total;
+}
+
 bool Mesh::readBin(const char* filename)
 {
 	FILE* f;
@@ -652,7 +880,8 @@ bool Mesh::readBin(const char* filename)
 
 	struct stat stbuffer;
 
-	stat(filename, &stbuffer);
+	if (stat(filename, &stbuffer) != 0)
+		return false;
 	f = fopen(filename, "rb");
 	if (f == NULL)
 		return false;
@@ -663,9 +892,10 @@ bool Mesh::readBin(const char* filename)
 	fclose(f);
 
 	//watermark
-	if (memcmp(data, "MBIN", 4) != 0)
+	if (size < 4 + sizeof(sMeshInfo) || memcmp(data, "MBIN", 4) != 0)
 	{
 		std::cout << "[ERROR] loading BIN: invalid content: " << filename << std::endl;
+		delete[] data;
 		return false;
 	}
 
@@ -674,44 +904,119 @@ bool Mesh::readBin(const char* filename)
 	memcpy(&info, pos, sizeof(sMeshInfo));
 	pos += sizeof(sMeshInfo);
 
-	if (info.version != MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo))
+	if (info.version < MESH_BIN_MIN_VERSION || info.version > MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo))
 	{
 		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+		delete[] data;
+		return false;
+	}
+
+	//the counts in the header must match the data, a truncated or corrupted file is parsed again from the source
+	bool quantized = info.version >= 13 && info.encoding == MESH_ENCODING_QUANTIZED;
+	size_t available = size - (pos - data);
+	size_t streams_bytes = binStreamsBytes(info, quantized);
+	bool valid = info.size > 0 && (info.streams[0] == 'I' || info.streams[0] == 'V') && (info.streams[4] != 'I' || info.num_indices > 0);
+	if (quantized) //the LZ stage cannot expand the data more than 255 times
+		valid = valid && info.packed_bytes <= available && streams_bytes == info.encoded_bytes && (size_t)info.encoded_bytes <= (size_t)info.packed_bytes * 255;
+	else
+		valid = valid && streams_bytes <= available;
+	if (!valid)
+	{
+		std::cout << "[ERROR] loading BIN: streams do not match the header: " << filename << std::endl;
+		delete[] data;
 		return false;
 	}
 
+	//quantized streams are stored compressed, unpack them first
+	std::vector<uint8_t> unpacked;
+	if (quantized)
+	{
+		unpacked.resize(info.encoded_bytes);
+		if (!decompressLZ((uint8_t*)pos, info.packed_bytes, unpacked.data(), unpacked.size()))
+		{
+			std::cout << "[ERROR] loading BIN: corrupted streams: " << filename << std::endl;
+			delete[] data;
+			return false;
+		}
+		pos = (char*)unpacked.data();
+	}
+
 	if (info.streams[0] == 'I')
 	{
 		interleaved.resize(info.size);
-		memcpy((void*)&interleaved[0], pos, sizeof(tInterleaved) * info.size);
-		pos += sizeof(tInterleaved) * info.size;
+		if (quantized)
+		{
+			decodePositions((uint8_t*)pos, info.size, info.aabb_min, info.aabb_max, &interleaved[0].vertex, sizeof(tInterleaved));
+			pos += MESH_ENCODED_POSITION_SIZE * info.size;
+			decodeNormals((uint8_t*)pos, info.size, &interleaved[0].normal, sizeof(tInterleaved));
+			pos += MESH_ENCODED_NORMAL_SIZE * info.size;
+			decodeUVs((uint8_t*)pos, info.size, &interleaved[0].uv, sizeof(tInterleaved));
+			pos += MESH_ENCODED_UV_SIZE * info.size;
+		}
+		else
+		{
+			memcpy((void*)&interleaved[0], pos, sizeof(tInterleaved) * info.size);
+			pos += sizeof(tInterleaved) * info.size;
+		}
 	}
 	else if (info.streams[0] == 'V')
 	{
 		vertices.resize(info.size);
-		memcpy((void*)&vertices[0], pos, sizeof(glm::vec3) * info.size);
-		pos += sizeof(glm::vec3) * info.size;
+		if (quantized)
+		{
+			decodePositions((uint8_t*)pos, info.size, info.aabb_min, info.aabb_max, &vertices[0], sizeof(glm::vec3));
+			pos += MESH_ENCODED_POSITION_SIZE * info.size;
+		}
+		else
+		{
+			memcpy((void*)&vertices[0], pos, sizeof(glm::vec3) * info.size);
+			pos += sizeof(glm::vec3) * info.size;
+		}
 	}
 
 	if (info.streams[1] == 'N')
 	{
 		normals.resize(info.size);
-		memcpy((void*)&normals[0], pos, sizeof(glm::vec3) * info.size);
-		pos += sizeof(glm::vec3) * info.size;
+		if (quantized)
+		{
+			decodeNormals((uint8_t*)pos, info.size, &normals[0], sizeof(glm::vec3));
+			pos += MESH_ENCODED_NORMAL_SIZE * info.size;
+		}
+		else
+		{
+			memcpy((void*)&normals[0], pos, sizeof(glm::vec3) * info.size);
+			pos += sizeof(glm::vec3) * info.size;
+		}
 	}
 
 	if (info.streams[2] == 'U')
 	{
 		uvs.resize(info.size);
-		memcpy((void*)&uvs[0], pos, sizeof(glm::vec2) * info.size);
-		pos += sizeof(glm::vec2) * info.size;
+		if (quantized)
+		{
+			decodeUVs((uint8_t*)pos, info.size, &uvs[0], sizeof(glm::vec2));
+			pos += MESH_ENCODED_UV_SIZE * info.size;
+		}
+		else
+		{
+			memcpy((void*)&uvs[0], pos, sizeof(glm::vec2) * info.size);
+			pos += sizeof(glm::vec2) * info.size;
+		}
 	}
 
 	if (info.streams[3] == 'C')
 	{
 		colors.resize(info.size);
-		memcpy((void*)&colors[0], pos, sizeof(glm::vec4) * info.size);
-		pos += sizeof(glm::vec4) * info.size;
+		if (quantized)
+		{
+			decodeColors((uint8_t*)pos, info.size, &colors[0], sizeof(glm::vec4));
+			pos += MESH_ENCODED_COLOR_SIZE * info.size;
+		}
+		else
+		{
+			memcpy((void*)&colors[0], pos, sizeof(glm::vec4) * info.size);
+			pos += sizeof(glm::vec4) * info.size;
+		}
 	}
 
 	if (info.streams[4] == 'I')
@@ -738,8 +1043,16 @@ bool Mesh::readBin(const char* filename)
 	if (info.streams[7] == 'u')
 	{
 		uvs1.resize(info.size);
-		memcpy((void*)&uvs1[0], pos, sizeof(glm::vec2) * info.size);
-		pos += sizeof(glm::vec2) * info.size;
+		if (quantized)
+		{
+			decodeUVs((uint8_t*)pos, info.size, &uvs1[0], sizeof(glm::vec2));
+			pos += MESH_ENCODED_UV_SIZE * info.size;
+		}
+		else
+		{
+			memcpy((void*)&uvs1[0], pos, sizeof(glm::vec2) * info.size);
+			pos += sizeof(glm::vec2) * info.size;
+		}
 	}
 
 	if (info.num_bones)
@@ -763,6 +1076,8 @@ bool Mesh::readBin(const char* filename)
 		pos += sizeof(sSubmeshInfo) * info.num_submeshes;
 	}
 
+	delete[] data;
+
 	// if the mtl is not specified in the obj but it's needed
 	if (!materials.size()) {
 		std::string mesh_name = filename;
@@ -793,6 +1108,10 @@ bool Mesh::writeBin(const char* filename)
 		return false;
 	}
 
+	//positions are quantized inside the AABB, so it must be tight
+	if (compress_binary)
+		updateBoundingBox();
+
 	//watermark
 	fwrite("MBIN", sizeof(char), 4, f);
 
@@ -810,6 +1129,7 @@ bool Mesh::writeBin(const char* filename)
 	info.num_bones = bones_info.size();
 	info.bind_matrix = bind_matrix;
 	info.num_submeshes = submeshes.size();
+	info.encoding = compress_binary ? MESH_ENCODING_QUANTIZED : MESH_ENCODING_RAW;
 
 	info.streams[0] = interleaved.size() ? 'I' : 'V';
 	info.streams[1] = normals.size() ? 'N' : ' ';
@@ -820,38 +1140,88 @@ bool Mesh::writeBin(const char* filename)
 	info.streams[6] = weights.size() ? 'W' : ' ';
 	info.streams[7] = uvs1.size() ? 'u' : ' ';
 
-	//write info
-	fwrite((void*)&info, sizeof(sMeshInfo), 1, f);
+	//gather streams (same order used by readBin)
+	std::vector<uint8_t> streams;
+	auto appendRaw = [&streams](const void* ptr, size_t bytes) { streams.insert(streams.end(), (const uint8_t*)ptr, (const uint8_t*)ptr + bytes); };
+	bool quantized = info.encoding == MESH_ENCODING_QUANTIZED;
 
-	//write streams
 	if (interleaved.size())
-		fwrite((void*)&interleaved[0], interleaved.size() * sizeof(tInterleaved), 1, f);
+	{
+		if (quantized)
+		{
+			encodePositions(&interleaved[0].vertex, sizeof(tInterleaved), interleaved.size(), info.aabb_min, info.aabb_max, streams);
+			encodeNormals(&interleaved[0].normal, sizeof(tInterleaved), interleaved.size(), streams);
+			encodeUVs(&interleaved[0].uv, sizeof(tInterleaved), interleaved.size(), streams);
+		}
+		else
+			appendRaw(&interleaved[0], interleaved.size() * sizeof(tInterleaved));
+	}
 	else
 	{
-		fwrite((void*)&vertices[0], vertices.size() * sizeof(glm::vec3), 1, f);
+		if (quantized)
+			encodePositions(&vertices[0], sizeof(glm::vec3), vertices.size(), info.aabb_min, info.aabb_max, streams);
+		else
+			appendRaw(&vertices[0], vertices.size() * sizeof(glm::vec3));
 		if (normals.size())
-			fwrite((void*)&normals[0], normals.size() * sizeof(glm::vec3), 1, f);
+		{
+			if (quantized)
+				encodeNormals(&normals[0], sizeof(glm::vec3), normals.size(), streams);
+			else
+				appendRaw(&normals[0], normals.size() * sizeof(glm::vec3));
+		}
 		if (uvs.size())
-			fwrite((void*)&uvs[0], uvs.size() * sizeof(glm::vec2), 1, f);
+		{
+			if (quantized)
+				encodeUVs(&uvs[0], sizeof(glm::vec2), uvs.size(), streams);
+			else
+				appendRaw(&uvs[0], uvs.size() * sizeof(glm::vec2));
+		}
 	}
 
 	if (colors.size())
-		fwrite((void*)&colors[0], colors.size() * sizeof(glm::vec4), 1, f);
+	{
+		if (quantized)
+			encodeColors(&colors[0], sizeof(glm::vec4), colors.size(), streams);
+		else
+			appendRaw(&colors[0], colors.size() * sizeof(glm::vec4));
+	}
 
 	if (indices.size())
-		fwrite((void*)&indices[0], indices.size() * sizeof(glm::vec3), 1, f);
+		appendRaw(&indices[0], indices.size() * sizeof(glm::vec3));
 
 	if (bones.size())
-		fwrite((void*)&bones[0], bones.size() * sizeof(glm::vec4), 1, f);
+		appendRaw(&bones[0], bones.size() * sizeof(glm::vec4));
 	if (weights.size())
-		fwrite((void*)&weights[0], weights.size() * sizeof(glm::vec4), 1, f);
-	if (bones_info.size())
-		fwrite((void*)&bones_info[0], bones_info.size() * sizeof(BoneInfo), 1, f);
+		appendRaw(&weights[0], weights.size() * sizeof(glm::vec4));
 	if (uvs1.size())
-		fwrite((void*)&uvs1[0], uvs1.size() * sizeof(glm::vec2), 1, f);
+	{
+		if (quantized)
+			encodeUVs(&uvs1[0], sizeof(glm::vec2), uvs1.size(), streams);
+		else
+			appendRaw(&uvs1[0], uvs1.size() * sizeof(glm::vec2));
+	}
+	if (bones_info.size())
+		appendRaw(&bones_info[0], bones_info.size() * sizeof(BoneInfo));
 
 	if (submeshes.size())
-		fwrite((void*)&submeshes[0], submeshes.size() * sizeof(sSubmeshInfo), 1, f);
+		appendRaw(&submeshes[0], submeshes.size() * sizeof(sSubmeshInfo));
+
+	//LZ stage
+	std::vector<uint8_t> packed;
+	if (quantized)
+	{
+		compressLZ(streams.data(), streams.size(), packed);
+		info.encoded_bytes = (unsigned int)streams.size();
+		info.packed_bytes = (unsigned int)packed.size();
+	}
+
+	//write info
+	fwrite((void*)&info, sizeof(sMeshInfo), 1, f);
+
+	//write streams
+	const std::vector<uint8_t>& content = quantized ? packed : streams;
+	if (content.size())
+		fwrite((void*)&content[0], content.size(), 1, f);
 
 	fclose(f);
 	return true;
@@ -1524,11 +1894,42 @@ Mesh* Mesh::getQuad()
 Mesh* Mesh::Get(const char* filename)
 {
 	assert(filename);
-	std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
-	if (it != sMeshesLoaded.end())
-		return it->second;
+	Mesh* loaded = (Mesh*)ResourceManager::Find(filename, RESOURCE_MESH);
+	if (loaded)
+	{
+		//requested before with GetAsync, the callers of Get expect it ready so it is waited for and uploaded now
+		while (loaded->state == MESH_LOADING)
+		{
+			UpdateAsyncLoads();
+			if (loaded->state == MESH_LOADING)
+				std::this_thread::yield();
+		}
+		if (loaded->state == MESH_FAILED)
+			return NULL;
+		loaded->addRef();
+		return loaded;
+	}
 
 	Mesh* m = new Mesh();
+	if (!m->loadFromFile(filename))
+	{
+		delete m;
+		return NULL;
+	}
+	if (build_bvh)
+		m->buildBVH();
+
+	//and upload them to VRAM
+	if (auto_upload_to_vram)
+		m->uploadToVRAM();
+
+	m->registerMesh(filename);
+	m->addRef();
+	return m;
+}
+
+bool Mesh::loadFromFile(const char* filename)
+{
 	std::string name = filename;
 
 	//detect format
@@ -1545,7 +1946,7 @@ Mesh* Mesh::Get(const char* filename)
 	else
 	{
 		std::cerr << "Unknown mesh format: " << filename << std::endl;
-		return NULL;
+		return false;
 	}
 
 	//stats
@@ -1557,69 +1958,126 @@ Mesh* Mesh::Get(const char* filename)
 		binfilename = binfilename + ".mbin";
 
 	//try loading the binary version
-	if (use_binary && m->readBin(binfilename.c_str()))
+	if (use_binary && readBin(binfilename.c_str()))
 	{
-		if (interleave_meshes && m->interleaved.size() == 0)
+		if (interleave_meshes && interleaved.size() == 0)
 		{
 			std::cout << "[INTERL] ";
-			m->interleaveBuffers();
+			interleaveBuffers();
 		}
 
-		if (auto_upload_to_vram)
-		{
-			std::cout << "[VRAM] ";
-			m->uploadToVRAM();
-		}
-
-		std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
-		m->registerMesh(filename);
-		return m;
+		std::cout << "[OK BIN]  Faces: " << (interleaved.size() ? interleaved.size() : vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+		return true;
 	}
 
 	//load the ascii version
 	bool loaded = false;
 	if (file_format == FORMAT_OBJ)
-		loaded = m->loadOBJ(filename);
+		loaded = loadOBJ(filename);
 	/*else if (file_format == FORMAT_ASE)
-		loaded = m->loadASE(filename);*/
+		loaded = loadASE(filename);*/
 	else if (file_format == FORMAT_MESH)
-		loaded = m->loadMESH(filename);
+		loaded = loadMESH(filename);
 
 	if (!loaded)
 	{
-		delete m;
 		std::cout << "[ERROR]: Mesh not found" << std::endl;
-		return NULL;
+		return false;
 	}
 
+	size_t num_faces = vertices.size() / 3;
+
 	//to optimize, interleave the meshes
 	if (interleave_meshes)
 	{
 		std::cout << "[INTERL] ";
-		m->interleaveBuffers();
+		interleaveBuffers();
 	}
 
-	//and upload them to VRAM
-	if (auto_upload_to_vram)
-	{
-		std::cout << "[VRAM] ";
-		m->uploadToVRAM();
-	}
-
-	std::cout << "[OK]  Faces: " << m->vertices.size() / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	std::cout << "[OK]  Faces: " << num_faces << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	if (use_binary)
 	{
 		std::cout << "\t\t Writing .BIN ... ";
-		m->writeBin(filename);
+		writeBin(filename);
 		std::cout << "[OK]" << std::endl;
 	}
 
-	m->registerMesh(name);
+	return true;
+}
+
+//meshes parsed by the workers waiting to be uploaded by the main thread
+struct sAsyncMeshResult
+{
+	Mesh* mesh;
+	bool loaded;
+};
+static std::mutex async_meshes_mutex;
+static std::deque<sAsyncMeshResult> async_meshes_parsed;
+
+Mesh* Mesh::GetAsync(const char* filename)
+{
+	assert(filename);
+	Mesh* loaded = (Mesh*)ResourceManager::Find(filename, RESOURCE_MESH);
+	if (loaded)
+	{
+		loaded->addRef();
+		return loaded;
+	}
+
+	//register it now so other requests for the same file get the same handle
+	Mesh* m = new Mesh();
+	m->state = MESH_LOADING;
+	m->registerMesh(filename);
+	m->addRef();
+	num_async_loads++;
+
+	std::string path = filename;
+	ThreadPool::get()->enqueue([m, path]() {
+		bool loaded = m->loadFromFile(path.c_str());
+		if (loaded && build_bvh)
+			m->buildBVH();
+		std::lock_guard<std::mutex> lock(async_meshes_mutex);
+		async_meshes_parsed.push_back({ m, loaded });
+	});
+
 	return m;
 }
 
+void Mesh::UpdateAsyncLoads()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	while (true)
+	{
+		sAsyncMeshResult result;
+		{
+			std::lock_guard<std::mutex> lock(async_meshes_mutex);
+			if (async_meshes_parsed.empty())
+				return;
+			result = async_meshes_parsed.front();
+			async_meshes_parsed.pop_front();
+		}
+
+		Mesh* m = result.mesh;
+		num_async_loads--;
+		if (!result.loaded)
+			m->state = MESH_FAILED;
+		else
+		{
+			if (auto_upload_to_vram)
+				m->uploadToVRAM();
+			m->state = MESH_READY;
+		}
+
+		//an upload cannot be split, so the budget is checked between meshes
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if (elapsed.count() >= async_upload_budget)
+			return;
+	}
+}
+
 void Mesh::registerMesh(std::string name)
 {
 	this->name = name;
-	sMeshesLoaded[name] = this;
+	ResourceManager::Register(name, this);
 }
\ No newline at end of file
@@ -10,12 +10,16 @@
 #include <glm/matrix.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include "../framework/resourcemanager.h"
+
 class Shader; //for binding
 class Image; //for displace
 class Skeleton; //for skinned meshes
+class MeshBVH; //for ray queries
 
-//version from 21/01/2024
-#define MESH_BIN_VERSION 12 //this is used to regenerate bins if the format changes
+//version from 18/10/2026
+#define MESH_BIN_VERSION 13 //this is used to regenerate bins if the format changes
+#define MESH_BIN_MIN_VERSION 12 //older bins that can still be read (raw streams only)
 
 #define MAX_SUBMESH_DRAW_CALLS 16
 
@@ -59,17 +63,23 @@ struct sMaterialInfo
 	glm::vec3 Ks;
 };
 
-class Mesh
+enum eMeshState { MESH_READY, MESH_LOADING, MESH_FAILED };
+
+class Mesh : public Resource
 {
 public:
-	static std::map<std::string, Mesh*> sMeshesLoaded;
 	static bool use_binary; //always load the binary version of a mesh when possible
 	static bool interleave_meshes; //loaded meshes will me automatically interleaved
 	static bool auto_upload_to_vram; //loaded meshes will be stored in the VRAM
+	static bool compress_binary; //written bins store quantized streams compressed with LZ (smaller but lossy)
+	static bool build_bvh; //loaded meshes get the triangle BVH used to pick them
 	static long num_meshes_rendered;
 	static long num_triangles_rendered;
+	static float async_upload_budget; //max ms per frame spent uploading meshes loaded in background
+	static unsigned int num_async_loads; //meshes from GetAsync not uploaded yet
 
 	std::string name;
+	eMeshState state = MESH_READY; //meshes from GetAsync cannot be rendered until they are ready
 
 	std::vector<sSubmeshInfo> submeshes; //contains info about every submesh
 	std::map<std::string, sMaterialInfo> materials; //contains info about every material
@@ -113,11 +123,17 @@ public:
 	unsigned int weights_vbo_id;
 	unsigned int uvs1_vbo_id;
 
+	unsigned int vao_id; //attribute layout of the VBOs, created on first render
+
 	Mesh();
 	~Mesh();
 
 	void clear();
 
+	size_t getCPUSize() override;
+	size_t getVRAMSize() override;
+	bool canEvict() override { return state != MESH_LOADING; } //a worker is still filling it
+
 	void render(unsigned int primitive, int submesh_id = -1, int num_instances = 0);
 	void renderInstanced(unsigned int primitive, const glm::mat4* instanced_models, int number);
 	void renderInstanced(unsigned int primitive, const std::vector<glm::vec3> positions, const char* uniform_name);
@@ -125,6 +141,7 @@ public:
 	void renderFixedPipeline(int primitive); //sloooooooow
 	void renderAnimated(unsigned int primitive, Skeleton* sk);
 
+	bool bindVAO(Shader* shader); //false if the shader or the mesh cannot use it
 	void enableBuffers(Shader* shader);
 	void drawCall(unsigned int primitive, int submesh_id, int draw_call_id, int num_instances);
 	void disableBuffers(Shader* shader);
@@ -137,14 +154,21 @@ public:
 
 	//collision testing
 	void* collision_model;
+	MeshBVH* bvh; //triangles for ray queries, built when the file is loaded
+	void buildBVH(); //from the RAM copy, does not use OpenGL so GetAsync builds it in the worker
+	MeshBVH* getBVH() const { return isReady() ? bvh : NULL; } //NULL if the mesh had no triangles in RAM
 	//bool createCollisionModel(bool is_static = false); //is_static sets if the inv matrix should be computed after setTransform (true) or before rayCollision (false)
 	////help: model is the transform of the mesh, ray origin and direction, a Vector3 where to store the collision if found, a Vector3 where to store the normal if there was a collision, max ray distance in case the ray should go to infintiy, and in_object_space to get the collision point in object space or world space
 	//bool testRayCollision(Matrix44 model, Vector3 ray_origin, Vector3 ray_direction, Vector3& collision, Vector3& normal, float max_ray_dist = 3.4e+38F, bool in_object_space = false);
 	//bool testSphereCollision(Matrix44 model, Vector3 center, float radius, Vector3& collision, Vector3& normal);
 
 	//loader
-	static Mesh* Get(const char* filename);
+	static Mesh* Get(const char* filename); //adds a reference, call removeRef() when done with it, a pending GetAsync of the same file is finished first
+	static Mesh* GetAsync(const char* filename); //returns a mesh at once, the file is parsed in a worker thread
+	static void UpdateAsyncLoads(); //uploads the meshes parsed in background, call it once per frame from the main thread
+	bool loadFromFile(const char* filename); //parses the file into RAM, does not use OpenGL
 	void registerMesh(std::string name);
+	bool isReady() const { return state == MESH_READY; }
 
 	//create help meshes
 	void createQuad(float center_x, float center_y, float w, float h, bool flip_uvs);
@@ -160,6 +184,7 @@ public:
 
 	//optimize meshes
 	void uploadToVRAM();
+	void createVAO();
 	bool interleaveBuffers();
 
 private:
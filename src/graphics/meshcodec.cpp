@@ -0,0 +1,346 @@
+#include "meshcodec.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define MESHCODEC_SSE2
+	#include <emmintrin.h>
+#endif
+
+static inline void pushU16(std::vector<uint8_t>& out, uint16_t v)
+{
+	out.push_back((uint8_t)(v & 0xFF));
+	out.push_back((uint8_t)(v >> 8));
+}
+
+static inline uint16_t readU16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+// HALF FLOATS ************************
+
+uint16_t floatToHalf(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, 4);
+	uint32_t sign = (x >> 16) & 0x8000;
+	int32_t exp = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+	uint32_t mant = x & 0x7FFFFF;
+
+	if (((x >> 23) & 0xFF) == 0xFF) //inf or nan
+		return (uint16_t)(sign | 0x7C00 | (mant ? 0x200 : 0));
+	if (exp >= 31) //too big, clamp to inf
+		return (uint16_t)(sign | 0x7C00);
+
+	if (exp <= 0) //denormal
+	{
+		if (exp < -10)
+			return (uint16_t)sign;
+		mant |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - exp);
+		uint32_t h = mant >> shift;
+		uint32_t rem = mant & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rem > halfway || (rem == halfway && (h & 1)))
+			h++;
+		return (uint16_t)(sign | h);
+	}
+
+	//round to nearest even, a carry moves into the exponent
+	uint32_t h = ((uint32_t)exp << 10) | (mant >> 13);
+	uint32_t rem = mant & 0x1FFF;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+		h++;
+	return (uint16_t)(sign | h);
+}
+
+float halfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	int32_t exp = (h >> 10) & 0x1F;
+	uint32_t mant = h & 0x3FF;
+	uint32_t x;
+
+	if (exp == 0)
+	{
+		if (mant == 0)
+			x = sign;
+		else //denormal, normalize it
+		{
+			exp = 1;
+			while (!(mant & 0x400)) { mant <<= 1; exp--; }
+			mant &= 0x3FF;
+			x = sign | ((uint32_t)(exp + 112) << 23) | (mant << 13);
+		}
+	}
+	else if (exp == 31)
+		x = sign | 0x7F800000 | (mant << 13);
+	else
+		x = sign | ((uint32_t)(exp + 112) << 23) | (mant << 13);
+
+	float f;
+	memcpy(&f, &x, 4);
+	return f;
+}
+
+#ifdef MESHCODEC_SSE2
+//converts 4 halfs (in the low 16 bits of every lane) to floats, denormals included
+static inline __m128 halfToFloat4(__m128i h)
+{
+	const __m128i mask_nosign = _mm_set1_epi32(0x7FFF);
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+	const __m128i was_infnan = _mm_set1_epi32(0x7BFF);
+	const __m128 exp_infnan = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+	__m128i expmant = _mm_and_si128(mask_nosign, h);
+	__m128i justsign = _mm_xor_si128(h, expmant);
+	__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), magic);
+	__m128i infnan = _mm_cmpgt_epi32(expmant, was_infnan);
+	__m128 sign = _mm_castsi128_ps(_mm_slli_epi32(justsign, 16));
+	__m128 infnan_exp = _mm_and_ps(_mm_castsi128_ps(infnan), exp_infnan);
+	return _mm_or_ps(scaled, _mm_or_ps(sign, infnan_exp));
+}
+#endif
+
+// POSITIONS ************************
+
+void encodePositions(const void* src, size_t stride, size_t count, const glm::vec3& aabb_min, const glm::vec3& aabb_max, std::vector<uint8_t>& out)
+{
+	glm::vec3 extent = aabb_max - aabb_min;
+	glm::vec3 scale;
+	for (int k = 0; k < 3; ++k)
+		scale[k] = extent[k] > 0.0f ? 65535.0f / extent[k] : 0.0f;
+
+	out.reserve(out.size() + count * MESH_ENCODED_POSITION_SIZE);
+	const uint8_t* p = (const uint8_t*)src;
+	for (size_t i = 0; i < count; ++i, p += stride)
+	{
+		glm::vec3 v;
+		memcpy(&v, p, sizeof(glm::vec3));
+		for (int k = 0; k < 3; ++k)
+		{
+			float q = std::round((v[k] - aabb_min[k]) * scale[k]);
+			pushU16(out, (uint16_t)std::clamp(q, 0.0f, 65535.0f));
+		}
+	}
+}
+
+void decodePositions(const uint8_t* src, size_t count, const glm::vec3& aabb_min, const glm::vec3& aabb_max, void* dst, size_t stride)
+{
+	glm::vec3 scale = (aabb_max - aabb_min) * (1.0f / 65535.0f);
+	uint8_t* d = (uint8_t*)dst;
+	size_t i = 0;
+
+#ifdef MESHCODEC_SSE2
+	//4 vertices are 12 components, the scale and offset patterns repeat every 3 registers
+	const __m128 s0 = _mm_setr_ps(scale.x, scale.y, scale.z, scale.x);
+	const __m128 s1 = _mm_setr_ps(scale.y, scale.z, scale.x, scale.y);
+	const __m128 s2 = _mm_setr_ps(scale.z, scale.x, scale.y, scale.z);
+	const __m128 o0 = _mm_setr_ps(aabb_min.x, aabb_min.y, aabb_min.z, aabb_min.x);
+	const __m128 o1 = _mm_setr_ps(aabb_min.y, aabb_min.z, aabb_min.x, aabb_min.y);
+	const __m128 o2 = _mm_setr_ps(aabb_min.z, aabb_min.x, aabb_min.y, aabb_min.z);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const uint8_t* p = src + i * MESH_ENCODED_POSITION_SIZE;
+		__m128i a = _mm_loadu_si128((const __m128i*)p);
+		__m128i b = _mm_loadl_epi64((const __m128i*)(p + 16));
+
+		float values[12];
+		_mm_storeu_ps(values, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(a, zero)), s0), o0));
+		_mm_storeu_ps(values + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(a, zero)), s1), o1));
+		_mm_storeu_ps(values + 8, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero)), s2), o2));
+
+		if (stride == sizeof(glm::vec3))
+			memcpy(d + i * stride, values, sizeof(values));
+		else
+			for (int k = 0; k < 4; ++k)
+				memcpy(d + (i + k) * stride, values + k * 3, sizeof(glm::vec3));
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		const uint8_t* p = src + i * MESH_ENCODED_POSITION_SIZE;
+		glm::vec3 v;
+		for (int k = 0; k < 3; ++k)
+			v[k] = aabb_min[k] + readU16(p + k * 2) * scale[k];
+		memcpy(d + i * stride, &v, sizeof(glm::vec3));
+	}
+}
+
+// NORMALS ************************
+
+void encodeNormals(const void* src, size_t stride, size_t count, std::vector<uint8_t>& out)
+{
+	out.reserve(out.size() + count * MESH_ENCODED_NORMAL_SIZE);
+	const uint8_t* p = (const uint8_t*)src;
+	for (size_t i = 0; i < count; ++i, p += stride)
+	{
+		glm::vec3 n;
+		memcpy(&n, p, sizeof(glm::vec3));
+
+		//project on the octahedron and fold the lower half over the upper one
+		float x = 0.0f, y = 0.0f;
+		float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (l1 > 0.0f)
+		{
+			x = n.x / l1;
+			y = n.y / l1;
+			if (n.z < 0.0f)
+			{
+				float fx = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+				float fy = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+				x = fx;
+				y = fy;
+			}
+		}
+
+		pushU16(out, (uint16_t)(int16_t)std::round(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+		pushU16(out, (uint16_t)(int16_t)std::round(std::clamp(y, -1.0f, 1.0f) * 32767.0f));
+	}
+}
+
+void decodeNormals(const uint8_t* src, size_t count, void* dst, size_t stride)
+{
+	uint8_t* d = (uint8_t*)dst;
+	size_t i = 0;
+
+#ifdef MESHCODEC_SSE2
+	const __m128 inv = _mm_set1_ps(1.0f / 32767.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i * MESH_ENCODED_NORMAL_SIZE));
+		//sign extend to 32 bits: (x0,y0,x1,y1) and (x2,y2,x3,y3)
+		__m128 lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16)), inv);
+		__m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16)), inv);
+		__m128 x = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 y = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+		//z = 1 - |x| - |y|, and unfold the lower half
+		__m128 z = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, x)), _mm_andnot_ps(sign_mask, y));
+		__m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+		x = _mm_sub_ps(x, _mm_xor_ps(t, _mm_and_ps(x, sign_mask)));
+		y = _mm_sub_ps(y, _mm_xor_ps(t, _mm_and_ps(y, sign_mask)));
+
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		x = _mm_div_ps(x, len);
+		y = _mm_div_ps(y, len);
+		z = _mm_div_ps(z, len);
+
+		float xs[4], ys[4], zs[4];
+		_mm_storeu_ps(xs, x);
+		_mm_storeu_ps(ys, y);
+		_mm_storeu_ps(zs, z);
+		for (int k = 0; k < 4; ++k)
+		{
+			glm::vec3 n(xs[k], ys[k], zs[k]);
+			memcpy(d + (i + k) * stride, &n, sizeof(glm::vec3));
+		}
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		const uint8_t* p = src + i * MESH_ENCODED_NORMAL_SIZE;
+		float x = (int16_t)readU16(p) / 32767.0f;
+		float y = (int16_t)readU16(p + 2) / 32767.0f;
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		float t = std::max(-z, 0.0f);
+		x += x >= 0.0f ? -t : t;
+		y += y >= 0.0f ? -t : t;
+		float len = std::sqrt(x * x + y * y + z * z);
+		glm::vec3 n(x / len, y / len, z / len);
+		memcpy(d + i * stride, &n, sizeof(glm::vec3));
+	}
+}
+
+// UVS ************************
+
+void encodeUVs(const void* src, size_t stride, size_t count, std::vector<uint8_t>& out)
+{
+	out.reserve(out.size() + count * MESH_ENCODED_UV_SIZE);
+	const uint8_t* p = (const uint8_t*)src;
+	for (size_t i = 0; i < count; ++i, p += stride)
+	{
+		float uv[2];
+		memcpy(uv, p, sizeof(uv));
+		pushU16(out, floatToHalf(uv[0]));
+		pushU16(out, floatToHalf(uv[1]));
+	}
+}
+
+void decodeUVs(const uint8_t* src, size_t count, void* dst, size_t stride)
+{
+	uint8_t* d = (uint8_t*)dst;
+	size_t i = 0;
+
+#ifdef MESHCODEC_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i * MESH_ENCODED_UV_SIZE));
+		float values[8];
+		_mm_storeu_ps(values, halfToFloat4(_mm_unpacklo_epi16(a, zero)));
+		_mm_storeu_ps(values + 4, halfToFloat4(_mm_unpackhi_epi16(a, zero)));
+		for (int k = 0; k < 4; ++k)
+			memcpy(d + (i + k) * stride, values + k * 2, sizeof(float) * 2);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		const uint8_t* p = src + i * MESH_ENCODED_UV_SIZE;
+		float uv[2] = { halfToFloat(readU16(p)), halfToFloat(readU16(p + 2)) };
+		memcpy(d + i * stride, uv, sizeof(uv));
+	}
+}
+
+// COLORS ************************
+
+void encodeColors(const void* src, size_t stride, size_t count, std::vector<uint8_t>& out)
+{
+	out.reserve(out.size() + count * MESH_ENCODED_COLOR_SIZE);
+	const uint8_t* p = (const uint8_t*)src;
+	for (size_t i = 0; i < count; ++i, p += stride)
+	{
+		float c[4];
+		memcpy(c, p, sizeof(c));
+		for (int k = 0; k < 4; ++k)
+			out.push_back((uint8_t)std::round(std::clamp(c[k], 0.0f, 1.0f) * 255.0f));
+	}
+}
+
+void decodeColors(const uint8_t* src, size_t count, void* dst, size_t stride)
+{
+	uint8_t* d = (uint8_t*)dst;
+	size_t i = 0;
+
+#ifdef MESHCODEC_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 inv = _mm_set1_ps(1.0f / 255.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i * MESH_ENCODED_COLOR_SIZE));
+		__m128i lo = _mm_unpacklo_epi8(a, zero);
+		__m128i hi = _mm_unpackhi_epi8(a, zero);
+		_mm_storeu_ps((float*)(d + (i + 0) * stride), _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), inv));
+		_mm_storeu_ps((float*)(d + (i + 1) * stride), _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), inv));
+		_mm_storeu_ps((float*)(d + (i + 2) * stride), _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), inv));
+		_mm_storeu_ps((float*)(d + (i + 3) * stride), _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), inv));
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		const uint8_t* p = src + i * MESH_ENCODED_COLOR_SIZE;
+		float c[4];
+		for (int k = 0; k < 4; ++k)
+			c[k] = p[k] / 255.0f;
+		memcpy(d + i * stride, c, sizeof(c));
+	}
+}
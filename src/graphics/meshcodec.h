@@ -0,0 +1,37 @@
+/*
+	Quantized encodings for the streams stored in the .mbin files.
+	Positions are stored as 3x uint16 relative to the mesh AABB, normals as 2x int16 (octahedral mapping),
+	uvs as 2x half floats and colors as 4x uint8. Decoding uses SSE2 when available.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <glm/vec3.hpp>
+
+enum eMeshEncoding { MESH_ENCODING_RAW = 0, MESH_ENCODING_QUANTIZED = 1 };
+
+//size in bytes of every encoded element
+#define MESH_ENCODED_POSITION_SIZE 6
+#define MESH_ENCODED_NORMAL_SIZE 4
+#define MESH_ENCODED_UV_SIZE 4
+#define MESH_ENCODED_COLOR_SIZE 4
+
+//all functions read/write float data using a stride in bytes, so they work over interleaved buffers too
+void encodePositions(const void* src, size_t stride, size_t count, const glm::vec3& aabb_min, const glm::vec3& aabb_max, std::vector<uint8_t>& out);
+void decodePositions(const uint8_t* src, size_t count, const glm::vec3& aabb_min, const glm::vec3& aabb_max, void* dst, size_t stride);
+
+void encodeNormals(const void* src, size_t stride, size_t count, std::vector<uint8_t>& out);
+void decodeNormals(const uint8_t* src, size_t count, void* dst, size_t stride);
+
+void encodeUVs(const void* src, size_t stride, size_t count, std::vector<uint8_t>& out);
+void decodeUVs(const uint8_t* src, size_t count, void* dst, size_t stride);
+
+void encodeColors(const void* src, size_t stride, size_t count, std::vector<uint8_t>& out);
+void decodeColors(const uint8_t* src, size_t count, void* dst, size_t stride);
+
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
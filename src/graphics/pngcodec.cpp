@@ -0,0 +1,675 @@
+#include "pngcodec.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PNGCODEC_SSE2
+	#include <emmintrin.h>
+#endif
+
+// INFLATE ************************
+
+//LSB first, bytes past the end are read as zeros and counted to detect truncated streams
+struct sBitReader
+{
+	const uint8_t* pos;
+	const uint8_t* end;
+	uint64_t bits;
+	int count;
+	size_t padding;
+
+	void refill()
+	{
+		while (count <= 56)
+		{
+			if (pos < end)
+				bits |= (uint64_t)(*pos++) << count;
+			else
+				padding++;
+			count += 8;
+		}
+	}
+	uint32_t read(int n)
+	{
+		if (count < n)
+			refill();
+		uint32_t value = (uint32_t)(bits & ((1ULL << n) - 1));
+		bits >>= n;
+		count -= n;
+		return value;
+	}
+	bool overrun() const { return padding * 8 > (size_t)count; } //some of the bits used did not come from the stream
+};
+
+#define HUFFMAN_FAST_BITS 10
+#define HUFFMAN_MAX_SYMBOLS 288
+
+//canonical code, the short codes are resolved with one lookup of the next HUFFMAN_FAST_BITS
+struct sHuffman
+{
+	uint16_t fast[1 << HUFFMAN_FAST_BITS]; //length << 9 | symbol, 0 if the code is longer
+	uint16_t count[16]; //codes of every length
+	uint16_t symbols[HUFFMAN_MAX_SYMBOLS]; //sorted by code
+
+	bool build(const uint8_t* lengths, int num)
+	{
+		memset(count, 0, sizeof(count));
+		memset(fast, 0, sizeof(fast));
+		for (int i = 0; i < num; ++i)
+			count[lengths[i]]++;
+		count[0] = 0;
+
+		//over-subscribed sets are invalid, incomplete ones are allowed (a single distance code)
+		int left = 1;
+		for (int len = 1; len < 16; ++len)
+		{
+			left = (left << 1) - count[len];
+			if (left < 0)
+				return false;
+		}
+
+		uint16_t offsets[16];
+		uint16_t next_code[16];
+		offsets[1] = 0;
+		next_code[1] = 0;
+		for (int len = 1; len < 15; ++len)
+		{
+			offsets[len + 1] = offsets[len] + count[len];
+			next_code[len + 1] = (uint16_t)((next_code[len] + count[len]) << 1);
+		}
+
+		for (int symbol = 0; symbol < num; ++symbol)
+		{
+			int len = lengths[symbol];
+			if (!len)
+				continue;
+			symbols[offsets[len]++] = (uint16_t)symbol;
+			int code = next_code[len]++;
+			if (len > HUFFMAN_FAST_BITS)
+				continue;
+
+			//the stream has the codes from their first bit, the table is indexed by the bits reversed
+			int reversed = 0;
+			for (int i = 0; i < len; ++i)
+				reversed |= ((code >> i) & 1) << (len - 1 - i);
+			for (int i = reversed; i < (1 << HUFFMAN_FAST_BITS); i += 1 << len)
+				fast[i] = (uint16_t)((len << 9) | symbol);
+		}
+		return true;
+	}
+
+	int decode(sBitReader& reader) const
+	{
+		if (reader.count < 16)
+			reader.refill();
+		uint16_t entry = fast[reader.bits & ((1 << HUFFMAN_FAST_BITS) - 1)];
+		if (entry)
+		{
+			reader.bits >>= entry >> 9;
+			reader.count -= entry >> 9;
+			return entry & 511;
+		}
+
+		//long codes, one bit at a time
+		int code = 0, first = 0, index = 0;
+		for (int len = 1; len < 16; ++len)
+		{
+			code |= reader.read(1);
+			int num = count[len];
+			if (code - num < first)
+				return symbols[index + (code - first)];
+			index += num;
+			first = (first + num) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+};
+
+static const uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static bool inflateBlock(sBitReader& reader, const sHuffman& lengths, const sHuffman& distances, std::vector<uint8_t>& out, size_t& out_size, size_t max_size)
+{
+	while (true)
+	{
+		int symbol = lengths.decode(reader);
+		if (symbol < 0 || reader.overrun())
+			return false;
+
+		if (symbol < 256)
+		{
+			if (out_size == max_size)
+				return false;
+			if (out_size == out.size())
+				out.resize(std::min(std::max(out.size() * 2, (size_t)1024), max_size));
+			out[out_size++] = (uint8_t)symbol;
+			continue;
+		}
+		if (symbol == 256)
+			return true;
+
+		symbol -= 257;
+		if (symbol >= 29)
+			return false;
+		size_t length = length_base[symbol] + reader.read(length_extra[symbol]);
+		int distance_symbol = distances.decode(reader);
+		if (distance_symbol < 0 || distance_symbol >= 30)
+			return false;
+		size_t distance = distance_base[distance_symbol] + reader.read(distance_extra[distance_symbol]);
+		if (distance > out_size || length > max_size - out_size)
+			return false;
+
+		if (out_size + length > out.size())
+			out.resize(std::min(std::max(out.size() * 2, out_size + length), max_size));
+		uint8_t* dst = &out[out_size];
+		const uint8_t* src = dst - distance;
+		if (distance >= length)
+			memcpy(dst, src, length);
+		else
+			for (size_t i = 0; i < length; ++i) //overlapped, repeats the last bytes
+				dst[i] = src[i];
+		out_size += length;
+	}
+}
+
+bool inflateZlib(const uint8_t* src, size_t size, std::vector<uint8_t>& out, size_t expected_size, size_t max_size)
+{
+	//CMF and FLG, deflate without preset dictionary
+	if (size < 2 || (src[0] & 0x0F) != 8 || ((src[0] << 8) | src[1]) % 31 != 0 || (src[1] & 0x20))
+		return false;
+
+	sBitReader reader;
+	reader.pos = src + 2;
+	reader.end = src + size;
+	reader.bits = 0;
+	reader.count = 0;
+	reader.padding = 0;
+
+	out.resize(std::min(std::max(expected_size, (size_t)1024), max_size));
+	size_t out_size = 0;
+	sHuffman lengths, distances;
+
+	bool final_block = false;
+	while (!final_block)
+	{
+		final_block = reader.read(1) != 0;
+		int type = reader.read(2);
+
+		if (type == 0)
+		{
+			//stored, skip to the byte boundary and give back the whole bytes still in the reader
+			reader.read(reader.count & 7);
+			size_t buffered = reader.count / 8;
+			if (buffered < reader.padding)
+				return false;
+			reader.pos -= buffered - reader.padding;
+			reader.bits = 0;
+			reader.count = 0;
+			reader.padding = 0;
+
+			if (reader.end - reader.pos < 4)
+				return false;
+			size_t length = reader.pos[0] | (reader.pos[1] << 8);
+			size_t nlength = reader.pos[2] | (reader.pos[3] << 8);
+			reader.pos += 4;
+			if (length != (~nlength & 0xFFFF) || (size_t)(reader.end - reader.pos) < length || length > max_size - out_size)
+				return false;
+
+			if (out_size + length > out.size())
+				out.resize(std::min(std::max(out.size() * 2, out_size + length), max_size));
+			memcpy(&out[out_size], reader.pos, length);
+			out_size += length;
+			reader.pos += length;
+			continue;
+		}
+
+		uint8_t code_lengths[HUFFMAN_MAX_SYMBOLS + 32];
+		int num_lengths = 288, num_distances = 30;
+		if (type == 1)
+		{
+			//fixed codes
+			memset(code_lengths, 8, 144);
+			memset(code_lengths + 144, 9, 112);
+			memset(code_lengths + 256, 7, 24);
+			memset(code_lengths + 280, 8, 8);
+			memset(code_lengths + 288, 5, 30);
+		}
+		else if (type == 2)
+		{
+			num_lengths = reader.read(5) + 257;
+			num_distances = reader.read(5) + 1;
+			int num_codes = reader.read(4) + 4;
+			if (num_lengths > 286 || num_distances > 30)
+				return false;
+
+			static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+			uint8_t codes_lengths[19] = {};
+			for (int i = 0; i < num_codes; ++i)
+				codes_lengths[order[i]] = (uint8_t)reader.read(3);
+			sHuffman codes;
+			if (!codes.build(codes_lengths, 19))
+				return false;
+
+			//the lengths of both codes are one sequence, repeats can cross from one to the other
+			int total = num_lengths + num_distances;
+			for (int i = 0; i < total; )
+			{
+				int symbol = codes.decode(reader);
+				if (symbol < 0 || reader.overrun())
+					return false;
+				if (symbol < 16)
+				{
+					code_lengths[i++] = (uint8_t)symbol;
+					continue;
+				}
+
+				uint8_t value = 0;
+				int repeat = 0;
+				if (symbol == 16)
+				{
+					if (i == 0)
+						return false;
+					value = code_lengths[i - 1];
+					repeat = 3 + reader.read(2);
+				}
+				else if (symbol == 17)
+					repeat = 3 + reader.read(3);
+				else
+					repeat = 11 + reader.read(7);
+				if (i + repeat > total)
+					return false;
+				memset(code_lengths + i, value, repeat);
+				i += repeat;
+			}
+			if (code_lengths[256] == 0)
+				return false; //no end of block
+		}
+		else
+			return false;
+
+		if (!lengths.build(code_lengths, num_lengths) || !distances.build(code_lengths + num_lengths, num_distances))
+			return false;
+		if (!inflateBlock(reader, lengths, distances, out, out_size, max_size))
+			return false;
+	}
+
+	out.resize(out_size);
+	return true;
+}
+
+// UNFILTER ************************
+
+static inline int paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+#ifdef PNGCODEC_SSE2
+//one pixel of 3 or 4 bytes in the low bytes of a register
+static inline __m128i loadPixel(const uint8_t* p, int bpp)
+{
+	uint32_t value = 0;
+	memcpy(&value, p, bpp);
+	return _mm_cvtsi32_si128((int)value);
+}
+
+static inline void storePixel(uint8_t* p, __m128i v, int bpp)
+{
+	uint32_t value = (uint32_t)_mm_cvtsi128_si32(v);
+	memcpy(p, &value, bpp);
+}
+
+static inline __m128i absEpi16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+//the channels of one pixel are filtered together, the pixels still go one after the other
+static void unfilterRowSSE2(int filter, uint8_t* row, const uint8_t* prev, size_t size, int bpp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = zero; //left
+	__m128i c = zero; //up left
+	switch (filter)
+	{
+	case 1: //sub
+		for (size_t i = 0; i < size; i += bpp)
+		{
+			a = _mm_add_epi8(loadPixel(row + i, bpp), a);
+			storePixel(row + i, a, bpp);
+		}
+		break;
+	case 3: //average, rounding down
+		for (size_t i = 0; i < size; i += bpp)
+		{
+			__m128i b = loadPixel(prev + i, bpp);
+			__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+			a = _mm_add_epi8(loadPixel(row + i, bpp), average);
+			storePixel(row + i, a, bpp);
+		}
+		break;
+	case 4: //paeth in 16 bits, ties go to a, then b, then c
+		for (size_t i = 0; i < size; i += bpp)
+		{
+			__m128i b = _mm_unpacklo_epi8(loadPixel(prev + i, bpp), zero);
+			__m128i a16 = _mm_unpacklo_epi8(a, zero);
+			__m128i p = _mm_sub_epi16(b, c);
+			__m128i q = _mm_sub_epi16(a16, c);
+			__m128i pa = absEpi16(p);
+			__m128i pb = absEpi16(q);
+			__m128i pc = absEpi16(_mm_add_epi16(p, q));
+			__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+			__m128i nearest = select(_mm_cmpeq_epi16(smallest, pa), a16, select(_mm_cmpeq_epi16(smallest, pb), b, c));
+			a = _mm_add_epi8(loadPixel(row + i, bpp), _mm_packus_epi16(nearest, nearest));
+			storePixel(row + i, a, bpp);
+			c = b;
+		}
+		break;
+	}
+}
+#endif
+
+static bool unfilterRow(int filter, uint8_t* row, const uint8_t* prev, size_t size, int bpp)
+{
+	if (filter == 0)
+		return true;
+	if (filter > 4)
+		return false;
+
+	//up has no dependency between pixels
+	if (filter == 2)
+	{
+		size_t i = 0;
+#ifdef PNGCODEC_SSE2
+		for (; i + 16 <= size; i += 16)
+			_mm_storeu_si128((__m128i*)(row + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*)(row + i)), _mm_loadu_si128((const __m128i*)(prev + i))));
+#endif
+		for (; i < size; ++i)
+			row[i] += prev[i];
+		return true;
+	}
+
+#ifdef PNGCODEC_SSE2
+	if (bpp == 3 || bpp == 4)
+	{
+		unfilterRowSSE2(filter, row, prev, size, bpp);
+		return true;
+	}
+#endif
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+		int b = prev[i];
+		int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+		if (filter == 1)
+			row[i] += (uint8_t)a;
+		else if (filter == 3)
+			row[i] += (uint8_t)((a + b) >> 1);
+		else
+			row[i] += (uint8_t)paeth(a, b, c);
+	}
+	return true;
+}
+
+// PNG ************************
+
+struct sPNGInfo
+{
+	int width;
+	int height;
+	int bit_depth;
+	int color_type; //0 gray, 2 RGB, 3 palette, 4 gray and alpha, 6 RGBA
+	int interlace;
+	int bytes_per_pixel; //of the output
+	uint8_t palette[256][4];
+	bool has_transparency;
+	uint16_t transparent_color[3]; //gray or RGB key of the tRNS chunk
+	std::vector<const uint8_t*> idat; //start of every IDAT chunk and its size
+	std::vector<uint32_t> idat_sizes;
+};
+
+static inline uint32_t readU32BE(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+
+static int getChannels(int color_type)
+{
+	switch (color_type)
+	{
+		case 0: case 3: return 1;
+		case 2: return 3;
+		case 4: return 2;
+		case 6: return 4;
+	}
+	return 0;
+}
+
+static bool parsePNG(const uint8_t* src, size_t size, sPNGInfo& info, bool read_data)
+{
+	static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	if (size < 8 + 25 || memcmp(src, signature, 8) != 0)
+		return false;
+
+	memset(info.palette, 0, sizeof(info.palette));
+	for (int i = 0; i < 256; ++i)
+		info.palette[i][3] = 255;
+	info.has_transparency = false;
+	info.width = 0;
+
+	const uint8_t* pos = src + 8;
+	const uint8_t* end = src + size;
+	while (end - pos >= 12)
+	{
+		uint32_t length = readU32BE(pos);
+		const uint8_t* type = pos + 4;
+		const uint8_t* data = pos + 8;
+		if (length > (size_t)(end - data) - 4)
+			return false;
+		pos = data + length + 4; //skips the CRC
+
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			if (length != 13)
+				return false;
+			info.width = (int)readU32BE(data);
+			info.height = (int)readU32BE(data + 4);
+			info.bit_depth = data[8];
+			info.color_type = data[9];
+			info.interlace = data[12];
+			int channels = getChannels(info.color_type);
+			bool valid_depth = info.bit_depth == 8 || info.bit_depth == 16 || ((info.color_type == 0 || info.color_type == 3) && info.bit_depth < 8 && (info.bit_depth & (info.bit_depth - 1)) == 0);
+			if (info.width <= 0 || info.height <= 0 || info.width > PNG_MAX_SIZE || info.height > PNG_MAX_SIZE || !channels || !valid_depth || (info.color_type == 3 && info.bit_depth == 16) || data[10] != 0 || data[11] != 0 || info.interlace > 1)
+				return false;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			for (uint32_t i = 0; i < length / 3 && i < 256; ++i)
+				memcpy(info.palette[i], data + i * 3, 3);
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			info.has_transparency = true;
+			if (info.color_type == 3)
+				for (uint32_t i = 0; i < length && i < 256; ++i)
+					info.palette[i][3] = data[i];
+			else if (info.color_type == 0 && length >= 2)
+				info.transparent_color[0] = (uint16_t)((data[0] << 8) | data[1]);
+			else if (info.color_type == 2 && length >= 6)
+				for (int c = 0; c < 3; ++c)
+					info.transparent_color[c] = (uint16_t)((data[c * 2] << 8) | data[c * 2 + 1]);
+			else
+				info.has_transparency = false;
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+		{
+			info.idat.push_back(data);
+			info.idat_sizes.push_back(length);
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+			break;
+		else if (!read_data && info.width)
+			break; //the header is all we need
+	}
+
+	if (!info.width)
+		return false;
+	info.bytes_per_pixel = info.color_type == 4 || info.color_type == 6 || info.has_transparency ? 4 : 3;
+	return !read_data || info.idat.size();
+}
+
+bool readPNGHeader(const uint8_t* src, size_t size, int& width, int& height, int& bytes_per_pixel)
+{
+	//the tRNS chunk is after the header, the whole chunk list is walked but no data is read
+	sPNGInfo info;
+	if (!parsePNG(src, size, info, true))
+		return false;
+	width = info.width;
+	height = info.height;
+	bytes_per_pixel = info.bytes_per_pixel;
+	return true;
+}
+
+//writes width texels of an unfiltered row at dst, every step bytes
+static void convertRow(const sPNGInfo& info, const uint8_t* row, int width, uint8_t* dst, size_t step)
+{
+	int out_bpp = info.bytes_per_pixel;
+	int depth = info.bit_depth;
+
+	//the common cases copy the row as it is
+	if (depth == 8 && step == (size_t)out_bpp && ((info.color_type == 6) || (info.color_type == 2 && !info.has_transparency)))
+	{
+		memcpy(dst, row, (size_t)width * out_bpp);
+		return;
+	}
+
+	int channels = getChannels(info.color_type);
+	int max_value = (1 << depth) - 1;
+	for (int x = 0; x < width; ++x, dst += step)
+	{
+		//samples of the pixel, 16 bits keep the high byte (the tRNS key is compared with the full value)
+		uint16_t samples[4];
+		for (int c = 0; c < channels; ++c)
+		{
+			if (depth == 16)
+			{
+				const uint8_t* p = row + ((size_t)x * channels + c) * 2;
+				samples[c] = (uint16_t)((p[0] << 8) | p[1]);
+			}
+			else if (depth == 8)
+				samples[c] = row[(size_t)x * channels + c];
+			else
+			{
+				size_t bit = (size_t)x * depth;
+				samples[c] = (uint16_t)((row[bit >> 3] >> (8 - depth - (bit & 7))) & max_value);
+			}
+		}
+
+		uint8_t rgba[4];
+		if (info.color_type == 3)
+			memcpy(rgba, info.palette[samples[0]], 4);
+		else
+		{
+			bool transparent = info.has_transparency && (info.color_type == 0 ? samples[0] == info.transparent_color[0] :
+				info.color_type == 2 && samples[0] == info.transparent_color[0] && samples[1] == info.transparent_color[1] && samples[2] == info.transparent_color[2]);
+			uint8_t values[4];
+			for (int c = 0; c < channels; ++c)
+				values[c] = depth == 16 ? (uint8_t)(samples[c] >> 8) : (depth == 8 ? (uint8_t)samples[c] : (uint8_t)(samples[c] * 255 / max_value));
+
+			if (channels <= 2) //gray
+			{
+				rgba[0] = rgba[1] = rgba[2] = values[0];
+				rgba[3] = channels == 2 ? values[1] : 255;
+			}
+			else
+			{
+				memcpy(rgba, values, 3);
+				rgba[3] = channels == 4 ? values[3] : 255;
+			}
+			if (transparent)
+				rgba[3] = 0;
+		}
+		memcpy(dst, rgba, out_bpp);
+	}
+}
+
+bool decodePNG(const uint8_t* src, size_t size, uint8_t* dst)
+{
+	sPNGInfo info;
+	if (!parsePNG(src, size, info, true))
+		return false;
+
+	//Adam7 passes: first x, first y, step x, step y
+	static const int passes[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+	static const int no_interlace[1][4] = { { 0, 0, 1, 1 } };
+	const int (*pass_list)[4] = info.interlace ? passes : no_interlace;
+	int num_passes = info.interlace ? 7 : 1;
+
+	int bits_per_pixel = getChannels(info.color_type) * info.bit_depth;
+	int filter_bpp = std::max(bits_per_pixel / 8, 1);
+	size_t expected = 0;
+	for (int p = 0; p < num_passes; ++p)
+	{
+		size_t pass_width = (info.width - pass_list[p][0] + pass_list[p][2] - 1) / pass_list[p][2];
+		size_t pass_height = (info.height - pass_list[p][1] + pass_list[p][3] - 1) / pass_list[p][3];
+		if (pass_width && pass_height)
+			expected += pass_height * (1 + (pass_width * bits_per_pixel + 7) / 8);
+	}
+
+	//the zlib stream can be split in several IDAT chunks
+	std::vector<uint8_t> joined;
+	const uint8_t* compressed = info.idat[0];
+	size_t compressed_size = info.idat_sizes[0];
+	if (info.idat.size() > 1)
+	{
+		for (size_t i = 0; i < info.idat.size(); ++i)
+			joined.insert(joined.end(), info.idat[i], info.idat[i] + info.idat_sizes[i]);
+		compressed = &joined[0];
+		compressed_size = joined.size();
+	}
+
+	//the rows cannot be bigger than the image, a stream that inflates beyond it is rejected
+	std::vector<uint8_t> raw;
+	if (!inflateZlib(compressed, compressed_size, raw, expected, expected) || raw.size() < expected)
+		return false;
+
+	int out_bpp = info.bytes_per_pixel;
+	size_t dst_row = (size_t)info.width * out_bpp;
+	uint8_t* pos = &raw[0];
+	std::vector<uint8_t> zero_row;
+	for (int p = 0; p < num_passes; ++p)
+	{
+		int x0 = pass_list[p][0], y0 = pass_list[p][1], dx = pass_list[p][2], dy = pass_list[p][3];
+		int pass_width = (info.width - x0 + dx - 1) / dx;
+		int pass_height = (info.height - y0 + dy - 1) / dy;
+		if (pass_width <= 0 || pass_height <= 0)
+			continue;
+
+		//the first row of every pass is unfiltered against zeros
+		size_t row_size = ((size_t)pass_width * bits_per_pixel + 7) / 8;
+		zero_row.assign(row_size, 0);
+		const uint8_t* prev = &zero_row[0];
+		for (int y = 0; y < pass_height; ++y)
+		{
+			uint8_t* row = pos + 1;
+			if (!unfilterRow(pos[0], row, prev, row_size, filter_bpp))
+				return false;
+			convertRow(info, row, pass_width, dst + (size_t)(y0 + y * dy) * dst_row + (size_t)x0 * out_bpp, (size_t)dx * out_bpp);
+			prev = row;
+			pos += 1 + row_size;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+/*
+	PNG decoding: zlib inflate, row unfiltering (SSE2 for 3 and 4 bytes per pixel) and conversion to 8 bits per channel.
+	All the color types, bit depths and Adam7 interlacing are read, the CRCs and the adler32 are not checked.
+	A decode runs in the calling thread, Texture::GetAsync decodes one file per worker.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define PNG_MAX_SIZE 16384 //width or height, bigger images are rejected before allocating them
+
+//zlib stream (RFC 1950/1951), expected_size only reserves the output, false if it is corrupted or inflates beyond max_size
+bool inflateZlib(const uint8_t* src, size_t size, std::vector<uint8_t>& out, size_t expected_size = 0, size_t max_size = SIZE_MAX);
+
+//bytes_per_pixel is 4 if the image has alpha or a transparency chunk, 3 otherwise
+bool readPNGHeader(const uint8_t* src, size_t size, int& width, int& height, int& bytes_per_pixel);
+
+//dst must have width * height * bytes_per_pixel bytes, the rows are stored from the top
+bool decodePNG(const uint8_t* src, size_t size, uint8_t* dst);
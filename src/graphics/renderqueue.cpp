@@ -0,0 +1,119 @@
+#include "renderqueue.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "mesh.h"
+#include "material.h"
+#include "shader.h"
+#include "../framework/camera.h"
+
+void RenderQueue::clear()
+{
+	this->items.clear();
+	this->entries.clear();
+}
+
+void RenderQueue::submit(Mesh* mesh, Material* material, const glm::mat4& model, Camera* camera, eRenderPass pass)
+{
+	if (!mesh || !material || !material->shader || !material->shader->compiled)
+		return;
+
+	float depth = glm::length(glm::vec3(model[3]) - camera->eye) / camera->far_plane;
+
+	sSortEntry entry;
+	entry.key = ComputeKey(pass, mesh, material, depth);
+	entry.index = (uint32_t)this->items.size();
+	this->entries.push_back(entry);
+
+	sDrawItem item;
+	item.mesh = mesh;
+	item.material = material;
+	item.model = model;
+	this->items.push_back(item);
+}
+
+//depth is normalized (0 near, 1 far), opaque draws go front to back to help the early z test
+uint64_t RenderQueue::ComputeKey(eRenderPass pass, Mesh* mesh, Material* material, float depth)
+{
+	uint64_t depth_bits = (uint64_t)(std::clamp(depth, 0.f, 1.f) * ((1 << RENDER_KEY_DEPTH_BITS) - 1));
+	uint64_t shader_id = material->shader->handle.index & 0xFFFF;
+	uint64_t material_id = material->id & 0xFFFF;
+	uint64_t mesh_id = mesh->handle.index & 0xFFFF; //meshes not registered share the last bucket
+
+	return ((uint64_t)pass << 60) | (shader_id << 44) | (material_id << 28) | (mesh_id << RENDER_KEY_DEPTH_BITS) | depth_bits;
+}
+
+//LSD radix sort, 8 bits per pass, the passes where all the keys have the same byte are skipped
+void RenderQueue::sort()
+{
+	size_t num = this->entries.size();
+	if (num < 2)
+		return;
+
+	this->scratch.resize(num);
+	sSortEntry* src = &this->entries[0];
+	sSortEntry* dst = &this->scratch[0];
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256];
+		memset(counts, 0, sizeof(counts));
+		for (size_t i = 0; i < num; ++i)
+			counts[(src[i].key >> shift) & 0xFF]++;
+
+		if (counts[(src[0].key >> shift) & 0xFF] == num)
+			continue;
+
+		size_t offset = 0;
+		for (int b = 0; b < 256; ++b)
+		{
+			size_t count = counts[b];
+			counts[b] = offset;
+			offset += count;
+		}
+
+		for (size_t i = 0; i < num; ++i)
+			dst[counts[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+		std::swap(src, dst);
+	}
+
+	if (src != &this->entries[0])
+		this->entries.swap(this->scratch);
+}
+
+void RenderQueue::render(Camera* camera)
+{
+	this->num_draws = this->num_shader_changes = this->num_material_changes = 0;
+
+	Shader* current_shader = NULL;
+	Material* current_material = NULL;
+
+	for (size_t i = 0; i < this->entries.size(); ++i)
+	{
+		sDrawItem& item = this->items[this->entries[i].index];
+		Material* material = item.material;
+
+		if (material->shader != current_shader)
+		{
+			current_shader = material->shader;
+			current_shader->enable();
+			current_material = NULL; //uniforms belong to the program
+			this->num_shader_changes++;
+		}
+
+		if (material != current_material)
+		{
+			current_material = material;
+			material->bind();
+			this->num_material_changes++;
+		}
+
+		material->draw(item.mesh, item.model, camera);
+		this->num_draws++;
+	}
+
+	if (current_shader)
+		current_shader->disable();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/matrix.hpp>
+
+class Mesh;
+class Material;
+class Camera;
+
+enum eRenderPass { RENDER_PASS_OPAQUE = 0, RENDER_PASS_WIREFRAME = 1 };
+
+//sort key, from most to least significant: pass (4 bits) | shader (16) | material (16) | mesh (16) | depth (12)
+#define RENDER_KEY_DEPTH_BITS 12
+
+struct sDrawItem
+{
+	Mesh* mesh;
+	Material* material;
+	glm::mat4 model;
+};
+
+//Collects the draws of a frame, sorts them by state and submits them skipping the redundant changes
+class RenderQueue
+{
+public:
+	std::vector<sDrawItem> items;
+
+	//stats of the last render
+	unsigned int num_draws = 0;
+	unsigned int num_shader_changes = 0;
+	unsigned int num_material_changes = 0;
+
+	void clear();
+	void submit(Mesh* mesh, Material* material, const glm::mat4& model, Camera* camera, eRenderPass pass = RENDER_PASS_OPAQUE);
+	void sort(); //radix sort of the keys
+	void render(Camera* camera);
+
+	static uint64_t ComputeKey(eRenderPass pass, Mesh* mesh, Material* material, float depth);
+
+private:
+	struct sSortEntry
+	{
+		uint64_t key;
+		uint32_t index; //in items
+	};
+	std::vector<sSortEntry> entries;
+	std::vector<sSortEntry> scratch;
+};
@@ -7,11 +7,21 @@
 #include <functional> 
 #include <cctype>
 #include <locale>
+#include <unordered_map>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
 
 #include "texture.h"
+#include "../framework/filewatcher.h"
 
 std::string Shader::s_shader_atlas_filename;
 std::map<std::string, std::string> Shader::s_shaders_atlas;
+std::string Shader::s_binary_cache_folder = "cache/shaders/";
+bool Shader::s_hot_reload = true;
+std::vector<std::pair<Shader*, Shader*>> Shader::s_reloading;
+FileWatcher* Shader::s_watcher = NULL;
+unsigned int Shader::s_used_uniform_blocks = 0;
 
 
 //typedef unsigned int GLhandle;
@@ -54,20 +64,48 @@ REGISTER_GLEXT(void, glUniformMatrix4fv, GLint location, GLsizei count, GLboolea
 
 #endif
 
-std::map<std::string, Shader*> Shader::s_Shaders;
+//FNV-1a, the separator keeps "ab"+"c" and "a"+"bc" apart
+static void hashBytes(uint64_t& hash, const char* str, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ (uint8_t)str[i]) * 1099511628211ULL;
+	hash = (hash ^ 0xFF) * 1099511628211ULL;
+}
+
+static uint64_t hashSources(const std::string& vsm, const std::string& psm)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	hashBytes(hash, vsm.c_str(), vsm.size());
+	hashBytes(hash, psm.c_str(), psm.size());
+	return hash;
+}
+
 bool Shader::s_ready = false;
 Shader* Shader::current = NULL;
+std::vector<Shader*> Shader::s_pending;
 
-Shader::Shader()
+Shader::Shader() : Resource(RESOURCE_SHADER)
 {
 	if (!Shader::s_ready)
 		Shader::init();
 	compiled = false;
+	fixed_attributes = false;
+	uniform_blocks = 0;
 	from_atlas = false;
+	vs = fs = program = 0;
+	binary_key = 0;
+	source_hash = 0;
 }
 
 Shader::~Shader()
 {
+	for (size_t i = 0; i < s_reloading.size(); ++i)
+		if (s_reloading[i].first == this)
+		{
+			delete s_reloading[i].second;
+			s_reloading.erase(s_reloading.begin() + i);
+			break;
+		}
 	release();
 }
 
@@ -78,6 +116,97 @@ void Shader::setFilenames(const std::string& vsf, const std::string& psf)
 }
 
 bool Shader::load(const std::string& vsf, const std::string& psf, const char* macros)
+{
+	if (!submitFiles(vsf, psf, macros))
+		return false;
+	if (!resolve())
+		return false;
+
+	assert(glGetError() == GL_NO_ERROR);
+
+	return true;
+}
+
+//reads a shader file replacing its #include "file" lines, the paths are relative to the file that includes them
+//every file is included once per source, so several files can include the same one
+static bool readSource(const std::string& filename, std::string& code, std::vector<std::string>& dependencies, std::vector<std::string>& included, int depth = 0)
+{
+	std::string name = FileWatcher::Normalize(filename);
+	included.push_back(name);
+	if (std::find(dependencies.begin(), dependencies.end(), name) == dependencies.end())
+		dependencies.push_back(name);
+
+	std::string content;
+	if (!readFile(name, content))
+		return false;
+
+	if (content.find("#include") == std::string::npos)
+	{
+		code = content;
+		return true;
+	}
+
+	std::string folder = std::filesystem::path(name).parent_path().generic_string();
+	if (!folder.empty())
+		folder += "/";
+
+	code.clear();
+	std::vector<std::string> lines = split(content, '\n');
+	for (const std::string& line : lines)
+	{
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+		{
+			code += line + "\n";
+			continue;
+		}
+
+		size_t open = line.find('"', start);
+		size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos)
+		{
+			std::cout << "[ERROR] Wrong #include in " << name << ": " << line << std::endl;
+			return false;
+		}
+
+		std::string include = FileWatcher::Normalize(folder + line.substr(open + 1, close - open - 1));
+		if (std::find(included.begin(), included.end(), include) != included.end())
+		{
+			code += "\n"; //already there, this also stops the cycles
+			continue;
+		}
+
+		std::string include_code;
+		if (depth >= 16 || !readSource(include, include_code, dependencies, included, depth + 1))
+		{
+			std::cout << "[ERROR] Shader #include not found: " << include << " in " << name << std::endl;
+			return false;
+		}
+		code += include_code + "\n";
+	}
+	return true;
+}
+
+//the macros must go after the #version line, only comments can be before it
+static std::string injectMacros(const std::string& code, const std::string& macros)
+{
+	if (macros.empty())
+		return code;
+
+	std::string block = macros;
+	if (block.back() != '\n')
+		block += "\n";
+
+	size_t pos = code.find("#version");
+	if (pos == std::string::npos)
+		return block + code;
+	size_t end = code.find('\n', pos);
+	if (end == std::string::npos)
+		return code + "\n" + block;
+	return code.substr(0, end + 1) + block + code.substr(end + 1);
+}
+
+bool Shader::submitFiles(const std::string& vsf, const std::string& psf, const char* macros)
 {
 	assert(compiled == false);
 	assert(glGetError() == GL_NO_ERROR);
@@ -85,32 +214,44 @@ bool Shader::load(const std::string& vsf, const std::string& psf, const char* ma
 	vs_filename = vsf;
 	ps_filename = psf;
 	from_atlas = false;
+	this->macros = macros ? macros : "";
 
 	bool printMacros = false;
 
 	std::cout << " + Shader: Vertex: " << vsf << "  Pixel: " << psf << "  " << (macros && printMacros ? macros : "") << std::endl;
 	std::string vsm, psm;
-	if (!readFile(vsf, vsm) || !readFile(psf, psm))
+	std::vector<std::string> vs_included, ps_included;
+	dependencies.clear();
+	bool read = readSource(vsf, vsm, dependencies, vs_included);
+	read = readSource(psf, psm, dependencies, ps_included) && read;
+	WatchFiles(dependencies); //also when one is missing, creating it reloads the shader
+	if (!read)
 		return false;
 
 	//printf("Vertex shader from memory:\n%s\n", vsm.c_str());
 	//printf("Fragment shader from memory:\n%s\n", psm.c_str());
 	if (macros)
 	{
-		vsm = macros + vsm;
-		psm = macros + psm;
-		this->macros = macros;
+		vsm = injectMacros(vsm, macros);
+		psm = injectMacros(psm, macros);
 	}
 
-	if (!compileFromMemory(vsm, psm))
-		return false;
-
-	assert(glGetError() == GL_NO_ERROR);
-
-	return true;
+	return submit(vsm, psm);
 }
 
 Shader* Shader::Get(const char* vsf, const char* psf, const char* macros)
+{
+	//failed shaders stay registered so a reload can fix them
+	Shader* sh = GetAsync(vsf, psf, macros);
+	if (sh && !sh->resolve())
+	{
+		sh->removeRef();
+		return NULL;
+	}
+	return sh;
+}
+
+Shader* Shader::GetAsync(const char* vsf, const char* psf, const char* macros)
 {
 	std::string name;
 
@@ -118,27 +259,149 @@ Shader* Shader::Get(const char* vsf, const char* psf, const char* macros)
 		name = std::string(vsf) + "," + std::string(psf ? psf : "") + (macros ? macros : "");
 	else
 		name = vsf;
-	std::map<std::string, Shader*>::iterator it = s_Shaders.find(name);
-	if (it != s_Shaders.end())
-		return it->second;
+	Shader* loaded = (Shader*)ResourceManager::Find(name, RESOURCE_SHADER);
+	if (loaded)
+	{
+		loaded->addRef();
+		return loaded;
+	}
 
 	if (!psf)
 		return NULL;
 
 	Shader* sh = new Shader();
-	if (!sh->load(vsf, psf, macros))
+	if (!sh->submitFiles(vsf, psf, macros))
+	{
+		delete sh;
 		return NULL;
-	s_Shaders[name] = sh;
+	}
+	ResourceManager::Register(name, sh);
+	sh->addRef();
 	return sh;
 }
 
+//the shaders keep drawing with their old program until the new one is ready
 void Shader::ReloadAll()
 {
-	for (std::map<std::string, Shader*>::iterator it = s_Shaders.begin(); it != s_Shaders.end(); it++)
-		it->second->recompile();
+	ResourceManager::ForEach(RESOURCE_SHADER, [](Resource* resource) {
+		((Shader*)resource)->reloadAsync();
+	});
 	if (!s_shader_atlas_filename.empty())
 		LoadAtlas(s_shader_atlas_filename.c_str());
-	std::cout << "Shaders recompiled" << std::endl;
+	std::cout << "Shaders reloading: " << s_reloading.size() << std::endl;
+}
+
+void Shader::WatchFiles(const std::vector<std::string>& filenames)
+{
+	if (!s_hot_reload)
+		return;
+	if (!s_watcher)
+		s_watcher = new FileWatcher();
+	for (const std::string& filename : filenames)
+		s_watcher->addFile(filename);
+}
+
+//atlas shaders are reloaded by LoadAtlas, it knows their sources
+void Shader::reloadAsync()
+{
+	if (from_atlas || !vs_filename.size() || !ps_filename.size())
+		return;
+
+	Shader* staging = new Shader();
+	if (!staging->submitFiles(vs_filename, ps_filename, macros.size() ? macros.c_str() : NULL))
+	{
+		std::cout << "[ERROR] Shader not reloaded: " << vs_filename << ", " << ps_filename << std::endl;
+		delete staging;
+		return;
+	}
+	beginReload(staging);
+}
+
+//a newer staging program replaces the one still compiling
+void Shader::beginReload(Shader* staging)
+{
+	for (auto& entry : s_reloading)
+		if (entry.first == this)
+		{
+			delete entry.second;
+			entry.second = staging;
+			return;
+		}
+	s_reloading.push_back(std::make_pair(this, staging));
+}
+
+bool Shader::isReloading() const
+{
+	for (const auto& entry : s_reloading)
+		if (entry.first == this)
+			return true;
+	return false;
+}
+
+//takes the program of other, which gets the old one and deletes it with itself
+void Shader::swapProgram(Shader* other)
+{
+	assert(other->compiled && !other->isPending());
+	if (current == this)
+		current = NULL; //the next enable binds the new program
+
+	std::swap(vs, other->vs);
+	std::swap(fs, other->fs);
+	std::swap(program, other->program);
+	std::swap(compiled, other->compiled);
+	std::swap(fixed_attributes, other->fixed_attributes);
+	std::swap(uniform_blocks, other->uniform_blocks);
+	std::swap(source_hash, other->source_hash);
+	std::swap(dependencies, other->dependencies);
+	std::swap(info_log, other->info_log);
+	locations.swap(other->locations);
+	uniform_slots.swap(other->uniform_slots);
+}
+
+void Shader::UpdateHotReload()
+{
+	std::vector<std::string> changed;
+	if (s_watcher && s_watcher->poll(changed))
+	{
+		for (const std::string& filename : changed)
+			std::cout << " + Shader file changed: " << filename << std::endl;
+
+		if (!s_shader_atlas_filename.empty() && std::find(changed.begin(), changed.end(), FileWatcher::Normalize(s_shader_atlas_filename)) != changed.end())
+			LoadAtlas(s_shader_atlas_filename.c_str());
+
+		//only the programs that read one of the files
+		ResourceManager::ForEach(RESOURCE_SHADER, [&changed](Resource* resource) {
+			Shader* shader = (Shader*)resource;
+			for (const std::string& dependency : shader->dependencies)
+				if (std::find(changed.begin(), changed.end(), dependency) != changed.end())
+				{
+					shader->reloadAsync();
+					return;
+				}
+		});
+	}
+
+	//swap the ones the driver finished, without waiting for the rest
+	for (size_t i = 0; i < s_reloading.size(); )
+	{
+		Shader* shader = s_reloading[i].first;
+		Shader* staging = s_reloading[i].second;
+		if (!staging->isCompletionAvailable())
+		{
+			++i;
+			continue;
+		}
+		s_reloading.erase(s_reloading.begin() + i);
+
+		if (staging->resolve())
+		{
+			shader->swapProgram(staging);
+			std::cout << " + Shader reloaded: " << shader->vs_filename << ", " << shader->ps_filename << std::endl;
+		}
+		else
+			std::cout << "[ERROR] Shader reload failed, keeping the previous program: " << shader->vs_filename << ", " << shader->ps_filename << std::endl;
+		delete staging;
+	}
 }
 
 //functions to trim strings
@@ -210,8 +473,9 @@ bool Shader::LoadAtlas(const char* filename)
 	}
 	s_shaders_atlas[subfile_name] = subfile_content;
 
-	//compile shaders
+	//compile shaders, all of them are submitted before checking any
 	std::string shaders = s_shaders_atlas[""];
+	std::vector<std::pair<std::string, Shader*>> submitted;
 
 	lines = tokenize(shaders, "\n");
 	for (int i = 0; i < lines.size(); ++i)
@@ -239,34 +503,54 @@ bool Shader::LoadAtlas(const char* filename)
 			continue;
 		}
 
-		vs_code = macros + "\n" + vs_code;
-		fs_code = macros + "\n" + fs_code;
+		vs_code = injectMacros(vs_code, macros);
+		fs_code = injectMacros(fs_code, macros);
 
-		Shader* shader = NULL;
-		auto it = s_Shaders.find(name);
-		if (it == s_Shaders.end())
+		//when reloading, the shaders that did not change keep their program and the others are swapped once compiled
+		Shader* shader = (Shader*)ResourceManager::Find(name, RESOURCE_SHADER);
+		Shader* target = shader;
+		if (shader && shader->compiled && shader->source_hash == hashSources(vs_code, fs_code))
+			continue;
+		if (shader)
+			target = new Shader();
+		else
 		{
-			shader = new Shader();
-			s_Shaders[name] = shader;
+			shader = target = new Shader();
+			ResourceManager::Register(name, shader);
 		}
-		else
-			shader = it->second;
 
-		if (!shader->compileFromMemory(vs_code, fs_code))
+		target->vs_filename = vs_filename;
+		target->ps_filename = fs_filename;
+		target->from_atlas = true;
+		target->dependencies.assign(1, FileWatcher::Normalize(filename));
+		WatchFiles(target->dependencies);
+		if (!target->submit(vs_code, fs_code))
 		{
-			delete shader;
-			std::cout << " * Compilation error in shader at atlas: " << name << std::endl;
-			return false; //stop here
+			if (target != shader)
+				delete target;
 			continue;
 		}
 
-		shader->vs_filename = vs_filename;
-		shader->ps_filename = fs_filename;
-		shader->from_atlas = true;
-		std::cout << " + Shader from atlas: " << name << std::endl;
+		if (target != shader)
+			shader->beginReload(target);
+		else
+			submitted.push_back(std::make_pair(name, shader));
 	}
 
-	return true;
+	//the driver compiled them meanwhile
+	bool all_ok = true;
+	for (auto& entry : submitted)
+	{
+		if (!entry.second->resolve())
+		{
+			std::cout << " * Compilation error in shader at atlas: " << entry.first << std::endl;
+			all_ok = false;
+			continue;
+		}
+		std::cout << " + Shader from atlas: " << entry.first << std::endl;
+	}
+
+	return all_ok;
 }
 
 bool Shader::compile()
@@ -296,6 +580,14 @@ bool Shader::hasInfoLog() const
 // ******************************************
 
 bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
+{
+	if (!submit(vsm, psm))
+		return false;
+	return resolve();
+}
+
+//starts the compilation and the link without asking for the result, so the driver can work on several programs at once
+bool Shader::submit(const std::string& vsm, const std::string& psm)
 {
 	if (glCreateProgram == 0)
 	{
@@ -303,24 +595,81 @@ bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
 		exit(0);
 	}
 
+	source_hash = hashSources(vsm, psm);
+
+	//the same source already linked by this driver
+	bool use_binary_cache = !s_binary_cache_folder.empty() && GLEW_ARB_get_program_binary;
+	binary_key = use_binary_cache ? ComputeBinaryKey(vsm, psm) : 0;
+	if (use_binary_cache && loadBinary(binary_key))
+	{
+		binary_key = 0; //nothing to save
+		fixed_attributes = checkAttributeLocations();
+		bindUniformBlocks();
+		compiled = true;
+		return true;
+	}
+
 	program = glCreateProgram();
 	assert(glGetError() == GL_NO_ERROR);
+	if (use_binary_cache)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
-	if (!createVertexShaderObject(vsm))
+	createVertexShaderObject(vsm);
+	createFragmentShaderObject(psm);
+
+	bindAttributeLocations();
+	glLinkProgram(program);
+	assert(glGetError() == GL_NO_ERROR);
+
+	//kept to show the lines if it fails
+	pending_vs = vsm;
+	pending_ps = psm;
+	s_pending.push_back(this);
+	return true;
+}
+
+bool Shader::isPending() const
+{
+	return std::find(s_pending.begin(), s_pending.end(), this) != s_pending.end();
+}
+
+//without the parallel compile extension the first status query waits for the driver
+bool Shader::isCompletionAvailable()
+{
+	if (!isPending() || !(GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile))
+		return true;
+
+	GLint done = 0;
+	glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+	return done != 0;
+}
+
+//waits for the program submitted and checks the result
+bool Shader::resolve()
+{
+	auto it = std::find(s_pending.begin(), s_pending.end(), this);
+	if (it == s_pending.end())
+		return compiled;
+	s_pending.erase(it);
+
+	std::string vsm, psm;
+	vsm.swap(pending_vs);
+	psm.swap(pending_ps);
+
+	if (!checkShaderObject(vs, vsm))
 	{
 		printf("Vertex shader compilation failed\n");
+		release();
 		return false;
 	}
 
-	if (!createFragmentShaderObject(psm))
+	if (!checkShaderObject(fs, psm))
 	{
 		printf("Fragment shader compilation failed\n");
+		release();
 		return false;
 	}
 
-	glLinkProgram(program);
-	assert(glGetError() == GL_NO_ERROR);
-
 	GLint linked = 0;
 
 	glGetProgramiv(program, GL_LINK_STATUS, &linked);
@@ -337,11 +686,192 @@ bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
 	validate();
 #endif
 
+	fixed_attributes = checkAttributeLocations();
+	bindUniformBlocks();
 	compiled = true;
 
+	if (binary_key)
+		saveBinary(binary_key);
+	binary_key = 0;
+
 	return true;
 }
 
+bool Shader::ResolveAll()
+{
+	bool all_ok = true;
+	while (s_pending.size())
+	{
+		Shader* shader = s_pending.front();
+		if (!shader->resolve())
+		{
+			std::cout << "[ERROR] Shader failed: " << shader->vs_filename << ", " << shader->ps_filename << std::endl;
+			all_ok = false;
+		}
+	}
+	return all_ok;
+}
+
+//indexed by location, NULL for the extra locations of the instanced model
+static const char* attribute_names[] = { "a_vertex", "a_normal", "a_uv", "a_color", "a_uv1", "a_bones", "a_weights", "u_model", NULL, NULL, NULL, "a_draw_id" };
+
+//must be called before linking, names not used by the shader are ignored
+void Shader::bindAttributeLocations()
+{
+	for (int i = 0; i < VERTEX_ATTRIB_COUNT; ++i)
+		if (attribute_names[i])
+			glBindAttribLocation(program, i, attribute_names[i]);
+}
+
+//shaders with explicit layout qualifiers can override the locations, those cannot use the mesh VAOs
+bool Shader::checkAttributeLocations()
+{
+	for (int i = 0; i < VERTEX_ATTRIB_COUNT; ++i)
+	{
+		if (!attribute_names[i])
+			continue;
+		int loc = glGetAttribLocation(program, attribute_names[i]);
+		if (loc != -1 && loc != i)
+			return false;
+	}
+	return true;
+}
+
+static const char* uniform_block_names[] = { "FrameBlock", "LightBlock", "ObjectBlock", "LightsBlock", "ClusterBlock" };
+
+//shaders without layout(binding = X) still get the right binding points
+void Shader::bindUniformBlocks()
+{
+	uniform_blocks = 0;
+	for (int i = 0; i < UNIFORM_BLOCK_COUNT; ++i)
+	{
+		GLuint index = glGetUniformBlockIndex(program, uniform_block_names[i]);
+		if (index == GL_INVALID_INDEX)
+			continue;
+		glUniformBlockBinding(program, index, i);
+		uniform_blocks |= 1 << i;
+	}
+	s_used_uniform_blocks |= uniform_blocks;
+}
+
+#define SHADER_BINARY_VERSION 1 //change it if the way programs are linked changes
+
+struct sShaderBinaryHeader
+{
+	char magic[4]; //SBIN
+	uint32_t version;
+	uint64_t key;
+	uint32_t format; //driver specific
+	uint32_t size;
+};
+
+//FNV-1a of the final sources, the attribute locations and the driver, any change gives a different file
+uint64_t Shader::ComputeBinaryKey(const std::string& vsm, const std::string& psm)
+{
+	uint64_t hash = hashSources(vsm, psm);
+	auto add = [&hash](const char* str, size_t size) { hashBytes(hash, str, size); };
+
+	for (int i = 0; i < VERTEX_ATTRIB_COUNT; ++i)
+		if (attribute_names[i])
+			add(attribute_names[i], strlen(attribute_names[i]));
+
+	GLenum driver_strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (GLenum name : driver_strings)
+	{
+		const char* str = (const char*)glGetString(name);
+		if (str)
+			add(str, strlen(str));
+	}
+
+	uint32_t version = SHADER_BINARY_VERSION;
+	add((const char*)&version, sizeof(version));
+	return hash;
+}
+
+static std::string getBinaryFilename(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return Shader::s_binary_cache_folder + name;
+}
+
+bool Shader::loadBinary(uint64_t key)
+{
+	std::string filename = getBinaryFilename(key);
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (!file)
+		return false;
+
+	sShaderBinaryHeader header;
+	std::vector<uint8_t> data;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "SBIN", 4) == 0 &&
+		header.version == SHADER_BINARY_VERSION && header.key == key && header.size > 0;
+	if (valid)
+	{
+		data.resize(header.size);
+		valid = fread(&data[0], 1, header.size, file) == header.size;
+	}
+	fclose(file);
+
+	if (valid)
+	{
+		program = glCreateProgram();
+		glProgramBinary(program, header.format, &data[0], header.size);
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		valid = linked != 0;
+		if (!valid)
+		{
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+
+	//drivers can reject old binaries even with the same strings, it will be written again
+	if (!valid)
+	{
+		glGetError();
+		std::remove(filename.c_str());
+	}
+	return valid;
+}
+
+void Shader::saveBinary(uint64_t key)
+{
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return;
+
+	std::vector<uint8_t> data(size);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, size, &written, &format, &data[0]);
+	if (!written)
+		return;
+
+	std::error_code error;
+	std::filesystem::create_directories(s_binary_cache_folder, error);
+
+	std::string filename = getBinaryFilename(key);
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (!file)
+	{
+		std::cout << "[WARN] Cannot write shader binary: " << filename << std::endl;
+		return;
+	}
+
+	sShaderBinaryHeader header;
+	memcpy(header.magic, "SBIN", 4);
+	header.version = SHADER_BINARY_VERSION;
+	header.key = key;
+	header.format = format;
+	header.size = (uint32_t)written;
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&data[0], 1, written, file);
+	fclose(file);
+}
+
 bool Shader::validate()
 {
 	glValidateProgram(program);
@@ -376,16 +906,22 @@ bool Shader::createShaderObject(unsigned int type, GLuint& handle, const std::st
 	handle = glCreateShader(type);
 	assert(glGetError() == GL_NO_ERROR);
 
-	std::string prefix = "";//"#define DESKTOP\n";
-
-	std::string fullcode = prefix + code;
-	const char* ptr = fullcode.c_str();
+	const char* ptr = code.c_str();
 	glShaderSource(handle, 1, &ptr, NULL);
 	assert(glGetError() == GL_NO_ERROR);
 
 	glCompileShader(handle);
 	assert(glGetError() == GL_NO_ERROR);
 
+	//the status is checked in resolve, a shader that failed only makes the link fail
+	glAttachShader(program, handle);
+	assert(glGetError() == GL_NO_ERROR);
+
+	return true;
+}
+
+bool Shader::checkShaderObject(GLuint handle, const std::string& code)
+{
 	GLint compile = 0;
 	glGetShaderiv(handle, GL_COMPILE_STATUS, &compile);
 	assert(glGetError() == GL_NO_ERROR);
@@ -395,22 +931,26 @@ bool Shader::createShaderObject(unsigned int type, GLuint& handle, const std::st
 	{
 		saveShaderInfoLog(handle);
 		std::cout << "Shader code:\n " << std::endl;
-		std::vector<std::string> lines = split(fullcode, '\n');
+		std::vector<std::string> lines = split(code, '\n');
 		for (size_t i = 0; i < lines.size(); ++i)
 			std::cout << i << "  " << lines[i] << std::endl;
 
 		return false;
 	}
 
-	glAttachShader(program, handle);
-	assert(glGetError() == GL_NO_ERROR);
-
 	return true;
 }
 
 
 void Shader::release()
 {
+	auto it = std::find(s_pending.begin(), s_pending.end(), this);
+	if (it != s_pending.end())
+		s_pending.erase(it);
+	pending_vs.clear();
+	pending_ps.clear();
+	binary_key = 0;
+
 	if (vs)
 	{
 		glDeleteShader(vs);
@@ -433,8 +973,11 @@ void Shader::release()
 	}
 
 	locations.clear();
+	uniform_slots.clear();
 
 	compiled = false;
+	fixed_attributes = false;
+	uniform_blocks = 0;
 }
 
 
@@ -443,6 +986,10 @@ void Shader::enable()
 	if (current == this)
 		return;
 
+	//submitted with GetAsync and not resolved yet
+	if (!compiled && program)
+		resolve();
+
 	current = this;
 
 	glUseProgram(program);
@@ -539,6 +1086,59 @@ GLint Shader::getLocation(const char* varname, loctable* table)
 	return loc;
 }
 
+//function statics so handles can be created during static initialization of other files
+static std::vector<std::string>& uniformNames()
+{
+	static std::vector<std::string> names;
+	return names;
+}
+
+static std::unordered_map<std::string, int>& uniformIds()
+{
+	static std::unordered_map<std::string, int> ids;
+	return ids;
+}
+
+UniformHandle Shader::GetUniform(const char* varname)
+{
+	assert(varname);
+	UniformHandle uniform;
+	auto it = uniformIds().find(varname);
+	if (it != uniformIds().end())
+		uniform.id = it->second;
+	else
+	{
+		uniform.id = (int)uniformNames().size();
+		uniformNames().push_back(varname);
+		uniformIds()[varname] = uniform.id;
+	}
+	return uniform;
+}
+
+GLint Shader::resolveLocation(UniformHandle uniform)
+{
+	assert(uniform.isValid() && "uniform handle not initialized");
+	if (!uniform.isValid() || !program)
+		return -1;
+
+	if (uniform_slots.size() <= (size_t)uniform.id)
+		uniform_slots.resize(uniformNames().size(), UNIFORM_NOT_RESOLVED);
+
+	GLint loc = glGetUniformLocation(program, uniformNames()[uniform.id].c_str());
+	uniform_slots[uniform.id] = loc;
+	return loc;
+}
+
+void Shader::setUniform(UniformHandle uniform, Texture* texture, int slot)
+{
+	assert(current == this);
+	GLint loc = getLocation(uniform);
+	CHECK_SHADER_VAR(loc, uniform);
+	glActiveTexture(GL_TEXTURE0 + slot);
+	glBindTexture(texture->texture_type, texture->texture_id);
+	glUniform1i(loc, slot);
+}
+
 int Shader::getAttribLocation(const char* varname)
 {
 	int loc = glGetAttribLocation(program, varname);
@@ -780,6 +1380,12 @@ void Shader::init()
 		IMPORT_GLEXT(glUniform4fv);
 		IMPORT_GLEXT(glUniformMatrix4fv);
 #endif
+
+		//let the driver use all the threads it wants for the submitted shaders
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else if (GLEW_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 	}
 
 	firsttime = false;
@@ -787,9 +1393,9 @@ void Shader::init()
 
 Shader* Shader::getDefaultShader(std::string name)
 {
-	auto it = s_Shaders.find(name);
-	if (it != s_Shaders.end())
-		return it->second;
+	Shader* loaded = (Shader*)ResourceManager::Find(name, RESOURCE_SHADER);
+	if (loaded)
+		return loaded;
 
 	std::string vs = "";
 	std::string fs = "";
@@ -947,6 +1553,8 @@ Shader* Shader::getDefaultShader(std::string name)
 	sh->setUniform4("u_color", glm::vec4(1, 1, 1, 1));
 	sh->disable();
 
-	s_Shaders[name] = sh;
+	//default shaders are kept for the whole execution
+	ResourceManager::Register(name, sh);
+	sh->addRef();
 	return sh;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "../framework/includes.h"
+#include "../framework/resourcemanager.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -22,8 +23,50 @@
 #endif
 
 class Texture;
+class FileWatcher;
+
+//fixed attribute locations, every shader is linked with them so meshes can keep their layout in a VAO
+enum eVertexAttribute {
+	VERTEX_ATTRIB_POSITION = 0,	//a_vertex
+	VERTEX_ATTRIB_NORMAL,		//a_normal
+	VERTEX_ATTRIB_UV,			//a_uv
+	VERTEX_ATTRIB_COLOR,		//a_color
+	VERTEX_ATTRIB_UV1,			//a_uv1
+	VERTEX_ATTRIB_BONES,		//a_bones
+	VERTEX_ATTRIB_WEIGHTS,		//a_weights
+	VERTEX_ATTRIB_INSTANCE_MODEL, //u_model when used as attribute for instancing, takes 4 locations
+	VERTEX_ATTRIB_DRAW_ID = VERTEX_ATTRIB_INSTANCE_MODEL + 4, //a_draw_id, index in the object buffer of the static batches
+	VERTEX_ATTRIB_COUNT
+};
+
+//fixed binding points of the std140 blocks shared by the shaders (structs in uniformbuffer.h)
+enum eUniformBlock {
+	UNIFORM_BLOCK_FRAME = 0,	//FrameBlock: camera, ambient and time
+	UNIFORM_BLOCK_LIGHT,		//LightBlock: the light of the current pass
+	UNIFORM_BLOCK_OBJECT,		//ObjectBlock: model and color of the current draw
+	UNIFORM_BLOCK_LIGHTS,		//LightsBlock: every light, for the single pass shaders without clusters
+	UNIFORM_BLOCK_CLUSTERS,		//ClusterBlock: size of the light cluster grid, the lists are in storage buffers
+	UNIFORM_BLOCK_COUNT
+};
+
+//fixed binding points of the std430 storage buffers, declared with layout(binding = X) in the shaders
+enum eStorageBuffer {
+	STORAGE_BUFFER_OBJECTS = 0,	//ObjectBuffer: models and colors of a static batch
+	STORAGE_BUFFER_LIGHTS,		//LightBuffer: every light of the frame
+	STORAGE_BUFFER_CLUSTERS,	//ClusterBuffer: offset and count of the lights of every cluster
+	STORAGE_BUFFER_LIGHT_INDICES //LightIndexBuffer: the light lists of all the clusters
+};
+
+//global id of a uniform name, get it once with Shader::GetUniform and reuse it to skip the name lookups
+struct UniformHandle
+{
+	int id = -1;
+	bool isValid() const { return id != -1; }
+};
+
+#define UNIFORM_NOT_RESOLVED -2
 
-class Shader
+class Shader : public Resource
 {
 	int last_slot;
 
@@ -42,7 +85,15 @@ public:
 	virtual bool load(const std::string& vsf, const std::string& psf, const char* macros);
 
 	//internal functions
-	virtual bool compileFromMemory(const std::string& vsm, const std::string& psm);
+	virtual bool compileFromMemory(const std::string& vsm, const std::string& psm); //submit and resolve
+
+	//two phase compilation, submit several shaders and resolve them later so the driver compiles them in parallel
+	bool submit(const std::string& vsm, const std::string& psm);
+	bool submitFiles(const std::string& vsf, const std::string& psf, const char* macros);
+	bool resolve(); //waits for the result, false if it failed
+	bool isPending() const;
+	bool isCompletionAvailable(); //true if resolve will not wait (always true without GL_KHR_parallel_shader_compile)
+	static bool ResolveAll();
 	virtual void release();
 	virtual void enable();
 	virtual void disable();
@@ -67,6 +118,19 @@ public:
 	//for textures you must specify an slot (a number from 0 to 16) where this texture is stored in the shader
 	void setUniform(const char* varname, Texture* texture, int slot) { assert(current == this); setTexture(varname, texture, slot); }
 
+	//upload using handles, the location is an array access once resolved
+	static UniformHandle GetUniform(const char* varname); //the same name gets the same handle in every shader
+	GLint getLocation(UniformHandle uniform) { return (unsigned int)uniform.id < uniform_slots.size() && uniform_slots[uniform.id] != UNIFORM_NOT_RESOLVED ? uniform_slots[uniform.id] : resolveLocation(uniform); }
+
+	void setUniform(UniformHandle uniform, bool input) { assert(current == this); GLint loc = getLocation(uniform); CHECK_SHADER_VAR(loc, uniform); glUniform1i(loc, input); }
+	void setUniform(UniformHandle uniform, int input) { assert(current == this); GLint loc = getLocation(uniform); CHECK_SHADER_VAR(loc, uniform); glUniform1i(loc, input); }
+	void setUniform(UniformHandle uniform, float input) { assert(current == this); GLint loc = getLocation(uniform); CHECK_SHADER_VAR(loc, uniform); glUniform1f(loc, input); }
+	void setUniform(UniformHandle uniform, const glm::vec2& input) { assert(current == this); GLint loc = getLocation(uniform); CHECK_SHADER_VAR(loc, uniform); glUniform2f(loc, input.x, input.y); }
+	void setUniform(UniformHandle uniform, const glm::vec3& input) { assert(current == this); GLint loc = getLocation(uniform); CHECK_SHADER_VAR(loc, uniform); glUniform3f(loc, input.x, input.y, input.z); }
+	void setUniform(UniformHandle uniform, const glm::vec4& input) { assert(current == this); GLint loc = getLocation(uniform); CHECK_SHADER_VAR(loc, uniform); glUniform4f(loc, input.x, input.y, input.z, input.w); }
+	void setUniform(UniformHandle uniform, const glm::mat4& input) { assert(current == this); GLint loc = getLocation(uniform); CHECK_SHADER_VAR(loc, uniform); glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(input)); }
+	void setUniform(UniformHandle uniform, Texture* texture, int slot);
+
 
 	virtual void setInt(const char* varname, const int& input) { setUniform1(varname, input); }
 	virtual void setFloat(const char* varname, const float& input) { setUniform1(varname, input); }
@@ -108,12 +172,26 @@ public:
 	std::string getInfoLog() const;
 	bool hasInfoLog() const;
 	bool compiled;
+	bool fixed_attributes; //all its attributes are in the locations of eVertexAttribute
+	unsigned int uniform_blocks; //bitmask of the eUniformBlock it declares
+
+	bool hasUniformBlock(eUniformBlock block) const { return (uniform_blocks & (1 << block)) != 0; }
+
+	static unsigned int s_used_uniform_blocks; //bitmask of the eUniformBlock declared by any shader linked so far, never cleared
+	static bool IsUniformBlockUsed(eUniformBlock block) { return (s_used_uniform_blocks & (1 << block)) != 0; }
 
 	void setMacros(const char* macros);
 
-	static Shader* Get(const char* vsf, const char* psf = NULL, const char* macros = NULL);
-	static void ReloadAll();
-	static std::map<std::string, Shader*> s_Shaders;
+	static Shader* Get(const char* vsf, const char* psf = NULL, const char* macros = NULL); //adds a reference, call removeRef() when done with it
+	static Shader* GetAsync(const char* vsf, const char* psf = NULL, const char* macros = NULL); //like Get but not resolved, see ResolveAll
+	static void ReloadAll(); //recompiles all in background, like when their files change
+
+	//hot reload: the programs using a file modified on disk are recompiled in background
+	//and each one replaces the old program once it links, the old one is kept if it fails
+	static bool s_hot_reload;
+	static void UpdateHotReload(); //call it once per frame from the main thread
+	void reloadAsync();
+	bool isReloading() const;
 
 	//this is a way to load a single file that contains all the shaders 
 	//to know more about the file format, it is based in this https://github.com/jagenjo/rendeer.js/tree/master/guides#the-shaders but with tiny differences
@@ -123,6 +201,9 @@ public:
 
 	static Shader* getDefaultShader(std::string name);
 
+	//linked programs are stored here and reused while the source and the driver do not change, empty to disable
+	static std::string s_binary_cache_folder;
+
 protected:
 
 	std::string info_log;
@@ -130,10 +211,22 @@ protected:
 	std::string ps_filename;
 	std::string macros;
 	bool from_atlas;
+	std::vector<std::string> dependencies; //files its source was read from, including the #includes
+	uint64_t source_hash; //of the final sources, the atlas only recompiles the shaders that changed
 
 	bool createVertexShaderObject(const std::string& shader);
 	bool createFragmentShaderObject(const std::string& shader);
 	bool createShaderObject(unsigned int type, GLuint& handle, const std::string& shader);
+	bool checkShaderObject(GLuint handle, const std::string& code);
+	void beginReload(Shader* staging);
+	void swapProgram(Shader* other);
+	static void WatchFiles(const std::vector<std::string>& filenames);
+	void bindAttributeLocations();
+	bool checkAttributeLocations();
+	void bindUniformBlocks();
+	static uint64_t ComputeBinaryKey(const std::string& vsm, const std::string& psm);
+	bool loadBinary(uint64_t key);
+	void saveBinary(uint64_t key);
 	void saveShaderInfoLog(GLuint obj);
 	void saveProgramInfoLog(GLuint obj);
 
@@ -144,6 +237,16 @@ protected:
 	GLuint program;
 	std::string log;
 
+	//until resolved
+	static std::vector<Shader*> s_pending;
+	std::string pending_vs;
+	std::string pending_ps;
+	uint64_t binary_key; //to save the binary once linked, 0 if it came from the cache
+
+	//programs being recompiled in background, the second one is swapped into the first once resolved
+	static std::vector<std::pair<Shader*, Shader*>> s_reloading;
+	static FileWatcher* s_watcher;
+
 	//this is a hack to speed up shader usage (save info locally)
 private:
 
@@ -159,4 +262,8 @@ private:
 public:
 	GLint getLocation(const char* varname, loctable* table);
 	loctable locations;
+
+private:
+	std::vector<GLint> uniform_slots; //location of every uniform handle, UNIFORM_NOT_RESOLVED until first used
+	GLint resolveLocation(UniformHandle uniform);
 };
\ No newline at end of file
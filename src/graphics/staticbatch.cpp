@@ -0,0 +1,311 @@
+#include "staticbatch.h"
+
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+
+#include "material.h"
+#include "shader.h"
+#include "uniformbuffer.h"
+#include "../framework/scenenode.h"
+#include "../framework/camera.h"
+
+//set while drawing the batch, the shaders without it cannot read the object buffer
+//(the batch VAO also needs the fixed attribute locations)
+static const UniformHandle u_batched = Shader::GetUniform("u_batched");
+
+bool StaticBatch::IsSupported()
+{
+	return GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object;
+}
+
+StaticBatch::StaticBatch()
+{
+	this->built = false;
+	this->vao_id = this->vertices_vbo_id = this->indices_vbo_id = this->draw_ids_vbo_id = this->commands_buffer_id = this->objects_buffer_id = 0;
+}
+
+StaticBatch::~StaticBatch()
+{
+	clear();
+}
+
+bool StaticBatch::add(SceneNode* node)
+{
+	if (!IsSupported() || node->isBatched())
+		return false;
+
+	//the meshes are merged from their RAM copy, skinned meshes need their own shader
+	Mesh* mesh = node->getMesh();
+	if (!mesh || !mesh->isReady() || (!mesh->vertices.size() && !mesh->interleaved.size()) || mesh->bones.size())
+		return false;
+
+	Material* material = node->getMaterial();
+	if (!material || !material->shader || !material->shader->compiled || !material->shader->fixed_attributes || material->shader->getLocation(u_batched) == -1)
+		return false;
+
+	node->setBatched(true);
+	this->nodes.push_back(node);
+	this->built = false;
+	return true;
+}
+
+void StaticBatch::clear()
+{
+	for (SceneNode* node : this->nodes)
+		node->setBatched(false);
+	this->nodes.clear();
+	this->groups.clear();
+	this->commands.clear();
+	this->ranges.clear();
+	this->node_indices.clear();
+	releaseBuffers();
+	this->built = false;
+}
+
+void StaticBatch::releaseBuffers()
+{
+	if (this->vao_id)
+		glDeleteVertexArrays(1, &this->vao_id);
+
+	unsigned int buffers[] = { this->vertices_vbo_id, this->indices_vbo_id, this->draw_ids_vbo_id, this->commands_buffer_id, this->objects_buffer_id };
+	for (unsigned int buffer : buffers)
+		if (buffer)
+			glDeleteBuffers(1, &buffer);
+
+	this->vao_id = this->vertices_vbo_id = this->indices_vbo_id = this->draw_ids_vbo_id = this->commands_buffer_id = this->objects_buffer_id = 0;
+}
+
+//appends the vertices as Vertex,Normal,UV and the indices relative to the first vertex of the mesh
+void StaticBatch::mergeMesh(Mesh* mesh, std::vector<Mesh::tInterleaved>& vertices, std::vector<uint32_t>& indices)
+{
+	sMeshRange range;
+	range.first_index = (uint32_t)indices.size();
+	range.base_vertex = (int32_t)vertices.size();
+
+	if (mesh->interleaved.size())
+		vertices.insert(vertices.end(), mesh->interleaved.begin(), mesh->interleaved.end());
+	else
+	{
+		size_t first = vertices.size();
+		vertices.resize(first + mesh->vertices.size());
+		for (size_t i = 0; i < mesh->vertices.size(); ++i)
+		{
+			Mesh::tInterleaved& v = vertices[first + i];
+			v.vertex = mesh->vertices[i];
+			v.normal = i < mesh->normals.size() ? mesh->normals[i] : glm::vec3(0.f);
+			v.uv = i < mesh->uvs.size() ? mesh->uvs[i] : glm::vec2(0.f);
+		}
+	}
+
+	if (mesh->indices.size())
+	{
+		//the indices are stored as vector3u in a vec3
+		size_t first = indices.size();
+		indices.resize(first + mesh->indices.size() * 3);
+		memcpy(&indices[first], &mesh->indices[0], mesh->indices.size() * sizeof(glm::vec3));
+	}
+	else
+	{
+		for (uint32_t i = 0; i < mesh->getNumVertices(); ++i)
+			indices.push_back(i);
+	}
+
+	range.count = (uint32_t)indices.size() - range.first_index;
+	this->ranges[mesh] = range;
+}
+
+bool StaticBatch::build()
+{
+	releaseBuffers();
+	this->groups.clear();
+	this->commands.clear();
+	this->ranges.clear();
+	this->node_indices.clear();
+	this->built = false;
+
+	if (!this->nodes.size())
+		return false;
+
+	//the nodes of the same material must be consecutive, sorting by shader first saves program changes
+	std::stable_sort(this->nodes.begin(), this->nodes.end(), [](SceneNode* a, SceneNode* b) {
+		if (a->getMaterial()->shader != b->getMaterial()->shader) //not every shader is in the ResourceManager, so not by handle
+			return std::less<Shader*>()(a->getMaterial()->shader, b->getMaterial()->shader);
+		return a->getMaterial()->id < b->getMaterial()->id;
+	});
+
+	std::vector<Mesh::tInterleaved> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> draw_ids(this->nodes.size());
+
+	for (size_t i = 0; i < this->nodes.size(); ++i)
+	{
+		SceneNode* node = this->nodes[i];
+		this->node_indices[node] = (unsigned int)i;
+		Mesh* mesh = node->getMesh();
+		if (this->ranges.find(mesh) == this->ranges.end())
+			mergeMesh(mesh, vertices, indices);
+		const sMeshRange& range = this->ranges[mesh];
+
+		DrawElementsIndirectCommand command;
+		command.count = range.count;
+		command.instance_count = 1;
+		command.first_index = range.first_index;
+		command.base_vertex = range.base_vertex;
+		command.base_instance = (uint32_t)i;
+		this->commands.push_back(command);
+		draw_ids[i] = (uint32_t)i;
+
+		if (!this->groups.size() || this->groups.back().material != node->getMaterial())
+		{
+			sBatchGroup group;
+			group.material = node->getMaterial();
+			group.first_command = (unsigned int)i;
+			group.num_commands = 0;
+			group.num_visible = 0;
+			this->groups.push_back(group);
+		}
+		this->groups.back().num_commands++;
+	}
+
+	glGenVertexArrays(1, &this->vao_id);
+	glBindVertexArray(this->vao_id);
+
+	//same layout as the interleaved meshes, in the fixed attribute locations
+	glGenBuffers(1, &this->vertices_vbo_id);
+	glBindBuffer(GL_ARRAY_BUFFER, this->vertices_vbo_id);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Mesh::tInterleaved), &vertices[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(VERTEX_ATTRIB_POSITION);
+	glVertexAttribPointer(VERTEX_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::tInterleaved), (void*)offsetof(Mesh::tInterleaved, vertex));
+	glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL);
+	glVertexAttribPointer(VERTEX_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::tInterleaved), (void*)offsetof(Mesh::tInterleaved, normal));
+	glEnableVertexAttribArray(VERTEX_ATTRIB_UV);
+	glVertexAttribPointer(VERTEX_ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, sizeof(Mesh::tInterleaved), (void*)offsetof(Mesh::tInterleaved, uv));
+
+	//one value per instance, the base instance of every command selects its draw
+	glGenBuffers(1, &this->draw_ids_vbo_id);
+	glBindBuffer(GL_ARRAY_BUFFER, this->draw_ids_vbo_id);
+	glBufferData(GL_ARRAY_BUFFER, draw_ids.size() * sizeof(uint32_t), &draw_ids[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(VERTEX_ATTRIB_DRAW_ID);
+	glVertexAttribIPointer(VERTEX_ATTRIB_DRAW_ID, 1, GL_UNSIGNED_INT, sizeof(uint32_t), NULL);
+	glVertexAttribDivisor(VERTEX_ATTRIB_DRAW_ID, 1);
+
+	glGenBuffers(1, &this->indices_vbo_id);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indices_vbo_id);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), &indices[0], GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	//the instance counts are rewritten every frame with the culling result
+	glGenBuffers(1, &this->commands_buffer_id);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commands_buffer_id);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, this->commands.size() * sizeof(DrawElementsIndirectCommand), &this->commands[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glGenBuffers(1, &this->objects_buffer_id);
+	updateObjects();
+
+	std::cout << " + Static batch: " << this->nodes.size() << " nodes, " << this->ranges.size() << " meshes, " << this->groups.size() << " draw calls" << std::endl;
+	this->built = true;
+	return true;
+}
+
+//std430 layout of sObject in basic.vs matches the object block
+void StaticBatch::updateObjects()
+{
+	if (!this->objects_buffer_id || !this->nodes.size())
+		return;
+
+	std::vector<sObjectBlock> objects(this->nodes.size());
+	for (size_t i = 0; i < this->nodes.size(); ++i)
+	{
+		objects[i].model = this->nodes[i]->getGlobalMatrix();
+		objects[i].color = this->nodes[i]->getMaterial()->color;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->objects_buffer_id);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(sObjectBlock), &objects[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+//a node dragged in the editor only rewrites its own object
+void StaticBatch::updateObjects(const SceneGraph& scene, const std::vector<int>& entities)
+{
+	if (!this->objects_buffer_id || !entities.size())
+		return;
+	if (entities.size() * 4 > this->nodes.size())
+	{
+		updateObjects();
+		return;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->objects_buffer_id);
+	for (int entity : entities)
+	{
+		auto it = this->node_indices.find(scene.nodes[entity]);
+		if (it == this->node_indices.end())
+			continue;
+		sObjectBlock object;
+		object.model = scene.world[entity];
+		object.color = it->first->getMaterial()->color;
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, it->second * sizeof(sObjectBlock), sizeof(sObjectBlock), &object);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void StaticBatch::render(Camera* camera)
+{
+	this->num_draw_calls = this->num_visible = 0;
+	if (!this->built)
+		return;
+
+	//culled nodes keep their command with no instances, so the groups never change
+	this->culler.cull(this->nodes, camera);
+	for (sBatchGroup& group : this->groups)
+	{
+		group.num_visible = 0;
+		for (unsigned int i = group.first_command; i < group.first_command + group.num_commands; ++i)
+		{
+			this->commands[i].instance_count = this->culler.visibility[i] && this->nodes[i]->isVisible();
+			group.num_visible += this->commands[i].instance_count;
+		}
+		this->num_visible += group.num_visible;
+	}
+
+	if (!this->num_visible)
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commands_buffer_id);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, this->commands.size() * sizeof(DrawElementsIndirectCommand), &this->commands[0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BUFFER_OBJECTS, this->objects_buffer_id);
+	glBindVertexArray(this->vao_id);
+
+	for (const sBatchGroup& group : this->groups)
+	{
+		if (!group.num_visible)
+			continue;
+
+		Shader* shader = group.material->shader;
+		shader->enable();
+		shader->setUniform(u_batched, true);
+		group.material->bind();
+		group.material->drawBatch(this, group);
+		shader->setUniform(u_batched, false); //the same program draws the nodes out of the batch
+		shader->disable();
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void StaticBatch::drawGroup(const sBatchGroup& group)
+{
+	const void* offset = (const void*)(group.first_command * sizeof(DrawElementsIndirectCommand));
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, group.num_commands, sizeof(DrawElementsIndirectCommand));
+
+	this->num_draw_calls++;
+	Mesh::num_meshes_rendered += group.num_visible;
+}
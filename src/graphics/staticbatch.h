@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "../framework/culling.h"
+#include "mesh.h"
+
+class Material;
+class Shader;
+class SceneNode;
+class Camera;
+class SceneGraph;
+
+//layout read by glMultiDrawElementsIndirect, do not change it
+struct DrawElementsIndirectCommand
+{
+	uint32_t count;
+	uint32_t instance_count; //0 when the node is culled
+	uint32_t first_index;
+	int32_t base_vertex;
+	uint32_t base_instance; //index of the draw in the object buffer
+};
+
+//consecutive commands that share a material, they are submitted with one call
+struct sBatchGroup
+{
+	Material* material;
+	unsigned int first_command;
+	unsigned int num_commands;
+	unsigned int num_visible;
+};
+
+//Merges the meshes of static nodes in a single vertex and index buffer and draws every material with one multi draw
+//The nodes must not move after build(), call updateObjects() if they do
+class StaticBatch
+{
+public:
+	static bool IsSupported(); //needs multi draw indirect and shader storage buffers
+
+	std::vector<SceneNode*> nodes; //sorted by shader and material after build
+	std::vector<sBatchGroup> groups;
+
+	//stats of the last render
+	unsigned int num_draw_calls = 0;
+	unsigned int num_visible = 0;
+
+	StaticBatch();
+	~StaticBatch();
+
+	bool add(SceneNode* node); //false if the node cannot be batched, it must be rendered as usual
+	void clear(); //the nodes are released from the batch
+	bool build(); //merges the meshes and uploads all the buffers
+	void updateObjects(); //uploads the models and colors of the nodes again
+	void updateObjects(const SceneGraph& scene, const std::vector<int>& entities); //only the ones of these entities, all of them when they are many
+	bool isBuilt() const { return built; }
+
+	void render(Camera* camera);
+	void drawGroup(const sBatchGroup& group); //the shader must be enabled, used by Material::drawBatch
+
+private:
+	struct sMeshRange
+	{
+		uint32_t first_index;
+		int32_t base_vertex;
+		uint32_t count;
+	};
+
+	std::map<Mesh*, sMeshRange> ranges; //where every mesh is in the merged buffers
+	std::map<SceneNode*, unsigned int> node_indices; //position of every node in nodes, its command and its object
+	std::vector<DrawElementsIndirectCommand> commands; //one per node
+	FrustumCuller culler;
+	bool built;
+
+	unsigned int vao_id;
+	unsigned int vertices_vbo_id;
+	unsigned int indices_vbo_id;
+	unsigned int draw_ids_vbo_id;
+	unsigned int commands_buffer_id;
+	unsigned int objects_buffer_id;
+
+	void releaseBuffers();
+	void mergeMesh(Mesh* mesh, std::vector<Mesh::tInterleaved>& vertices, std::vector<uint32_t>& indices);
+};
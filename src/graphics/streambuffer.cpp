@@ -0,0 +1,189 @@
+#include "streambuffer.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "uniformbuffer.h"
+
+unsigned int StreamBuffer::default_frame_size = 4 * 1024 * 1024;
+
+StreamBuffer* StreamBuffer::get()
+{
+	static StreamBuffer* stream_buffer = new StreamBuffer(default_frame_size);
+	return stream_buffer;
+}
+
+StreamBuffer::StreamBuffer(unsigned int frame_size)
+{
+	this->buffer_id = 0;
+	this->mapped = NULL;
+	this->frame = 0;
+	this->head = 0;
+	this->grow = false;
+	for (int i = 0; i < STREAM_BUFFER_FRAMES; ++i)
+		this->fences[i] = NULL;
+	create(frame_size);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	release();
+}
+
+void StreamBuffer::create(unsigned int frame_size)
+{
+	this->frame_size = frame_size;
+	this->persistent = GLEW_ARB_buffer_storage;
+	unsigned int size = frame_size * STREAM_BUFFER_FRAMES;
+
+	glGenBuffers(1, &this->buffer_id);
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer_id);
+	if (this->persistent)
+	{
+		//coherent, the writes are visible to the draws issued after them
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		this->mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+		if (!this->mapped)
+		{
+			std::cout << "[WARN] Stream buffer cannot be mapped, using uploads" << std::endl;
+			this->persistent = false;
+			glDeleteBuffers(1, &this->buffer_id);
+			glGenBuffers(1, &this->buffer_id);
+			glBindBuffer(GL_ARRAY_BUFFER, this->buffer_id);
+		}
+	}
+	if (!this->persistent)
+	{
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		this->shadow.resize(size);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamBuffer::release()
+{
+	for (int i = 0; i < STREAM_BUFFER_FRAMES; ++i)
+	{
+		if (this->fences[i])
+			glDeleteSync(this->fences[i]);
+		this->fences[i] = NULL;
+	}
+
+	if (this->mapped)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffer_id);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	this->mapped = NULL;
+	this->shadow.clear();
+
+	if (this->buffer_id)
+		glDeleteBuffers(1, &this->buffer_id);
+	this->buffer_id = 0;
+}
+
+void StreamBuffer::waitFence(unsigned int region)
+{
+	GLsync fence = this->fences[region];
+	if (!fence)
+		return;
+
+	//normally the frame finished long ago, only wait if the GPU is STREAM_BUFFER_FRAMES behind
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		this->num_waits++;
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); //1ms
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+
+	glDeleteSync(fence);
+	this->fences[region] = NULL;
+}
+
+void StreamBuffer::beginFrame()
+{
+	if (this->grow)
+	{
+		//the old buffer may still be read by the frames in flight
+		glFinish();
+		unsigned int frame_size = this->frame_size * 2;
+		release();
+		create(frame_size);
+		this->grow = false;
+		std::cout << " + Stream buffer grown to " << frame_size / 1024 << "KB per frame" << std::endl;
+	}
+
+	this->frame = (this->frame + 1) % STREAM_BUFFER_FRAMES;
+	waitFence(this->frame);
+	this->head = 0;
+	this->frame_usage = 0;
+}
+
+void StreamBuffer::endFrame()
+{
+	if (this->fences[this->frame])
+		glDeleteSync(this->fences[this->frame]);
+	this->fences[this->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+sStreamRange StreamBuffer::allocate(unsigned int size, unsigned int alignment)
+{
+	sStreamRange range;
+	range.ptr = NULL;
+	range.offset = 0;
+	range.size = size;
+
+	assert(size <= this->frame_size && "stream allocation bigger than a frame");
+	if (size > this->frame_size)
+		return range;
+
+	unsigned int start = (this->head + alignment - 1) / alignment * alignment;
+	if (start + size > this->frame_size)
+	{
+		//out of space, the draws of this frame must finish before its region is overwritten
+		if (!this->grow)
+			std::cout << "[WARN] Stream buffer full (" << this->frame_size / 1024 << "KB per frame), stalling" << std::endl;
+		this->grow = true;
+		this->num_waits++;
+		glFinish();
+		start = 0;
+	}
+
+	range.offset = this->frame * this->frame_size + start;
+	range.ptr = this->persistent ? this->mapped + range.offset : &this->shadow[range.offset];
+	this->head = start + size;
+	this->frame_usage = this->head;
+	return range;
+}
+
+void StreamBuffer::commit(const sStreamRange& range)
+{
+	if (this->persistent || !range.ptr)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer_id);
+	glBufferSubData(GL_ARRAY_BUFFER, range.offset, range.size, range.ptr);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+sStreamRange StreamBuffer::push(const void* data, unsigned int size, unsigned int alignment)
+{
+	sStreamRange range = allocate(size, alignment);
+	if (range.ptr)
+	{
+		memcpy(range.ptr, data, size);
+		commit(range);
+	}
+	return range;
+}
+
+void StreamBuffer::pushUniformBlock(const void* data, unsigned int size, unsigned int binding)
+{
+	sStreamRange range = push(data, size, UniformBuffer::GetOffsetAlignment());
+	if (range.ptr)
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, this->buffer_id, range.offset, size);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../framework/includes.h"
+
+#include <vector>
+#include <cstdint>
+
+#define STREAM_BUFFER_FRAMES 3 //frames the GPU can be behind the CPU
+
+//piece of the stream buffer for this frame
+struct sStreamRange
+{
+	uint8_t* ptr; //write here before the draw that reads it, NULL if it did not fit
+	unsigned int offset; //in the buffer, for attribute pointers and uniform ranges
+	unsigned int size;
+};
+
+//Buffer for the data rewritten every frame (instances, per draw uniforms, particles...)
+//It is split in one region per frame in flight and persistently mapped when the GPU allows it.
+//A region is reused once the fence of the frame that wrote it has passed, so writing never waits for the draws.
+class StreamBuffer
+{
+public:
+	static StreamBuffer* get(); //global buffer, created on first use from the main thread
+	static unsigned int default_frame_size;
+
+	GLuint buffer_id;
+	unsigned int frame_size; //bytes of every region
+	bool persistent; //mapped once (ARB_buffer_storage), otherwise every range is uploaded on commit
+
+	//stats
+	unsigned int frame_usage = 0; //bytes used in the current frame
+	unsigned int num_waits = 0; //times the CPU had to wait for the GPU
+
+	StreamBuffer(unsigned int frame_size);
+	~StreamBuffer();
+
+	void beginFrame(); //waits until the region of this frame is free
+	void endFrame(); //fences the region written this frame
+
+	sStreamRange allocate(unsigned int size, unsigned int alignment = 16);
+	void commit(const sStreamRange& range); //call it once written, nothing to do when persistent
+	sStreamRange push(const void* data, unsigned int size, unsigned int alignment = 16); //allocates, copies and commits
+	void pushUniformBlock(const void* data, unsigned int size, unsigned int binding); //also binds the range to the block
+
+private:
+	unsigned int frame; //region in use
+	unsigned int head; //next free byte in the region
+	GLsync fences[STREAM_BUFFER_FRAMES];
+	uint8_t* mapped;
+	std::vector<uint8_t> shadow; //written by the CPU when the buffer cannot be mapped
+	bool grow; //a frame did not fit, the regions are doubled on the next beginFrame
+
+	void create(unsigned int frame_size);
+	void release();
+	void waitFence(unsigned int region);
+};
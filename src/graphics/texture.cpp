@@ -5,9 +5,16 @@
 #include <iostream> //to output
 #include <cmath>
 #include <algorithm>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <sys/stat.h>
 
 #include "mesh.h"
 #include "shader.h"
+#include "../framework/threadpool.h"
+#include "pngcodec.h"
+#include "imageops.h"
 #include <cassert>
 
 //bilinear interpolation
@@ -39,12 +46,15 @@ glm::vec4 Image::getPixelInterpolatedHigh(float x, float y, bool repeat) {
 	return glm::mix(top, bottom, fy);
 };
 
-std::map<std::string, Texture*> Texture::sTexturesLoaded;
 int Texture::default_mag_filter = GL_LINEAR;
 int Texture::default_min_filter = GL_LINEAR_MIPMAP_LINEAR;
 FBO* Texture::global_fbo = NULL;
+unsigned int Texture::async_upload_budget = 8 * 1024 * 1024;
+unsigned int Texture::num_async_loads = 0;
+bool Texture::use_binary = true;
+bool Texture::compress_levels = true;
 
-Texture::Texture()
+Texture::Texture() : Resource(RESOURCE_TEXTURE)
 {
 	width = 0;
 	height = 0;
@@ -59,13 +69,13 @@ Texture::Texture()
 	internal_format = 0;
 }
 
-Texture::Texture(unsigned int width, unsigned int height, unsigned int format, unsigned int type, bool mipmaps, uint8_t* data, unsigned int internal_format)
+Texture::Texture(unsigned int width, unsigned int height, unsigned int format, unsigned int type, bool mipmaps, uint8_t* data, unsigned int internal_format) : Resource(RESOURCE_TEXTURE)
 {
 	texture_id = 0;
 	create(width, height, format, type, mipmaps, data, internal_format);
 }
 
-Texture::Texture(Image* img)
+Texture::Texture(Image* img) : Resource(RESOURCE_TEXTURE)
 {
 	texture_id = 0;
 	create(img->width, img->height, img->bytes_per_pixel == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, true, img->data);
@@ -83,6 +93,37 @@ void Texture::clear()
 	texture_id = 0;
 }
 
+size_t Texture::getCPUSize()
+{
+	return image.data ? (size_t)image.width * image.height * image.bytes_per_pixel : 0;
+}
+
+//estimated from the formats, the driver may pad or compress it
+size_t Texture::getVRAMSize()
+{
+	if (!texture_id)
+		return 0;
+
+	unsigned int channels = 4;
+	switch (format)
+	{
+		case GL_RED: case GL_DEPTH_COMPONENT: channels = 1; break;
+		case GL_RG: channels = 2; break;
+		case GL_RGB: channels = 3; break;
+	}
+	size_t texel_size = channels * (type == GL_FLOAT ? 4 : (type == GL_HALF_FLOAT ? 2 : 1));
+	size_t size = (size_t)width * (size_t)height * (depth > 0 ? (size_t)depth : 1) * texel_size;
+	if (internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+		size = getEncodedLevelSize(TEXTURE_ENCODING_BC1, (int)width, (int)height);
+	else if (internal_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		size = getEncodedLevelSize(TEXTURE_ENCODING_BC3, (int)width, (int)height);
+	if (texture_type == GL_TEXTURE_CUBE_MAP)
+		size *= 6;
+	if (mipmaps)
+		size += size / 3;
+	return size;
+}
+
 void Texture::create(unsigned int width, unsigned int height, unsigned int format, unsigned int type, bool mipmaps, uint8_t* data, unsigned int internal_format)
 {
 	assert(width && height && "texture must have a size");
@@ -209,9 +250,23 @@ Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap)
 	assert(filename);
 
 	//check if loaded
-	auto it = sTexturesLoaded.find(filename);
-	if (it != sTexturesLoaded.end())
-		return it->second;
+	Texture* loaded = (Texture*)ResourceManager::Find(filename, RESOURCE_TEXTURE);
+	if (loaded)
+	{
+		//requested before with GetAsync, the callers of Get expect it ready so the rest of the load happens now
+		while (loaded->state == TEXTURE_LOADING || loaded->state == TEXTURE_STREAMING)
+		{
+			UpdateAsyncLoads();
+			if (loaded->state != TEXTURE_LOADING && loaded->state != TEXTURE_STREAMING)
+				break;
+			glFlush(); //so the fences of the upload buffers get signaled
+			std::this_thread::yield();
+		}
+		if (loaded->state == TEXTURE_FAILED)
+			return NULL;
+		loaded->addRef();
+		return loaded;
+	}
 
 	//load it
 	Texture* texture = new Texture();
@@ -221,34 +276,42 @@ Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap)
 		return NULL;
 	}
 
+	texture->addRef();
 	return texture;
 }
 
 bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type)
 {
-	std::string str = filename;
-	std::string ext = str.substr(str.size() - 4, 4);
 	Image* image = NULL;
 	long time = getTime();
 
 	std::cout << " + Texture loading: " << filename << " ... ";
 
-	image = new Image();
-	bool found = false;
-
-	if (ext == ".tga" || ext == ".TGA")
-		found = image->loadTGA(filename);
-	else if (ext == ".png" || ext == ".PNG")
-		found = image->loadPNG(filename);
-	else
+	//all the levels prebuilt, from the .tbin or written to it now
+	if (type == GL_UNSIGNED_BYTE)
 	{
-		std::cout << "[ERROR]: unsupported format" << std::endl;
-		return false; //unsupported file type
+		sTextureData data;
+		if (!data.load(filename, mipmaps))
+		{
+			std::cout << " [ERROR]: Texture not found " << std::endl;
+			return false;
+		}
+
+		this->filename = filename;
+		allocateLevels(data, wrap);
+		for (int level = (int)data.levels.size() - 1; level >= 0; --level)
+			uploadLevel(data, level, data.getLevelData(level));
+
+		std::cout << "[OK" << (data.file.isOpen() ? " BIN" : "") << "] Size: " << width << "x" << height << " Levels: " << num_levels << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+		setName(filename);
+		return true;
 	}
 
-	if (!found) //file not found
+	image = new Image();
+	if (!image->load(filename)) //file not found
 	{
 		std::cout << " [ERROR]: Texture not found " << std::endl;
+		delete image;
 		return false;
 	}
 
@@ -267,12 +330,489 @@ bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int t
 	if (mipmaps)
 		generateMipmaps();
 
+	delete image;
 	this->image.clear();
 	std::cout << "[OK] Size: " << width << "x" << height << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	setName(filename);
 	return true;
 }
 
+// TEXTURE DATA ************************
+
+struct sTextureBinHeader
+{
+	char magic[4]; //TBIN
+	uint32_t version;
+	uint32_t header_bytes;
+	uint32_t encoding; //eTextureEncoding
+	uint32_t width;
+	uint32_t height;
+	uint32_t num_levels; //followed by one sTextureBinLevel per level, level 0 first
+	uint32_t data_offset; //where the first (smallest) level starts
+	uint64_t source_size; //of the image when it was baked
+	int64_t source_time;
+};
+
+struct sTextureBinLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset; //from the start of the file
+	uint64_t size;
+};
+
+#define TEXTURE_LEVEL_ALIGNMENT 16
+
+static inline size_t alignLevel(size_t offset) { return (offset + TEXTURE_LEVEL_ALIGNMENT - 1) / TEXTURE_LEVEL_ALIGNMENT * TEXTURE_LEVEL_ALIGNMENT; }
+
+bool sTextureData::readSource(const char* filename)
+{
+	struct stat stbuffer;
+	if (stat(filename, &stbuffer) != 0)
+	{
+		source_size = 0;
+		source_time = 0;
+		return false;
+	}
+	source_size = (uint64_t)stbuffer.st_size;
+	source_time = (int64_t)stbuffer.st_mtime;
+	return true;
+}
+
+bool sTextureData::load(const char* filename, bool mipmaps)
+{
+	//without the extension the blocks cannot be uploaded, the levels are kept uncompressed
+	bool compress = Texture::compress_levels && GLEW_EXT_texture_compression_s3tc;
+
+	//a .tbin alone (the image not shipped) is always used
+	std::string binfilename = std::string(filename) + ".tbin";
+	readSource(filename);
+	if (Texture::use_binary && readBin(binfilename.c_str()))
+	{
+		if (!isBlockEncoding(encoding) || GLEW_EXT_texture_compression_s3tc)
+			return true;
+		file.close();
+		levels.clear();
+	}
+
+	Image image;
+	if (!image.load(filename))
+		return false;
+	build(image, mipmaps, compress);
+
+	if (Texture::use_binary && !writeBin(binfilename.c_str()))
+		std::cout << "[WARN] cannot write texture BIN: " << binfilename << std::endl;
+	return true;
+}
+
+//box filtered levels down to 1x1, then encoded from the smallest
+void sTextureData::build(Image& image, bool mipmaps, bool compress)
+{
+	int bpp = image.bytes_per_pixel;
+	file.close();
+	storage.clear();
+
+	std::vector<std::vector<uint8_t>> pixels(1);
+	std::vector<sTextureLevel> sizes(1);
+	sizes[0].width = image.width;
+	sizes[0].height = image.height;
+	pixels[0].assign(image.data, image.data + (size_t)image.width * image.height * bpp);
+
+	if (mipmaps && isPowerOfTwo(image.width) && isPowerOfTwo(image.height))
+		while (sizes.back().width > 1 || sizes.back().height > 1)
+		{
+			const sTextureLevel prev = sizes.back();
+			const std::vector<uint8_t>& src_pixels = pixels.back();
+			sTextureLevel level;
+			level.width = std::max(prev.width / 2, 1);
+			level.height = std::max(prev.height / 2, 1);
+			std::vector<uint8_t> dst_pixels((size_t)level.width * level.height * bpp);
+			downsampleBox(&src_pixels[0], prev.width, prev.height, bpp, &dst_pixels[0]);
+			sizes.push_back(level);
+			pixels.push_back(std::move(dst_pixels));
+		}
+
+	//blocks need the full size to be multiple of 4, BC3 only when some texel is not opaque
+	encoding = bpp == 3 ? TEXTURE_ENCODING_RGB8 : TEXTURE_ENCODING_RGBA8;
+	if (compress && image.width % 4 == 0 && image.height % 4 == 0)
+	{
+		encoding = TEXTURE_ENCODING_BC1;
+		if (bpp == 4)
+			for (size_t i = 3; i < pixels[0].size(); i += 4)
+				if (pixels[0][i] != 255)
+				{
+					encoding = TEXTURE_ENCODING_BC3;
+					break;
+				}
+	}
+
+	levels = sizes;
+	for (int i = (int)levels.size() - 1; i >= 0; --i)
+	{
+		sTextureLevel& level = levels[i];
+		storage.resize(alignLevel(storage.size()));
+		level.offset = storage.size();
+		if (encoding == TEXTURE_ENCODING_BC1)
+			encodeBC1(&pixels[i][0], level.width, level.height, bpp, storage);
+		else if (encoding == TEXTURE_ENCODING_BC3)
+			encodeBC3(&pixels[i][0], level.width, level.height, storage);
+		else
+			storage.insert(storage.end(), pixels[i].begin(), pixels[i].end());
+		level.size = storage.size() - level.offset;
+		std::vector<uint8_t>().swap(pixels[i]);
+	}
+}
+
+//mapped, the levels are read straight from the file when uploaded
+bool sTextureData::readBin(const char* filename)
+{
+	if (!file.open(filename))
+		return false;
+
+	sTextureBinHeader header;
+	bool valid = file.size >= sizeof(header);
+	if (valid)
+	{
+		memcpy(&header, file.data, sizeof(header));
+		valid = memcmp(header.magic, "TBIN", 4) == 0 && header.version == TEXTURE_BIN_VERSION && header.header_bytes == sizeof(header) &&
+			header.encoding <= TEXTURE_ENCODING_BC3 && header.num_levels > 0 && header.num_levels <= 32 &&
+			sizeof(header) + header.num_levels * sizeof(sTextureBinLevel) <= file.size;
+	}
+	if (!valid)
+	{
+		std::cout << "[WARN] loading texture BIN: invalid or old version: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+	if (source_size && (header.source_size != source_size || header.source_time != source_time))
+	{
+		std::cout << "[WARN] loading texture BIN: the image changed: " << filename << std::endl;
+		file.close();
+		return false;
+	}
+
+	encoding = (eTextureEncoding)header.encoding;
+	levels.resize(header.num_levels);
+	const uint8_t* pos = file.data + sizeof(header);
+	for (uint32_t i = 0; i < header.num_levels; ++i, pos += sizeof(sTextureBinLevel))
+	{
+		sTextureBinLevel info;
+		memcpy(&info, pos, sizeof(info));
+		sTextureLevel& level = levels[i];
+		level.width = info.width;
+		level.height = info.height;
+		level.offset = (size_t)info.offset;
+		level.size = (size_t)info.size;
+		if (!level.width || !level.height || info.offset + info.size > file.size || level.size != getEncodedLevelSize(encoding, level.width, level.height))
+		{
+			std::cout << "[ERROR] loading texture BIN: corrupted levels: " << filename << std::endl;
+			file.close();
+			levels.clear();
+			return false;
+		}
+	}
+	storage.clear();
+	return true;
+}
+
+bool sTextureData::writeBin(const char* filename) const
+{
+	assert(levels.size() && !file.isOpen());
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL)
+		return false;
+
+	sTextureBinHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "TBIN", 4);
+	header.version = TEXTURE_BIN_VERSION;
+	header.header_bytes = sizeof(header);
+	header.encoding = encoding;
+	header.width = levels[0].width;
+	header.height = levels[0].height;
+	header.num_levels = (uint32_t)levels.size();
+	header.data_offset = (uint32_t)alignLevel(sizeof(header) + levels.size() * sizeof(sTextureBinLevel));
+	header.source_size = source_size;
+	header.source_time = source_time;
+	fwrite(&header, sizeof(header), 1, f);
+
+	//the storage is already laid out as the file data, only moved by data_offset
+	for (const sTextureLevel& level : levels)
+	{
+		sTextureBinLevel info;
+		info.width = level.width;
+		info.height = level.height;
+		info.offset = header.data_offset + level.offset;
+		info.size = level.size;
+		fwrite(&info, sizeof(info), 1, f);
+	}
+
+	uint8_t padding[TEXTURE_LEVEL_ALIGNMENT] = {};
+	fwrite(padding, 1, header.data_offset - sizeof(header) - levels.size() * sizeof(sTextureBinLevel), f);
+	bool written = fwrite(&storage[0], 1, storage.size(), f) == storage.size();
+	fclose(f);
+	return written;
+}
+
+bool Texture::Bake(const char* filename, bool mipmaps)
+{
+	Image image;
+	if (!image.load(filename))
+		return false;
+
+	sTextureData data;
+	data.readSource(filename);
+	data.build(image, mipmaps, compress_levels);
+	std::string binfilename = std::string(filename) + ".tbin";
+	if (!data.writeBin(binfilename.c_str()))
+		return false;
+
+	std::cout << " + Texture baked: " << binfilename << " Levels: " << data.levels.size() << " Size: " << data.storage.size() / 1024 << "KB" << std::endl;
+	return true;
+}
+
+static void getEncodingFormats(eTextureEncoding encoding, unsigned int& format, unsigned int& internal_format)
+{
+	switch (encoding)
+	{
+		case TEXTURE_ENCODING_RGB8: format = GL_RGB; internal_format = GL_RGB8; break;
+		case TEXTURE_ENCODING_RGBA8: format = GL_RGBA; internal_format = GL_RGBA8; break;
+		case TEXTURE_ENCODING_BC1: format = GL_RGB; internal_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+		case TEXTURE_ENCODING_BC3: format = GL_RGBA; internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+	}
+}
+
+//the storage of all the levels is allocated at once, only the smallest is sampled until the others arrive
+void Texture::allocateLevels(const sTextureData& data, bool wrap)
+{
+	const sTextureLevel& level0 = data.levels[0];
+	this->width = (float)level0.width;
+	this->height = (float)level0.height;
+	this->depth = 0;
+	getEncodingFormats(data.encoding, this->format, this->internal_format);
+	this->type = GL_UNSIGNED_BYTE;
+	this->texture_type = GL_TEXTURE_2D;
+	this->num_levels = (unsigned int)data.levels.size();
+	this->base_level = this->num_levels;
+	this->mipmaps = this->num_levels > 1;
+
+	if (this->texture_id != 0)
+		clear();
+	glGenTextures(1, &this->texture_id);
+	glBindTexture(GL_TEXTURE_2D, this->texture_id);
+	glTexStorage2D(GL_TEXTURE_2D, this->num_levels, this->internal_format, level0.width, level0.height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, this->num_levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, this->num_levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, this->mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	this->wrapS = this->wrapT = this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, this->wrapS);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, this->wrapT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	assert(checkGLErrors() && "Error creating texture");
+}
+
+void Texture::uploadLevel(const sTextureData& data, int level, const void* pixels)
+{
+	const sTextureLevel& info = data.levels[level];
+	glBindTexture(GL_TEXTURE_2D, this->texture_id);
+	if (isBlockEncoding(data.encoding))
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, info.width, info.height, this->internal_format, (GLsizei)info.size, pixels);
+	else
+	{
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, info.width, info.height, this->format, GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+	//the draws after this one sample the new level, the ones before used the smaller ones
+	if (level < (int)this->base_level)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+		this->base_level = level;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// ASYNC LOADING ************************
+
+struct sAsyncTexture
+{
+	Texture* texture;
+	bool loaded;
+	bool wrap;
+	sTextureData data;
+	int next_level; //uploaded from the last one down to 0
+};
+
+static std::mutex async_textures_mutex;
+static std::deque<sAsyncTexture*> async_textures_decoded;
+static std::vector<sAsyncTexture*> async_textures_streaming; //main thread only
+
+//the levels are copied to one of these and the driver reads it while the frame goes on,
+//a buffer is reused once the fence after its copy has passed
+#define TEXTURE_UPLOAD_BUFFERS 4
+
+struct sUploadBuffer
+{
+	GLuint id;
+	unsigned int size;
+	GLsync fence;
+};
+static sUploadBuffer upload_buffers[TEXTURE_UPLOAD_BUFFERS];
+
+//bound to GL_PIXEL_UNPACK_BUFFER, NULL if all of them are still being read
+static sUploadBuffer* getUploadBuffer(unsigned int size)
+{
+	for (sUploadBuffer& buffer : upload_buffers)
+	{
+		if (buffer.fence)
+		{
+			if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				continue;
+			glDeleteSync(buffer.fence);
+			buffer.fence = NULL;
+		}
+
+		if (!buffer.id)
+			glGenBuffers(1, &buffer.id);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+		if (buffer.size < size)
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+			buffer.size = size;
+		}
+		return &buffer;
+	}
+	return NULL;
+}
+
+Texture* Texture::GetAsync(const char* filename, bool mipmaps, bool wrap)
+{
+	assert(filename);
+	Texture* loaded = (Texture*)ResourceManager::Find(filename, RESOURCE_TEXTURE);
+	if (loaded)
+	{
+		loaded->addRef();
+		return loaded;
+	}
+
+	//register it now so other requests for the same file get the same texture
+	Texture* texture = new Texture();
+	texture->state = TEXTURE_LOADING;
+	texture->filename = filename;
+	texture->setName(filename);
+	texture->addRef();
+	num_async_loads++;
+
+	//reading the .tbin, or decoding, encoding and writing it, all happens in the worker
+	std::string path = filename;
+	ThreadPool::get()->enqueue([texture, path, mipmaps, wrap]() {
+		sAsyncTexture* job = new sAsyncTexture();
+		job->texture = texture;
+		job->wrap = wrap;
+		job->loaded = job->data.load(path.c_str(), mipmaps);
+		if (job->data.file.isOpen())
+			job->data.file.prefetch();
+		job->next_level = (int)job->data.levels.size() - 1;
+		std::lock_guard<std::mutex> lock(async_textures_mutex);
+		async_textures_decoded.push_back(job);
+	});
+
+	return texture;
+}
+
+//false if there is no upload buffer free, it never waits for the GPU
+static bool streamLevel(sAsyncTexture* job)
+{
+	int level = job->next_level;
+	const uint8_t* pixels = job->data.getLevelData(level);
+	unsigned int size = (unsigned int)job->data.levels[level].size;
+
+	sUploadBuffer* buffer = getUploadBuffer(size);
+	if (!buffer)
+		return false;
+
+	//unsynchronized, the fence already told the GPU is done with the previous copy
+	void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (ptr)
+	{
+		memcpy(ptr, pixels, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		pixels = NULL; //offset in the buffer
+	}
+	else
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	job->texture->uploadLevel(job->data, level, pixels);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (ptr)
+		buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	job->texture->state = TEXTURE_STREAMING;
+	job->next_level--;
+	return true;
+}
+
+void Texture::UpdateAsyncLoads()
+{
+	while (true)
+	{
+		sAsyncTexture* job = NULL;
+		{
+			std::lock_guard<std::mutex> lock(async_textures_mutex);
+			if (async_textures_decoded.empty())
+				break;
+			job = async_textures_decoded.front();
+			async_textures_decoded.pop_front();
+		}
+
+		if (!job->loaded)
+		{
+			std::cout << "[ERROR] Texture not found: " << job->texture->filename << std::endl;
+			job->texture->state = TEXTURE_FAILED;
+			num_async_loads--;
+			delete job;
+			continue;
+		}
+
+		job->texture->allocateLevels(job->data, job->wrap);
+		async_textures_streaming.push_back(job);
+	}
+
+	//one level of every texture per round, so all of them get their small levels before any gets the big ones
+	//at least one level is copied every frame even if it is bigger than the budget
+	unsigned int copied = 0;
+	bool progress = true;
+	while (progress && async_textures_streaming.size())
+	{
+		progress = false;
+		for (size_t i = 0; i < async_textures_streaming.size(); )
+		{
+			sAsyncTexture* job = async_textures_streaming[i];
+			unsigned int size = (unsigned int)job->data.levels[job->next_level].size;
+			if (copied && copied + size > async_upload_budget)
+				return;
+			if (!streamLevel(job))
+				return; //all the buffers are in flight
+
+			copied += size;
+			progress = true;
+			if (job->next_level >= 0)
+			{
+				++i;
+				continue;
+			}
+
+			job->texture->state = TEXTURE_READY;
+			num_async_loads--;
+			std::cout << " + Texture streamed: " << job->texture->filename << " Size: " << job->texture->width << "x" << job->texture->height << std::endl;
+			async_textures_streaming.erase(async_textures_streaming.begin() + i);
+			delete job; //also unmaps its .tbin
+		}
+	}
+}
+
 void Texture::upload(Image* img)
 {
 	create(img->width, img->height, img->bytes_per_pixel == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, true, img->data);
@@ -490,7 +1030,9 @@ void Image::fromScreen(int width, int height)
 		this->height = height;
 		data = new uint8_t[width * height * 4];
 	}
+	bytes_per_pixel = 4;
 
+	//synchronous, FrameCapture reads the frames without waiting for the GPU
 	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
 }
 
@@ -511,6 +1053,20 @@ void Image::fromTexture(Texture* texture)
 	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 }
 
+bool Image::load(const char* filename)
+{
+	std::string str = filename;
+	std::string ext = str.size() >= 4 ? str.substr(str.size() - 4, 4) : "";
+
+	if (ext == ".tga" || ext == ".TGA")
+		return loadTGA(filename);
+	else if (ext == ".png" || ext == ".PNG")
+		return loadPNG(filename);
+
+	std::cout << "[ERROR]: unsupported format" << std::endl;
+	return false; //unsupported file type
+}
+
 //TGA format from: http://www.paulbourke.net/dataformats/tga/
 //also on https://gshaw.ca/closecombat/formats/tga.html
 bool Image::loadTGA(const char* filename)
@@ -567,6 +1123,7 @@ bool Image::loadTGA(const char* filename)
 	{
 		if (data != NULL)
 			delete[]data;
+		data = NULL;
 		fclose(file);
 		return NULL;
 	}
@@ -575,12 +1132,7 @@ bool Image::loadTGA(const char* filename)
 		origin_topleft = true;
 
 	//flip BGR to RGB pixels
-	for (GLuint i = 0; i < int(imageSize); i += bytes_per_pixel)
-	{
-		uint8_t temp = data[i];
-		data[i] = data[i + 2];
-		data[i + 2] = temp;
-	}
+	swizzleRB(data, (size_t)width * height, bytes_per_pixel);
 
 	fclose(file);
 	return true;
@@ -598,7 +1150,7 @@ bool Image::loadPNG(const char* filename, bool flip_y)
 	if (file.seekg(0, std::ios::end).good()) size = file.tellg();
 	if (file.seekg(0, std::ios::beg).good()) size -= file.tellg();
 
-	if (!size)
+	if (size <= 0)
 		return false;
 
 	std::vector<unsigned char> buffer;
@@ -612,14 +1164,27 @@ bool Image::loadPNG(const char* filename, bool flip_y)
 	else
 		buffer.clear();
 
-	std::vector<unsigned char> out_image;
+	int png_width, png_height, png_bytes_per_pixel;
+	if (!readPNGHeader(&buffer[0], buffer.size(), png_width, png_height, png_bytes_per_pixel))
+	{
+		std::cout << "[ERROR] Invalid PNG: " << filename << std::endl;
+		return false;
+	}
 
-	//if (decodePNG(out_image, width, height, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size(), true) != 0)
-	//	return false;
+	uint8_t* pixels = new uint8_t[(size_t)png_width * png_height * png_bytes_per_pixel];
+	if (!decodePNG(&buffer[0], buffer.size(), pixels))
+	{
+		std::cout << "[ERROR] Corrupted PNG: " << filename << std::endl;
+		delete[] pixels;
+		return false;
+	}
 
-	data = new uint8_t[out_image.size()];
-	memcpy(data, &out_image[0], out_image.size());
-	bytes_per_pixel = 4;
+	if (data)
+		delete[] data;
+	data = pixels;
+	width = png_width;
+	height = png_height;
+	bytes_per_pixel = png_bytes_per_pixel;
 
 	//flip pixels in Y
 	if (flip_y)
@@ -672,17 +1237,13 @@ bool Image::saveTGA(const char* filename, bool flip_y)
 void Image::flipY()
 {
 	assert(data);
-	int row_size = 4 * width;
-	uint8_t* temp_row = new uint8_t[row_size];
-	for (int y = 0; y < height * 0.5; y += 1)
-	{
-		uint8_t* pos = data + y * row_size;
-		memcpy(temp_row, pos, row_size);
-		uint8_t* pos2 = data + (height - y - 1) * row_size;
-		memcpy(pos, pos2, row_size);
-		memcpy(pos2, temp_row, row_size);
-	}
-	delete[] temp_row;
+	flipRows(data, width, height, bytes_per_pixel);
+}
+
+void Image::sampleBilinear(const glm::vec2* uvs, glm::vec4* out, int count, bool repeat)
+{
+	assert(data);
+	::sampleBilinear(data, width, height, bytes_per_pixel, uvs, out, count, repeat);
 }
 
 bool isPowerOfTwo(int n)
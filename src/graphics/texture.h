@@ -5,8 +5,12 @@
 #pragma once
 
 #include "../framework/includes.h"
+#include "../framework/resourcemanager.h"
+#include "../framework/mappedfile.h"
+#include "texturecodec.h"
 #include <map>
 #include <string>
+#include <vector>
 #include <cassert>
 
 #include <glm/vec4.hpp>
@@ -46,29 +50,65 @@ public:
 
 	glm::vec4 getPixelInterpolated(float x, float y, bool repeat = false);
 	glm::vec4 getPixelInterpolatedHigh(float x, float y, bool repeat = false); //returns a Vector4 (floats)
+	void sampleBilinear(const glm::vec2* uvs, glm::vec4* out, int count, bool repeat = false); //uvs in 0..1, many at once
 
 	void fromTexture(Texture* texture);
 	void fromScreen(int width, int height);
 
+	bool load(const char* filename); //by extension, tga or png
 	bool loadTGA(const char* filename);
 	bool loadPNG(const char* filename, bool flip_y = false);
 	bool saveTGA(const char* filename, bool flip_y = true);
 };
 
 
+#define TEXTURE_BIN_VERSION 2 //the .tbin files of other versions are rebuilt
+
+//one level inside the data of a sTextureData
+struct sTextureLevel
+{
+	int width;
+	int height;
+	size_t offset; //from the start of the data
+	size_t size;
+};
+
+//All the levels of a texture ready to upload, built from an image or mapped from its .tbin
+//The smallest level goes first, so streaming them reads the file forward
+struct sTextureData
+{
+	eTextureEncoding encoding = TEXTURE_ENCODING_RGBA8;
+	std::vector<sTextureLevel> levels; //level 0 is the full size
+	std::vector<uint8_t> storage; //when built
+	MappedFile file; //when read, the offsets are from the start of the file
+	uint64_t source_size = 0; //of the image it comes from, a .tbin of another version of the image is rebuilt
+	int64_t source_time = 0;
+
+	const uint8_t* getLevelData(size_t level) const { return (file.isOpen() ? file.data : storage.data()) + levels[level].offset; }
+
+	bool load(const char* filename, bool mipmaps); //the .tbin if there is one, otherwise the image, writing its .tbin
+	bool readSource(const char* filename); //size and time of the image, false if it does not exist
+	void build(Image& image, bool mipmaps, bool compress); //mipmaps only for power of two sizes
+	bool readBin(const char* filename);
+	bool writeBin(const char* filename) const;
+};
+
+enum eTextureState { TEXTURE_READY, TEXTURE_LOADING, TEXTURE_STREAMING, TEXTURE_FAILED };
+
 // TEXTURE CLASS
-class Texture
+class Texture : public Resource
 {
 public:
 	static int default_mag_filter;
 	static int default_min_filter;
 	static FBO* global_fbo;
+	static unsigned int async_upload_budget; //max bytes copied to the upload buffers per frame
+	static unsigned int num_async_loads; //textures from GetAsync being decoded or streamed
+	static bool use_binary; //loads the .tbin of the images, it is written the first time
+	static bool compress_levels; //BC1/BC3 blocks when building the levels (less VRAM and bandwidth but lossy)
 
 	//a general struct to store all the information about a TGA file
 
-	//textures manager
-	static std::map<std::string, Texture*> sTexturesLoaded;
-
 	GLuint texture_id; // GL id to identify the texture in opengl, every texture must have its own id
 	float width;
 	float height;
@@ -84,6 +124,11 @@ public:
 	unsigned int wrapS = GL_CLAMP_TO_EDGE;
 	unsigned int wrapT = GL_CLAMP_TO_EDGE;
 
+	//textures from GetAsync stream their levels from the smallest, the first one can be used while the rest arrive
+	eTextureState state = TEXTURE_READY;
+	unsigned int num_levels = 1;
+	unsigned int base_level = 0; //finest level uploaded
+
 	//original data info
 	Image image;
 
@@ -94,6 +139,11 @@ public:
 
 	void clear();
 
+	size_t getCPUSize() override;
+	size_t getVRAMSize() override;
+	bool canEvict() override { return state != TEXTURE_LOADING && state != TEXTURE_STREAMING; } //its levels are still arriving
+	bool isLoaded() const { return state == TEXTURE_READY || state == TEXTURE_STREAMING; } //it can be sampled
+
 	void create(unsigned int width, unsigned int height, unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, uint8_t* data = NULL, unsigned int internal_format = 0);
 	void create3D(unsigned int width, unsigned int height, unsigned int depth, unsigned int format = GL_RED, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, uint8_t* data = NULL, unsigned int internal_format = 0);
 	void create3D(unsigned int width, unsigned int height, unsigned int depth, unsigned int format = GL_RED, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, float* data = NULL, unsigned int internal_format = 0);
@@ -116,9 +166,16 @@ public:
 	//load without using the manager
 	bool load(const char* filename, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
 
-	//load using the manager (caching loaded ones to avoid reloading them)
+	//load using the manager (caching loaded ones to avoid reloading them), adds a reference, call removeRef() when done with it
+	//it is always ready, a pending GetAsync of the same file is finished before returning
 	static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true);
-	void setName(const char* name) { sTexturesLoaded[name] = this; }
+	static Texture* GetAsync(const char* filename, bool mipmaps = true, bool wrap = true); //decoded in the workers, check isLoaded before using it
+	static void UpdateAsyncLoads(); //streams the decoded levels through the upload buffers, call it once per frame from the main thread
+	static bool Bake(const char* filename, bool mipmaps = true); //writes the .tbin of an image, does not need OpenGL
+
+	void allocateLevels(const sTextureData& data, bool wrap); //storage for all the levels, sampled from the smallest uploaded
+	void uploadLevel(const sTextureData& data, int level, const void* pixels); //pixels is an offset if a GL_PIXEL_UNPACK_BUFFER is bound
+	void setName(const char* name) { ResourceManager::Register(name, this); }
 
 	void generateMipmaps();
 
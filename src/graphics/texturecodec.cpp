@@ -0,0 +1,235 @@
+#include "texturecodec.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+bool isBlockEncoding(eTextureEncoding encoding)
+{
+	return encoding == TEXTURE_ENCODING_BC1 || encoding == TEXTURE_ENCODING_BC3;
+}
+
+size_t getEncodedLevelSize(eTextureEncoding encoding, int width, int height)
+{
+	size_t num_blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	switch (encoding)
+	{
+		case TEXTURE_ENCODING_RGB8: return (size_t)width * height * 3;
+		case TEXTURE_ENCODING_RGBA8: return (size_t)width * height * 4;
+		case TEXTURE_ENCODING_BC1: return num_blocks * 8;
+		case TEXTURE_ENCODING_BC3: return num_blocks * 16;
+	}
+	return 0;
+}
+
+//texels of a block as RGBA, the ones out of the image repeat the border
+static void fetchBlock(const uint8_t* src, int width, int height, int bytes_per_pixel, int bx, int by, uint8_t block[16][4])
+{
+	for (int y = 0; y < 4; ++y)
+		for (int x = 0; x < 4; ++x)
+		{
+			int sx = std::min(bx * 4 + x, width - 1);
+			int sy = std::min(by * 4 + y, height - 1);
+			const uint8_t* p = src + ((size_t)sy * width + sx) * bytes_per_pixel;
+			uint8_t* texel = block[y * 4 + x];
+			texel[0] = p[0];
+			texel[1] = p[1];
+			texel[2] = p[2];
+			texel[3] = bytes_per_pixel == 4 ? p[3] : 255;
+		}
+}
+
+static inline uint16_t packRGB565(const float* color)
+{
+	int r = (int)std::clamp(color[0] * (31.f / 255.f) + 0.5f, 0.f, 31.f);
+	int g = (int)std::clamp(color[1] * (63.f / 255.f) + 0.5f, 0.f, 63.f);
+	int b = (int)std::clamp(color[2] * (31.f / 255.f) + 0.5f, 0.f, 31.f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static inline void unpackRGB565(uint16_t value, int* color)
+{
+	int r = (value >> 11) & 31;
+	int g = (value >> 5) & 63;
+	int b = value & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+//8 bytes: two 565 endpoints and 2 bits per texel, always in the 4 colors mode (color0 > color1)
+static void encodeColorBlock(const uint8_t block[16][4], uint8_t* out)
+{
+	float mean[3] = { 0.f, 0.f, 0.f };
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < 3; ++c)
+			mean[c] += block[i][c];
+	for (int c = 0; c < 3; ++c)
+		mean[c] /= 16.f;
+
+	//covariance: rr rg rb gg gb bb
+	float cov[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+	for (int i = 0; i < 16; ++i)
+	{
+		float r = block[i][0] - mean[0];
+		float g = block[i][1] - mean[1];
+		float b = block[i][2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	//main axis with a few power iterations
+	float axis[3] = { 1.f, 1.f, 1.f };
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float v[3] = {
+			cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+			cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+			cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+		float scale = std::max(std::fabs(v[0]), std::max(std::fabs(v[1]), std::fabs(v[2])));
+		if (scale < 1e-6f)
+			break; //solid block
+		for (int c = 0; c < 3; ++c)
+			axis[c] = v[c] / scale;
+	}
+	float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	for (int c = 0; c < 3; ++c)
+		axis[c] /= length;
+
+	float min_t = 1e10f, max_t = -1e10f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+		min_t = std::min(min_t, t);
+		max_t = std::max(max_t, t);
+	}
+
+	//inset the extremes, they are usually outliers
+	float inset = (max_t - min_t) / 16.f;
+	float end0[3], end1[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		end0[c] = mean[c] + axis[c] * (max_t - inset);
+		end1[c] = mean[c] + axis[c] * (min_t + inset);
+	}
+
+	uint16_t color0 = packRGB565(end0);
+	uint16_t color1 = packRGB565(end1);
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		int palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0, best_distance = 0x7FFFFFFF;
+			for (int p = 0; p < 4; ++p)
+			{
+				int dr = block[i][0] - palette[p][0];
+				int dg = block[i][1] - palette[p][1];
+				int db = block[i][2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < best_distance)
+				{
+					best_distance = distance;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	out[0] = (uint8_t)(color0 & 0xFF);
+	out[1] = (uint8_t)(color0 >> 8);
+	out[2] = (uint8_t)(color1 & 0xFF);
+	out[3] = (uint8_t)(color1 >> 8);
+	for (int i = 0; i < 4; ++i)
+		out[4 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+//8 bytes: two alpha endpoints and 3 bits per texel, in the 8 values mode (alpha0 > alpha1)
+static void encodeAlphaBlock(const uint8_t block[16][4], uint8_t* out)
+{
+	int alpha_min = 255, alpha_max = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		alpha_min = std::min(alpha_min, (int)block[i][3]);
+		alpha_max = std::max(alpha_max, (int)block[i][3]);
+	}
+
+	out[0] = (uint8_t)alpha_max;
+	out[1] = (uint8_t)alpha_min;
+	memset(out + 2, 0, 6);
+	if (alpha_max == alpha_min)
+		return;
+
+	int palette[8];
+	palette[0] = alpha_max;
+	palette[1] = alpha_min;
+	for (int i = 2; i < 8; ++i)
+		palette[i] = ((8 - i) * alpha_max + (i - 1) * alpha_min) / 7;
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		int best = 0, best_distance = 256;
+		for (int p = 0; p < 8; ++p)
+		{
+			int distance = std::abs(block[i][3] - palette[p]);
+			if (distance < best_distance)
+			{
+				best_distance = distance;
+				best = p;
+			}
+		}
+		indices |= (uint64_t)best << (i * 3);
+	}
+
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+void encodeBC1(const uint8_t* src, int width, int height, int bytes_per_pixel, std::vector<uint8_t>& out)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	size_t start = out.size();
+	out.resize(start + (size_t)blocks_x * blocks_y * 8);
+
+	uint8_t block[16][4];
+	uint8_t* dst = &out[start];
+	for (int by = 0; by < blocks_y; ++by)
+		for (int bx = 0; bx < blocks_x; ++bx, dst += 8)
+		{
+			fetchBlock(src, width, height, bytes_per_pixel, bx, by, block);
+			encodeColorBlock(block, dst);
+		}
+}
+
+void encodeBC3(const uint8_t* src, int width, int height, std::vector<uint8_t>& out)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	size_t start = out.size();
+	out.resize(start + (size_t)blocks_x * blocks_y * 16);
+
+	uint8_t block[16][4];
+	uint8_t* dst = &out[start];
+	for (int by = 0; by < blocks_y; ++by)
+		for (int bx = 0; bx < blocks_x; ++bx, dst += 16)
+		{
+			fetchBlock(src, width, height, 4, bx, by, block);
+			encodeAlphaBlock(block, dst);
+			encodeColorBlock(block, dst + 8);
+		}
+}
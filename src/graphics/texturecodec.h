@@ -0,0 +1,20 @@
+/*
+	Block compression for the levels stored in the .tbin files.
+	BC1 stores 4x4 RGB texels in 8 bytes, BC3 adds 8 bytes of interpolated alpha.
+	The endpoints are fitted along the main axis of the colors of every block.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+enum eTextureEncoding { TEXTURE_ENCODING_RGB8 = 0, TEXTURE_ENCODING_RGBA8 = 1, TEXTURE_ENCODING_BC1 = 2, TEXTURE_ENCODING_BC3 = 3 };
+
+bool isBlockEncoding(eTextureEncoding encoding);
+size_t getEncodedLevelSize(eTextureEncoding encoding, int width, int height);
+
+//src has bytes_per_pixel 3 or 4, the width and height do not need to be multiple of 4 (the borders are repeated)
+void encodeBC1(const uint8_t* src, int width, int height, int bytes_per_pixel, std::vector<uint8_t>& out);
+void encodeBC3(const uint8_t* src, int width, int height, std::vector<uint8_t>& out);
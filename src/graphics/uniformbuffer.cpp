@@ -0,0 +1,58 @@
+#include "uniformbuffer.h"
+
+#include <cassert>
+
+UniformBuffer::UniformBuffer(unsigned int size, unsigned int binding)
+{
+	this->size = 0;
+	this->binding = binding;
+	glGenBuffers(1, &this->buffer_id);
+	resize(size);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	if (this->buffer_id)
+		glDeleteBuffers(1, &this->buffer_id);
+	this->buffer_id = 0;
+}
+
+void UniformBuffer::resize(unsigned int size)
+{
+	assert(size && "uniform buffer must have a size");
+	this->size = size;
+	glBindBuffer(GL_UNIFORM_BUFFER, this->buffer_id);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::upload(const void* data, unsigned int data_size, unsigned int offset)
+{
+	assert(offset + data_size <= this->size && "writing out of the uniform buffer");
+	glBindBuffer(GL_UNIFORM_BUFFER, this->buffer_id);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, data_size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind()
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, this->binding, this->buffer_id);
+}
+
+void UniformBuffer::bindRange(unsigned int offset, unsigned int range_size)
+{
+	assert(offset % GetOffsetAlignment() == 0 && "uniform buffer offset not aligned");
+	glBindBufferRange(GL_UNIFORM_BUFFER, this->binding, this->buffer_id, offset, range_size);
+}
+
+unsigned int UniformBuffer::GetOffsetAlignment()
+{
+	static GLint alignment = 0;
+	if (!alignment)
+	{
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment <= 0)
+			alignment = 256; //the biggest one found in drivers
+	}
+	return (unsigned int)alignment;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../framework/includes.h"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/matrix.hpp>
+
+//std140 layouts of the blocks in the shaders (see eUniformBlock), keep both sides in sync
+
+//written once per frame
+struct sFrameBlock
+{
+	glm::mat4 viewprojection;
+	glm::vec3 camera_position;
+	float time;
+	glm::vec4 ambient_light;
+};
+
+//written once per frame for every light, each pass binds the range of its light
+struct sLightBlock
+{
+	glm::vec4 color;
+	glm::vec3 position;
+	float intensity;
+	glm::vec3 direction;
+	float shininess;
+	int type;
+	float max_distance;
+	float padding[2];
+};
+
+//max lights shaded by the single pass shaders, same value as MAX_LIGHTS in normal.fs
+#define MAX_LIGHTS 64
+
+//written once per frame, all the lights for the single pass shaders without clusters
+struct sLightsBlock
+{
+	int num_lights;
+	int padding[3];
+	sLightBlock lights[MAX_LIGHTS];
+};
+
+//written once per frame by LightClusters, the light lists of the clusters are in storage buffers
+struct sClusterBlock
+{
+	glm::uvec4 dims; //number of clusters in x, y and z
+	glm::vec4 depth_params; //projection terms to get the view depth from the fragment depth
+	glm::vec4 slice_params; //scale and bias of the log depth slices, inverse of the viewport size
+};
+
+//streamed for every draw
+struct sObjectBlock
+{
+	glm::mat4 model;
+	glm::vec4 color;
+};
+
+//Wrapper of a GL uniform buffer attached to a fixed binding point
+class UniformBuffer
+{
+public:
+	GLuint buffer_id;
+	unsigned int size;
+	unsigned int binding;
+
+	UniformBuffer(unsigned int size, unsigned int binding);
+	virtual ~UniformBuffer();
+
+	void resize(unsigned int size); //contents are lost
+	void upload(const void* data, unsigned int data_size, unsigned int offset = 0);
+	void bind(); //the whole buffer
+	void bindRange(unsigned int offset, unsigned int range_size);
+
+	static unsigned int GetOffsetAlignment(); //offsets of bindRange must be multiple of this
+	static unsigned int Align(unsigned int size) { unsigned int a = GetOffsetAlignment(); return (size + a - 1) / a * a; }
+};
@@ -1,6 +1,9 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream> // to output
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
 
 // IMGUI
 #include "imgui.h"
@@ -9,6 +12,9 @@
 #include "ImGuizmo.h"
 
 #include "application.h"
+#include "graphics/texture.h"
+#include "graphics/framecapture.h"
+#include "graphics/fbo.h"
 
 // Globals
 Application* app;
@@ -125,6 +131,21 @@ void onScrollEvent(GLFWwindow* window, double xoffset, double yoffset)
 	}
 }
 
+void updateResources()
+{
+	// Finish the meshes loaded in background
+	Mesh::UpdateAsyncLoads();
+
+	// Stream the levels of the textures decoded in background
+	Texture::UpdateAsyncLoads();
+
+	// Swap in the shaders recompiled after their files changed
+	Shader::UpdateHotReload();
+
+	// Free the unused resources if we are over the memory budget
+	ResourceManager::Collect();
+}
+
 void mainLoop(GLFWwindow* window) 
 {
 	int32_t width, height;
@@ -161,9 +182,19 @@ void mainLoop(GLFWwindow* window)
 
 		//ImGui::ShowDemoWindow();
 
+		updateResources();
+
+		// Take the region of the stream buffer that the GPU is done with
+		StreamBuffer::get()->beginFrame();
+
 		app->render();
 
+		// Read back the frame for the recording, before the GUI is drawn on top
+		FrameCapture::get()->captureFrame(width, height);
+
 		renderGUI(window, app);
+
+		StreamBuffer::get()->endFrame();
 		
 		/* Swap front and back buffers */
 		glfwSwapBuffers(window);
@@ -172,19 +203,194 @@ void mainLoop(GLFWwindow* window)
 	}
 }
 
-int main(void) 
+// false if the context cannot run the renderer (SSBOs, indirect draws, immutable storage and fences need 4.3)
+bool initGLEW()
+{
+	/* Glew (OpenGL API) */
+	GLenum glew_error = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// EGL contexts have no GLX display, the GL functions are loaded anyway
+	if (glew_error == GLEW_ERROR_NO_GLX_DISPLAY)
+		glew_error = GLEW_OK;
+#endif
+	if (glew_error != GLEW_OK)
+		std::cout << "[Error] GLEW not initialized" << std::endl;
+	fprintf(stdout, "[INFO] Using GLEW %s\n", glewGetString(GLEW_VERSION));
+
+	// get version info
+	const GLubyte* renderer = glGetString(GL_RENDERER); // get renderer string
+	const GLubyte* version = glGetString(GL_VERSION); // version as a string
+	printf("\n[INFO] Renderer %s", renderer);
+	printf("\n[INFO] OpenGL version supported %s\n\n", version);
+	fflush(stdout);
+
+	if (glew_error != GLEW_OK || !GLEW_VERSION_4_3)
+	{
+		std::cout << "[ERROR] OpenGL 4.3 is required, the context has " << (version ? (const char*)version : "none") << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Renders a fixed number of frames to an offscreen target and exits, for benchmarks and golden images:
+// --headless [--frames N] [--size WxH] [--samples N] [--capture prefix] [--screenshot file.tga]
+int runHeadless(int argc, char** argv)
+{
+	int frames = 100;
+	int width = 1280;
+	int height = 720;
+	int samples = 4;
+	const char* capture = NULL;
+	const char* screenshot = NULL;
+	for (int i = 2; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--frames") == 0 && has_value)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && has_value)
+			sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (strcmp(argv[i], "--samples") == 0 && has_value)
+			samples = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--capture") == 0 && has_value)
+			capture = argv[++i];
+		else if (strcmp(argv[i], "--screenshot") == 0 && has_value)
+			screenshot = argv[++i];
+		else
+			std::cout << "[WARN] Unknown headless option: " << argv[i] << std::endl;
+	}
+	if (frames <= 0 || width <= 0 || height <= 0)
+	{
+		std::cout << "[ERROR] Wrong headless frames or size" << std::endl;
+		return 1;
+	}
+
+#if defined(__linux__) && defined(GLFW_PLATFORM_NULL)
+	// Without display server GLFW creates no windows and the context comes from EGL (Mesa surfaceless)
+	if (!getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY"))
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+	if (!glfwInit())
+		return -1;
+
+	/* The window is never shown, everything is rendered to the FBO */
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+#ifdef GLFW_PLATFORM_NULL
+	if (glfwGetPlatform() == GLFW_PLATFORM_NULL)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
+
+	GLFWwindow* window = glfwCreateWindow(width, height, "VDB Viewer (headless)", nullptr, nullptr);
+	if (!window)
+	{
+		std::cout << "[ERROR] Cannot create the headless context, OpenGL 4.3 is required" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
+	if (!initGLEW())
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return 1;
+	}
+
+	app = new Application();
+	app->init(window);
+
+	FBO* fbo = new FBO();
+	if (!fbo->create(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, true, samples))
+	{
+		delete fbo;
+		delete app;
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return 1;
+	}
+
+	// The resources loaded in background must be there from the first frame measured
+	auto warmup_start = std::chrono::steady_clock::now();
+	while ((Mesh::num_async_loads || Texture::num_async_loads) && std::chrono::steady_clock::now() - warmup_start < std::chrono::seconds(10))
+		updateResources();
+	if (Mesh::num_async_loads || Texture::num_async_loads)
+		std::cout << "[WARN] Resources still loading after the warm up" << std::endl;
+
+	if (capture)
+		FrameCapture::get()->startTGASequence(capture);
+
+	// Fixed time step and clock so every run renders the same frames
+	const double delta_time = 1.0 / 60.0;
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames && !app->close; ++frame)
+	{
+		glfwPollEvents();
+		glfwSetTime(frame * delta_time);
+		app->update(delta_time);
+		updateResources();
+
+		StreamBuffer::get()->beginFrame();
+
+		fbo->bind();
+		app->render();
+		fbo->unbind();
+		fbo->resolve();
+
+		if (screenshot && frame == frames - 1)
+			FrameCapture::get()->screenshot(screenshot);
+		fbo->bindRead();
+		FrameCapture::get()->captureFrame(width, height);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		StreamBuffer::get()->endFrame();
+		glFlush();
+	}
+	glFinish();
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	FrameCapture::get()->stop();
+	std::cout << " + Headless: " << frames << " frames at " << width << "x" << height << " (" << fbo->samples << " samples), "
+		<< elapsed.count() / frames << " ms per frame" << std::endl;
+
+	delete fbo;
+	delete app;
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
+
+int main(int argc, char** argv)
 {
+	// Offline conversion of images to .tbin: --bake-textures image.tga ...
+	if (argc > 1 && strcmp(argv[1], "--bake-textures") == 0)
+	{
+		int failed = 0;
+		for (int i = 2; i < argc; ++i)
+			if (!Texture::Bake(argv[i]))
+			{
+				std::cout << "[ERROR] Texture not baked: " << argv[i] << std::endl;
+				failed++;
+			}
+		return failed ? 1 : 0;
+	}
+
+	// Offscreen rendering without a visible window: --headless --frames 100 ...
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+		return runHeadless(argc, argv);
+
 	/* Glfw (Window API) */
 	if (!glfwInit())
 		return -1;
 
 	/* Create a windowed mode window and its OpenGL context */
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 
 	GLFWwindow* window = glfwCreateWindow(1600, 900, "VDB Viewer", nullptr, nullptr); // 1600, 900 or 1280, 720
 	if (!window)
 	{
+		std::cout << "[ERROR] Cannot create the window, OpenGL 4.3 is required" << std::endl;
 		glfwTerminate();
 		return -1;
 	}
@@ -193,17 +399,12 @@ int main(void)
 	glfwMakeContextCurrent(window);
 	glfwSwapInterval(1); // Enable vsync
 
-	/* Glew (OpenGL API) */
-	if (glewInit() != GLEW_OK)
-		std::cout << "[Error] GLEW not initialized" << std::endl;
-	fprintf(stdout, "[INFO] Using GLEW %s\n", glewGetString(GLEW_VERSION));
-
-	// get version info
-	const GLubyte* renderer = glGetString(GL_RENDERER); // get renderer string
-	const GLubyte* version = glGetString(GL_VERSION); // version as a string
-	printf("\n[INFO] Renderer %s", renderer);
-	printf("\n[INFO] OpenGL version supported %s\n\n", version);
-	fflush(stdout);
+	if (!initGLEW())
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return -1;
+	}
 
 	// Bind event callbacks
 	glfwSetKeyCallback(window, onKeyEvent);
@@ -231,6 +432,9 @@ int main(void)
 	// Main loop, application gets inside here till user closes it
 	mainLoop(window);
 
+	// Write the frames still in flight
+	FrameCapture::get()->stop();
+
 	// Free memory
 	delete app;
 